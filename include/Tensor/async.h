@@ -0,0 +1,412 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <optional>
+#include <atomic>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor.h"
+#include "parallel.h"
+#include "copy.h"
+#include "gemm.h"
+#include "operands.h"
+#include "reduction.h"
+#include "io.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * Asynchronous operations. Each async_* call queues the
+ * operation on the library pool and returns a Task, a
+ * shared future that can be waited on or chained:
+ *
+ *     Tensor<float, 2> next;
+ *     auto io = async_load("batch1.tns", next);
+ *     auto p  = async_matmul(a, b).then([](const Tensor<float, 2>& c) { ... });
+ *     p.wait();
+ *     io.get();
+ *
+ * A task runs on one worker (kernels called from a worker
+ * are serial), so several of them run side by side, and
+ * kernels called meanwhile by the caller do not wait for
+ * the workers the tasks hold. The
+ * tensors passed by reference must outlive the task and
+ * not be written while it runs. Do not wait on a task
+ * from inside another one: chain them with then() or
+ * when_all(). With a single thread the operations run
+ * on the spot.
+ */
+
+template <typename R>
+class Task;
+
+namespace tensor_impl {
+
+struct _Task_access;
+
+/**
+ * @brief The _Task_state struct. Result of a task, and the
+ *        continuations to queue when it is set.
+ */
+template <typename R>
+struct _Task_state {
+
+    using Stored = std::conditional_t<std::is_void<R>::value, char, R>;
+
+    /// Run f and keep its result or its exception.
+    template <typename F>
+    void
+    run(F& f)
+    {
+        try {
+            if constexpr (std::is_void<R>::value)
+                f();
+            else
+                value.emplace(f());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        finish();
+    }
+
+    void
+    fail(std::exception_ptr e)
+    {
+        error = e;
+        finish();
+    }
+
+    void
+    finish()
+    {
+        std::vector<std::function<void()>> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            next.swap(waiting);
+        }
+        cv.notify_all();
+        for (auto& g : next)
+            Thread_pool::instance().submit(std::move(g));
+    }
+
+    /// Queue g when the result is set (now if it is).
+    void
+    on_done(std::function<void()> g)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!done) {
+                waiting.push_back(std::move(g));
+                return;
+            }
+        }
+        Thread_pool::instance().submit(std::move(g));
+    }
+
+    void
+    wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return done; });
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::optional<Stored> value;
+    std::exception_ptr error;
+    std::vector<std::function<void()>> waiting;
+};
+
+/// Result type of a continuation of a Task<R>.
+template <typename R, typename F>
+struct _Then {
+    using type = std::invoke_result_t<F, const R&>;
+};
+
+template <typename F>
+struct _Then<void, F> {
+    using type = std::invoke_result_t<F>;
+};
+
+};
+
+/**
+ * @brief The Task class. Shared handle on the result of an
+ *        operation queued on the pool; copies refer to the
+ *        same result.
+ */
+template <typename R>
+class Task {
+public:
+
+    using value_type = R;
+
+    Task() = default;
+
+    /**
+     * @brief valid.
+     * @return true if the task refers to an operation.
+     */
+    bool
+    valid() const
+    { return bool(_s); }
+
+    /**
+     * @brief ready.
+     * @return true if the operation is over.
+     */
+    bool
+    ready() const
+    {
+        assert(valid());
+        std::lock_guard<std::mutex> lock(_s->mutex);
+        return _s->done;
+    }
+
+    /**
+     * @brief wait. Block until the operation is over.
+     */
+    void
+    wait() const
+    {
+        assert(valid());
+        _s->wait();
+    }
+
+    /**
+     * @brief get. Wait, then rethrow the exception of the
+     *        operation if it threw.
+     * @return the result (nothing for Task<void>).
+     */
+    decltype(auto)
+    get() const
+    {
+        wait();
+        if (_s->error)
+            std::rethrow_exception(_s->error);
+        if constexpr (!std::is_void<R>::value)
+            return static_cast<const R&>(*_s->value);
+    }
+
+    /**
+     * @brief then. Queue f(result) (f() for Task<void>) when
+     *        this task is over. If it threw, f is not called
+     *        and the new task holds the same exception.
+     * @param f
+     * @return the task of f.
+     */
+    template <typename F>
+    auto
+    then(F f) const
+    {
+        assert(valid());
+        using U = typename tensor_impl::_Then<R, F>::type;
+        Task<U> next(std::make_shared<tensor_impl::_Task_state<U>>());
+        auto s = _s;
+        auto ns = next._s;
+        _s->on_done([s, ns, f]() mutable {
+            if (s->error)
+                return ns->fail(s->error);
+            auto g = [&]() -> U {
+                if constexpr (std::is_void<R>::value)
+                    return f();
+                else
+                    return f(static_cast<const R&>(*s->value));
+            };
+            ns->run(g);
+        });
+        return next;
+    }
+
+private:
+
+    template <typename U>
+    friend class Task;
+
+    friend struct tensor_impl::_Task_access;
+
+    explicit Task(std::shared_ptr<tensor_impl::_Task_state<R>> s)
+        : _s{std::move(s)}
+    {}
+
+    std::shared_ptr<tensor_impl::_Task_state<R>> _s;
+};
+
+namespace tensor_impl {
+
+/// Creation of tasks and access to their state.
+struct _Task_access {
+
+    template <typename R>
+    static Task<R>
+    make()
+    { return Task<R>(std::make_shared<_Task_state<R>>()); }
+
+    template <typename R>
+    static const std::shared_ptr<_Task_state<R>>&
+    state(const Task<R>& t)
+    { return t._s; }
+};
+
+};
+
+/**
+ * @brief run_async. Queue f() on the pool.
+ * @param f copyable callable.
+ * @return the task of f.
+ */
+template <typename F>
+auto
+run_async(F f)
+{
+    using R = std::invoke_result_t<F>;
+    auto t = tensor_impl::_Task_access::make<R>();
+    auto s = tensor_impl::_Task_access::state(t);
+    Thread_pool::instance().submit([s, f]() mutable { s->run(f); });
+    return t;
+}
+
+/**
+ * @brief when_all. Task over when all of ts are; it holds
+ *        the exception of the first of them that threw.
+ * @param ts
+ * @return Task<void>
+ */
+template <typename... Rs>
+Task<void>
+when_all(const Task<Rs>&... ts)
+{
+    auto all = tensor_impl::_Task_access::make<void>();
+    auto s = tensor_impl::_Task_access::state(all);
+    if constexpr (sizeof...(Rs) == 0) {
+        s->finish();
+    } else {
+        struct Join {
+            std::atomic<std::size_t> left{sizeof...(Rs)};
+            std::exception_ptr error;
+        };
+        auto j = std::make_shared<Join>();
+        auto arm = [&](const auto& t) {
+            auto d = tensor_impl::_Task_access::state(t);
+            d->on_done([j, s, d] {
+                /// The error is set before the decrement that
+                /// releases it to the last dependency.
+                if (d->error) {
+                    std::lock_guard<std::mutex> lock(s->mutex);
+                    if (!j->error)
+                        j->error = d->error;
+                }
+                if (j->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    if (j->error)
+                        s->fail(j->error);
+                    else
+                        s->finish();
+                }
+            });
+        };
+        (arm(ts), ...);
+    }
+    return all;
+}
+
+/**
+ * @brief async_gemm. gemm(c, a, b, alpha, beta) on the pool.
+ * @return Task<void>
+ */
+template <typename C, typename A, typename B,
+          typename T = Value_type<std::remove_reference_t<C>>,
+          typename = Enable_if<(_2d<std::remove_reference_t<C>>() && _2d<A>() && _2d<B>())>>
+Task<void>
+async_gemm(C&& c, const A& a, const B& b, T alpha = T(1), T beta = T(0))
+{
+    /// c may be a temporary view: keep a view of it.
+    Tensor_ref<T, 2> r(c.descriptor(), c.data());
+    return run_async([r, &a, &b, alpha, beta]() mutable { gemm(r, a, b, alpha, beta); });
+}
+
+/**
+ * @brief async_matmul. a * b on the pool.
+ * @param a
+ * @param b
+ * @return Task of the product.
+ */
+template <typename T1, typename T2,
+          typename = Enable_if<(_2d<T1>() && _2d<T2>())>>
+Task<Tensor<Value_type<T1>, 2>>
+async_matmul(const T1& a, const T2& b)
+{ return run_async([&a, &b] { return Tensor<Value_type<T1>, 2>(a * b); }); }
+
+/**
+ * @brief async_sum. sum<Acc>(t, s) on the pool.
+ * @param t
+ * @param s
+ * @return Task of the sum.
+ */
+template <typename Acc, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Task<Acc>
+async_sum(const M& t, Summation s = Summation::naive)
+{ return run_async([&t, s] { return sum<Acc>(t, s); }); }
+
+/**
+ * @brief async_copy. Copy src into dst (same extents) on
+ *        the pool.
+ * @param dst tensor or view.
+ * @param src
+ * @return Task<void>
+ */
+template <typename D, typename S,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<D>>() && _tensor_type<S>())>>
+Task<void>
+async_copy(D&& dst, const S& src)
+{
+    auto* d = dst.data();
+    const auto dd = dst.descriptor();
+    const auto* p = src.data();
+    const auto sd = src.descriptor();
+    assert(dd.extents == sd.extents);
+    return run_async([=] { tensor_impl::_copy(p, sd, d, dd); });
+}
+
+/**
+ * @brief async_save. save(path, t) on the pool.
+ * @param path
+ * @param t
+ * @return Task of the success flag.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Task<bool>
+async_save(const std::string& path, const M& t)
+{ return run_async([path, &t] { return save(path, t); }); }
+
+/**
+ * @brief async_load. load(path, t) on the pool; t must not
+ *        be used until the task is over.
+ * @param path
+ * @param t
+ * @return Task of the success flag.
+ */
+template <typename T, std::size_t N>
+Task<bool>
+async_load(const std::string& path, Tensor<T, N>& t)
+{ return run_async([path, &t] { return load(path, t); }); }
+
+NUM_END
+
+#endif // ASYNC_H
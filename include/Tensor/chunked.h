@@ -0,0 +1,742 @@
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor.h"
+#include "tensor_slice.h"
+#include "copy.h"
+#include "parallel.h"
+#include "storage.h"
+#include "io.h"
+#include "traits.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * Chunked compressed tensor files. The tensor is cut in
+ * tiles of fixed extents (smaller at the upper edges), each
+ * compressed on its own, so that any box can be read by
+ * decoding only the tiles it touches:
+ *
+ *     "TNSC", version, kind, element size, rank   (8 bytes)
+ *     codec, 7 reserved bytes                     (8 bytes)
+ *     extents, tile extents                       (2 x rank x uint64)
+ *     index: offset, size of each tile            (2 x uint64 per tile)
+ *     tiles
+ *
+ * Tiles are numbered in row-major order of the tile grid;
+ * their elements are in row-major order. A tile whose
+ * encoding is not smaller than the raw bytes is stored raw.
+ */
+
+/// Encoding of the tiles.
+enum class Chunk_codec : std::uint8_t {
+    raw,        ///< as is.
+    lz,         ///< LZ77 on the bytes of the elements.
+    shuffle_lz  ///< byte planes first (byte 0 of all elements, byte 1, ...), then LZ77.
+};
+
+namespace tensor_impl {
+
+constexpr char _chunk_magic[4] = {'T', 'N', 'S', 'C'};
+constexpr std::uint8_t _chunk_version = 1;
+
+/// Size of the match finder table (log2), longest match offset.
+constexpr std::size_t _lz_hash_bits = 14;
+constexpr std::size_t _lz_window = 65535;
+
+/// Tiles compressed per batch and thread when writing.
+constexpr std::size_t _chunk_batch = 4;
+
+/**
+ * @brief _shuffle. Split n elements of S bytes into byte
+ *        planes: dst[b * n + i] = byte b of element i.
+ */
+template <std::size_t S>
+void
+_shuffle(const std::uint8_t* __restrict src, std::uint8_t* __restrict dst, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t b = 0; b < S; ++b)
+            dst[b * n + i] = src[i * S + b];
+}
+
+/**
+ * @brief _unshuffle. Inverse of _shuffle.
+ */
+template <std::size_t S>
+void
+_unshuffle(const std::uint8_t* __restrict src, std::uint8_t* __restrict dst, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t b = 0; b < S; ++b)
+            dst[i * S + b] = src[b * n + i];
+}
+
+/**
+ * @brief _shuffle_bytes. _shuffle (or _unshuffle if back)
+ *        for the usual element sizes; any other size goes
+ *        through the generic loop.
+ */
+inline void
+_shuffle_bytes(const std::uint8_t* src, std::uint8_t* dst, std::size_t n,
+               std::size_t size, bool back)
+{
+    switch (size) {
+    case 2: return back ? _unshuffle<2>(src, dst, n) : _shuffle<2>(src, dst, n);
+    case 4: return back ? _unshuffle<4>(src, dst, n) : _shuffle<4>(src, dst, n);
+    case 8: return back ? _unshuffle<8>(src, dst, n) : _shuffle<8>(src, dst, n);
+    default:
+        for (std::size_t b = 0; b < size; ++b)
+            for (std::size_t i = 0; i < n; ++i) {
+                if (back)
+                    dst[i * size + b] = src[b * n + i];
+                else
+                    dst[b * n + i] = src[i * size + b];
+            }
+    }
+}
+
+inline void
+_lz_put_length(std::vector<std::uint8_t>& out, std::size_t l)
+{
+    for (; l >= 255; l -= 255)
+        out.push_back(255);
+    out.push_back(std::uint8_t(l));
+}
+
+/**
+ * @brief _lz_compress. LZ77 with a single-probe hash match
+ *        finder. Sequences are a token (literal length,
+ *        match length - 4, 4 bits each, 15 meaning that more
+ *        length bytes follow), the literals, a 16 bit offset
+ *        and the extra length bytes; the last sequence has
+ *        literals only. Runs are matches at offset 1.
+ * @param src
+ * @param n
+ * @param out
+ */
+inline void
+_lz_compress(const std::uint8_t* src, std::size_t n, std::vector<std::uint8_t>& out)
+{
+    out.clear();
+    std::vector<std::size_t> table(std::size_t{1} << _lz_hash_bits, 0);
+    std::size_t anchor = 0;
+
+    auto emit = [&](std::size_t end, std::size_t offset, std::size_t match) {
+        const std::size_t lit = end - anchor;
+        std::uint8_t token = std::uint8_t(std::min<std::size_t>(lit, 15) << 4);
+        if (match)
+            token |= std::uint8_t(std::min<std::size_t>(match - 4, 15));
+        out.push_back(token);
+        if (lit >= 15)
+            _lz_put_length(out, lit - 15);
+        out.insert(out.end(), src + anchor, src + end);
+        if (match) {
+            out.push_back(std::uint8_t(offset));
+            out.push_back(std::uint8_t(offset >> 8));
+            if (match - 4 >= 15)
+                _lz_put_length(out, match - 4 - 15);
+        }
+    };
+
+    std::size_t i = 0;
+    while (i + 4 <= n) {
+        std::uint32_t v;
+        std::memcpy(&v, src + i, 4);
+        const std::size_t h = std::uint32_t(v * 2654435761u) >> (32 - _lz_hash_bits);
+        const std::size_t c = table[h];
+        table[h] = i + 1;
+        if (c && i - (c - 1) <= _lz_window && std::memcmp(src + c - 1, src + i, 4) == 0) {
+            const std::size_t p = c - 1;
+            std::size_t l = 4;
+            while (i + l < n && src[p + l] == src[i + l])
+                ++l;
+            emit(i, i - p, l);
+            i += l;
+            anchor = i;
+        } else {
+            ++i;
+        }
+    }
+    emit(n, 0, 0);
+}
+
+/**
+ * @brief _lz_decompress. Decode exactly m bytes.
+ * @return false if the input is not a valid encoding of m
+ *         bytes.
+ */
+inline bool
+_lz_decompress(const std::uint8_t* src, std::size_t n, std::uint8_t* dst, std::size_t m)
+{
+    std::size_t i = 0, o = 0;
+    auto length = [&](std::size_t& l) {
+        std::uint8_t b;
+        do {
+            if (i == n)
+                return false;
+            b = src[i++];
+            l += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (i < n) {
+        const std::uint8_t token = src[i++];
+        std::size_t lit = token >> 4;
+        if (lit == 15 && !length(lit))
+            return false;
+        if (lit > n - i || lit > m - o)
+            return false;
+        std::memcpy(dst + o, src + i, lit);
+        i += lit;
+        o += lit;
+        if (i == n)
+            break;
+
+        if (n - i < 2)
+            return false;
+        const std::size_t offset = std::size_t(src[i]) | std::size_t(src[i + 1]) << 8;
+        i += 2;
+        std::size_t match = token & 15;
+        if (match == 15 && !length(match))
+            return false;
+        match += 4;
+        if (offset == 0 || offset > o || match > m - o)
+            return false;
+        if (offset == 1)
+            std::memset(dst + o, dst[o - 1], match);
+        else
+            for (std::size_t k = 0; k < match; k += offset)
+                std::memcpy(dst + o + k, dst + o - offset + k, std::min(offset, match - k));
+        o += match;
+    }
+    return o == m;
+}
+
+/**
+ * @brief The _Chunk_grid struct. Tiles of a chunked tensor.
+ */
+template <std::size_t N>
+struct _Chunk_grid {
+
+    _Chunk_grid() = default;
+
+    _Chunk_grid(const std::array<std::size_t, N>& e,
+                const std::array<std::size_t, N>& c)
+        : extents{e},
+          chunk{c},
+          count{1}
+    {
+        for (std::size_t d = 0; d < N; ++d) {
+            assert(chunk[d] > 0);
+            grid[d] = extents[d] / chunk[d] + (extents[d] % chunk[d] != 0);
+            count *= grid[d];
+        }
+    }
+
+    /// Grid coordinates of tile i.
+    std::array<std::size_t, N>
+    coords(std::size_t i) const
+    {
+        std::array<std::size_t, N> g;
+        for (std::size_t d = N; d-- > 0;) {
+            g[d] = i % grid[d];
+            i /= grid[d];
+        }
+        return g;
+    }
+
+    std::size_t
+    index(const std::array<std::size_t, N>& g) const
+    {
+        std::size_t i = 0;
+        for (std::size_t d = 0; d < N; ++d)
+            i = i * grid[d] + g[d];
+        return i;
+    }
+
+    /// First element and extents of tile i.
+    void
+    tile(std::size_t i, std::array<std::size_t, N>& first,
+         std::array<std::size_t, N>& exts) const
+    {
+        const auto g = coords(i);
+        for (std::size_t d = 0; d < N; ++d) {
+            first[d] = g[d] * chunk[d];
+            exts[d] = std::min(chunk[d], extents[d] - first[d]);
+        }
+    }
+
+    std::array<std::size_t, N> extents;
+    std::array<std::size_t, N> chunk;
+    std::array<std::size_t, N> grid;
+    std::size_t count = 0;
+};
+
+/**
+ * @brief _sub_slice. Box [first, first + exts) of a tensor
+ *        described by d.
+ */
+template <std::size_t N>
+Tensor_slice<N>
+_sub_slice(const Tensor_slice<N>& d, const std::array<std::size_t, N>& first,
+           const std::array<std::size_t, N>& exts)
+{
+    Tensor_slice<N> s(exts);
+    s.start = d.start;
+    s.strides = d.strides;
+    for (std::size_t i = 0; i < N; ++i)
+        s.start += first[i] * d.strides[i];
+    return s;
+}
+
+/**
+ * @brief _encode_chunk. Encode the bytes of n elements of
+ *        size bytes; out is left empty if raw is as small.
+ */
+inline void
+_encode_chunk(Chunk_codec codec, const std::uint8_t* p, std::size_t n, std::size_t size,
+              std::vector<std::uint8_t>& tmp, std::vector<std::uint8_t>& out)
+{
+    out.clear();
+    const std::size_t bytes = n * size;
+    if (codec == Chunk_codec::raw)
+        return;
+    if (codec == Chunk_codec::shuffle_lz && size > 1) {
+        tmp.resize(bytes);
+        _shuffle_bytes(p, tmp.data(), n, size, false);
+        p = tmp.data();
+    }
+    _lz_compress(p, bytes, out);
+    if (out.size() >= bytes)
+        out.clear();
+}
+
+/**
+ * @brief _decode_chunk. Inverse of _encode_chunk, into dst
+ *        (n * size bytes).
+ * @return false if the data is corrupt.
+ */
+inline bool
+_decode_chunk(Chunk_codec codec, const std::uint8_t* src, std::size_t stored,
+              std::uint8_t* dst, std::size_t n, std::size_t size,
+              std::vector<std::uint8_t>& tmp)
+{
+    const std::size_t bytes = n * size;
+    if (stored == bytes) {
+        std::memcpy(dst, src, bytes);
+        return true;
+    }
+    if (codec == Chunk_codec::raw)
+        return false;
+    if (codec == Chunk_codec::shuffle_lz && size > 1) {
+        tmp.resize(bytes);
+        if (!_lz_decompress(src, stored, tmp.data(), bytes))
+            return false;
+        _shuffle_bytes(tmp.data(), dst, n, size, true);
+        return true;
+    }
+    return _lz_decompress(src, stored, dst, bytes);
+}
+
+/**
+ * @brief _mul_fits. a *= b, unless it overflows.
+ * @return true if it does not, false otherwise.
+ */
+inline bool
+_mul_fits(std::size_t& a, std::size_t b)
+{
+    if (b != 0 && a > std::numeric_limits<std::size_t>::max() / b)
+        return false;
+    a *= b;
+    return true;
+}
+
+template <typename T>
+void
+_put(std::ostream& os, T x)
+{ os.write(reinterpret_cast<const char*>(&x), sizeof(x)); }
+
+template <typename T>
+bool
+_get(std::istream& is, T& x)
+{ return bool(is.read(reinterpret_cast<char*>(&x), sizeof(x))); }
+
+};
+
+/**
+ * @brief save_chunked. Write a tensor (or a view) as a
+ *        chunked file. Tiles are gathered and compressed in
+ *        parallel, a batch at a time.
+ * @param path
+ * @param t
+ * @param chunk extents of the tiles.
+ * @param codec
+ * @return true on success, false otherwise.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+bool
+save_chunked(const std::string& path, const M& t,
+             const std::array<std::size_t, M::order>& chunk,
+             Chunk_codec codec = Chunk_codec::shuffle_lz)
+{
+    using namespace tensor_impl;
+    using T = std::remove_const_t<Value_type<M>>;
+    constexpr std::size_t N = M::order;
+    static_assert (std::is_trivially_copyable<T>::value,
+                   "save_chunked: trivially copyable types only");
+    static_assert (N < 256, "save_chunked: rank too large");
+    TENSOR_TRACE("save_chunked", t);
+
+    const auto& d = t.descriptor();
+    const _Chunk_grid<N> grid(d.extents, chunk);
+    std::ofstream os(path, std::ios::binary);
+    if (!os)
+        return false;
+
+    const std::uint8_t h[8] = {_chunk_version, _io_kind<T>(), std::uint8_t(sizeof(T)),
+                               std::uint8_t(N), std::uint8_t(codec), 0, 0, 0};
+    os.write(_chunk_magic, 4);
+    os.write(reinterpret_cast<const char*>(h), 8);
+    os.write("\0\0\0\0", 4);
+    for (auto e : grid.extents)
+        _put(os, std::uint64_t(e));
+    for (auto c : grid.chunk)
+        _put(os, std::uint64_t(c));
+
+    /// The index is written once the tile sizes are known.
+    const auto index_pos = os.tellp();
+    std::vector<std::uint64_t> index(2 * grid.count, 0);
+    os.write(reinterpret_cast<const char*>(index.data()),
+             std::streamsize(index.size() * sizeof(std::uint64_t)));
+
+    const std::size_t batch = _chunk_batch * Thread_pool::instance().size();
+    std::vector<std::vector<std::uint8_t>> raw(batch), out(batch);
+    std::uint64_t offset = std::uint64_t(os.tellp());
+    for (std::size_t b0 = 0; b0 < grid.count && os; b0 += batch) {
+        const std::size_t nb = std::min(batch, grid.count - b0);
+        _parallel_for(nb, 1, [&](std::size_t b, std::size_t e) {
+            std::vector<std::uint8_t> tmp;
+            for (std::size_t k = b; k < e; ++k) {
+                std::array<std::size_t, N> first, exts;
+                grid.tile(b0 + k, first, exts);
+                const Tensor_slice<N> td(exts);
+                raw[k].resize(td.size * sizeof(T));
+                _copy(t.data(), _sub_slice(d, first, exts),
+                      reinterpret_cast<T*>(raw[k].data()), td);
+                _encode_chunk(codec, raw[k].data(), td.size, sizeof(T), tmp, out[k]);
+            }
+        });
+        for (std::size_t k = 0; k < nb; ++k) {
+            const auto& s = out[k].empty() ? raw[k] : out[k];
+            os.write(reinterpret_cast<const char*>(s.data()), std::streamsize(s.size()));
+            index[2 * (b0 + k)] = offset;
+            index[2 * (b0 + k) + 1] = s.size();
+            offset += s.size();
+        }
+    }
+
+    os.seekp(index_pos);
+    os.write(reinterpret_cast<const char*>(index.data()),
+             std::streamsize(index.size() * sizeof(std::uint64_t)));
+    return bool(os.flush());
+}
+
+/**
+ * @brief The Chunked_file class. Reader of a chunked file:
+ *        the header and the index are loaded at open, tiles
+ *        are read and decoded, in parallel, on demand.
+ */
+template <typename T, std::size_t N>
+class Chunked_file {
+public:
+
+    static_assert (std::is_trivially_copyable<T>::value,
+                   "Chunked_file: trivially copyable types only");
+
+    Chunked_file() = default;
+
+    explicit Chunked_file(const std::string& path)
+    { open(path); }
+
+    /**
+     * @brief open. Load the header and the index of a file
+     *        of T tensors of rank N. Sizes that overflow, an
+     *        index longer than the file, tiles out of the file
+     *        or larger than their raw bytes are rejected
+     *        before anything is allocated.
+     * @param path
+     * @return true on success, false otherwise.
+     */
+    bool
+    open(const std::string& path)
+    {
+        using namespace tensor_impl;
+        _open = false;
+        std::ifstream is(path, std::ios::binary);
+        char m[4];
+        std::uint8_t h[8];
+        if (!is.read(m, 4) || std::memcmp(m, _chunk_magic, 4) != 0 ||
+            !is.read(reinterpret_cast<char*>(h), 8))
+            return false;
+        if (h[0] != _chunk_version || h[1] != _io_kind<T>() || h[2] != sizeof(T) ||
+            h[3] != N || h[4] > std::uint8_t(Chunk_codec::shuffle_lz))
+            return false;
+        is.ignore(4);
+
+        std::array<std::size_t, N> exts, chunk;
+        for (auto* a : {&exts, &chunk})
+            for (auto& e : *a) {
+                std::uint64_t x;
+                if (!_get(is, x))
+                    return false;
+                e = std::size_t(x);
+            }
+        std::size_t elems = sizeof(T), tile = sizeof(T), count = 1;
+        for (std::size_t d = 0; d < N; ++d) {
+            if (chunk[d] == 0)
+                return false;
+            const std::size_t g = exts[d] / chunk[d] + (exts[d] % chunk[d] != 0);
+            if (!_mul_fits(elems, exts[d]) || !_mul_fits(tile, std::min(chunk[d], exts[d])) ||
+                !_mul_fits(count, g))
+                return false;
+        }
+
+        const auto pos = is.tellg();
+        if (pos == std::istream::pos_type(-1) || !is.seekg(0, std::ios::end))
+            return false;
+        const auto end = is.tellg();
+        if (end == std::istream::pos_type(-1) || end < pos || !is.seekg(pos))
+            return false;
+        const std::size_t len = std::size_t(end);
+        const std::size_t data = std::size_t(pos);
+        if (count > (len - data) / (2 * sizeof(std::uint64_t)))
+            return false;
+
+        _Chunk_grid<N> grid(exts, chunk);
+        std::vector<std::uint64_t> index(2 * count);
+        if (!is.read(reinterpret_cast<char*>(index.data()),
+                     std::streamsize(index.size() * sizeof(std::uint64_t))))
+            return false;
+        const std::size_t first = data + index.size() * sizeof(std::uint64_t);
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint64_t off = index[2 * i], size = index[2 * i + 1];
+            std::array<std::size_t, N> tf, te;
+            grid.tile(i, tf, te);
+            if (off < first || size > len || off > len - size ||
+                size > Tensor_slice<N>(te).size * sizeof(T))
+                return false;
+        }
+
+        _grid = grid;
+        _index = std::move(index);
+        _codec = Chunk_codec(h[4]);
+        _path = path;
+        _open = true;
+        return true;
+    }
+
+    bool
+    is_open() const
+    { return _open; }
+
+    /// Extents of the tensor and of its tiles.
+    const std::array<std::size_t, N>&
+    extents() const
+    { return _grid.extents; }
+
+    const std::array<std::size_t, N>&
+    chunk_extents() const
+    { return _grid.chunk; }
+
+    Chunk_codec
+    codec() const
+    { return _codec; }
+
+    /**
+     * @brief chunks.
+     * @return number of tiles.
+     */
+    std::size_t
+    chunks() const
+    { return _grid.count; }
+
+    /**
+     * @brief chunk. Tile i in the whole (row-major) tensor.
+     * @param i
+     * @return Tensor_slice
+     */
+    Tensor_slice<N>
+    chunk(std::size_t i) const
+    {
+        assert(i < _grid.count);
+        std::array<std::size_t, N> first, exts;
+        _grid.tile(i, first, exts);
+        return tensor_impl::_sub_slice(Tensor_slice<N>(_grid.extents), first, exts);
+    }
+
+    /**
+     * @brief stored_bytes.
+     * @return size of tile i in the file.
+     */
+    std::size_t
+    stored_bytes(std::size_t i) const
+    { return std::size_t(_index[2 * i + 1]); }
+
+    /**
+     * @brief read. Read the whole tensor.
+     * @param t
+     * @return true on success, false otherwise.
+     */
+    bool
+    read(Tensor<T, N>& t) const
+    {
+        std::array<std::size_t, N> first{};
+        return read(first, _grid.extents, t);
+    }
+
+    /**
+     * @brief read. Read the box [first, first + exts) into
+     *        t, which takes the extents of the box. Only the
+     *        tiles it touches are read; t is left untouched
+     *        on failure.
+     * @param first
+     * @param exts
+     * @param t
+     * @return true on success, false otherwise.
+     */
+    bool
+    read(const std::array<std::size_t, N>& first,
+         const std::array<std::size_t, N>& exts, Tensor<T, N>& t) const
+    {
+        Tensor<T, N> r(uninitialized, exts);
+        if (!read_into(first, r))
+            return false;
+        t = std::move(r);
+        return true;
+    }
+
+    /**
+     * @brief read_into. Read the box at first with the
+     *        extents of dst into dst (a tensor or a view).
+     * @param first
+     * @param dst
+     * @return true on success, false otherwise.
+     */
+    template <typename M,
+              typename = Enable_if<_tensor_type<std::remove_reference_t<M>>()>>
+    bool
+    read_into(const std::array<std::size_t, N>& first, M&& dst) const
+    {
+        using namespace tensor_impl;
+        static_assert (std::is_same<Value_type<std::remove_reference_t<M>>, T>::value,
+                       "Chunked_file::read_into: types mismatch");
+        if (!_open)
+            return false;
+        const auto& dd = dst.descriptor();
+        const auto& exts = dd.extents;
+        std::array<std::size_t, N> lo, hi;
+        for (std::size_t d = 0; d < N; ++d) {
+            if (exts[d] > _grid.extents[d] || first[d] > _grid.extents[d] - exts[d])
+                return false;
+            if (exts[d] == 0)
+                return true;
+            lo[d] = first[d] / _grid.chunk[d];
+            hi[d] = (first[d] + exts[d] - 1) / _grid.chunk[d] + 1;
+        }
+
+        /// Tiles touched by the box.
+        std::vector<std::size_t> tiles;
+        std::array<std::size_t, N> g = lo;
+        while (true) {
+            tiles.push_back(_grid.index(g));
+            std::size_t d = N;
+            while (d-- > 0 && ++g[d] == hi[d])
+                g[d] = lo[d];
+            if (d == std::size_t(-1))
+                break;
+        }
+        TENSOR_TRACE("read_chunked", Trace_count{dd.size, dd.size * sizeof(T)}, dd);
+
+        T* out = dst.data();
+        std::atomic<bool> ok{true};
+        _parallel_for(tiles.size(), 1, [&](std::size_t b, std::size_t e) {
+            std::ifstream is(_path, std::ios::binary);
+            std::vector<std::uint8_t> stored, tmp;
+            for (std::size_t k = b; k < e && ok.load(std::memory_order_relaxed); ++k) {
+                const std::size_t i = tiles[k];
+                std::array<std::size_t, N> tf, te;
+                _grid.tile(i, tf, te);
+                const Tensor_slice<N> td(te);
+                stored.resize(std::size_t(_index[2 * i + 1]));
+                is.seekg(std::streamoff(_index[2 * i]));
+                Tensor_storage<T> elems(td.size, uninitialized);
+                if (!is.read(reinterpret_cast<char*>(stored.data()), std::streamsize(stored.size())) ||
+                    !_decode_chunk(_codec, stored.data(), stored.size(),
+                                   reinterpret_cast<std::uint8_t*>(elems.data()),
+                                   td.size, sizeof(T), tmp)) {
+                    ok.store(false, std::memory_order_relaxed);
+                    return;
+                }
+
+                /// Intersection of the tile and the box.
+                std::array<std::size_t, N> from, to, ie;
+                for (std::size_t d = 0; d < N; ++d) {
+                    const std::size_t a = std::max(tf[d], first[d]);
+                    const std::size_t z = std::min(tf[d] + te[d], first[d] + exts[d]);
+                    from[d] = a - tf[d];
+                    to[d] = a - first[d];
+                    ie[d] = z - a;
+                }
+                _copy(elems.data(), _sub_slice(td, from, ie),
+                      out, _sub_slice(dd, to, ie));
+            }
+        });
+        return ok.load();
+    }
+
+private:
+
+    std::string _path;
+    tensor_impl::_Chunk_grid<N> _grid;
+    std::vector<std::uint64_t> _index;
+    Chunk_codec _codec = Chunk_codec::raw;
+    bool _open = false;
+};
+
+/**
+ * @brief load_chunked. Read a whole chunked file.
+ * @param path
+ * @param t
+ * @return true on success, false otherwise.
+ */
+template <typename T, std::size_t N>
+bool
+load_chunked(const std::string& path, Tensor<T, N>& t)
+{
+    Chunked_file<T, N> f(path);
+    return f.is_open() && f.read(t);
+}
+
+NUM_END
+
+#endif // CHUNKED_H
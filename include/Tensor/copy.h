@@ -0,0 +1,204 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include <cassert>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "iteration.h"
+#include "parallel.h"
+#include "tensor_slice.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+namespace tensor_impl {
+
+/// Side of the tiles of a blocked 2D (transposing) copy.
+constexpr std::size_t _copy_tile = 32;
+
+/// Bytes below which a copy stays on the calling thread.
+constexpr std::size_t _parallel_copy_bytes = std::size_t{1} << 20;
+
+/// Largest source stride handled by the gather kernel.
+constexpr std::size_t _gather_max_stride = 64;
+
+/**
+ * @brief _copy_run. Copy a run of n elements, converting
+ *        U to T on the fly.
+ * @param dst
+ * @param ds
+ * @param src
+ * @param ss
+ * @param n
+ */
+template <typename T, typename U>
+void
+_copy_run(T* dst, std::size_t ds, const U* src, std::size_t ss, std::size_t n)
+{
+    using V = typename std::remove_const<U>::type;
+    if (ds == 1 && ss == 1) {
+        if constexpr (std::is_same<T, V>::value &&
+                      std::is_trivially_copyable<T>::value)
+            std::memcpy(dst, src, n * sizeof(T));
+        else
+            for (std::size_t i = 0; i < n; ++i)
+                dst[i] = src[i];
+        return;
+    }
+
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    /// Gather of small strides into a unit stride destination.
+    if constexpr (std::is_same<T, V>::value &&
+                  std::is_trivially_copyable<T>::value &&
+                  (sizeof(T) == 4 || sizeof(T) == 8)) {
+        if (ds == 1 && ss <= _gather_max_stride) {
+            const int s = int(ss);
+            if constexpr (sizeof(T) == 4) {
+                const __m256i idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s,
+                                                      4 * s, 5 * s, 6 * s, 7 * s);
+                for (; i + 8 <= n; i += 8) {
+                    auto p = reinterpret_cast<const int*>(src + i * ss);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                        _mm256_i32gather_epi32(p, idx, 4));
+                }
+            } else {
+                const __m128i idx = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+                for (; i + 4 <= n; i += 4) {
+                    auto p = reinterpret_cast<const long long*>(src + i * ss);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                        _mm256_i32gather_epi64(p, idx, 8));
+                }
+            }
+        }
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i * ds] = src[i * ss];
+}
+
+/**
+ * @brief _copy_tiled. Blocked copy of a r x c block, used
+ *        when the source and the destination are contiguous
+ *        along different dimensions (transposition), so
+ *        both sides stay in cache.
+ * @param dst
+ * @param d0
+ * @param d1
+ * @param src
+ * @param s0
+ * @param s1
+ * @param r
+ * @param c
+ */
+template <typename T, typename U>
+void
+_copy_tiled(T* dst, std::size_t d0, std::size_t d1,
+            const U* src, std::size_t s0, std::size_t s1,
+            std::size_t r, std::size_t c)
+{
+    for (std::size_t ib = 0; ib < r; ib += _copy_tile) {
+        std::size_t ie = std::min(r, ib + _copy_tile);
+        for (std::size_t jb = 0; jb < c; jb += _copy_tile) {
+            std::size_t je = std::min(c, jb + _copy_tile);
+            for (std::size_t i = ib; i < ie; ++i)
+                for (std::size_t j = jb; j < je; ++j)
+                    dst[i * d0 + j * d1] = src[i * s0 + j * s1];
+        }
+    }
+}
+
+/**
+ * @brief _copy. Copy between two layouts with the same
+ *        extents, converting U to T in the same pass.
+ *        Dimensions are collapsed first, then:
+ *        contiguous runs  -> memcpy (or a converting loop),
+ *        transposed pairs -> blocked 2D copy,
+ *        small strides    -> gather,
+ *        and large copies are split across the pool.
+ * @param src
+ * @param sd
+ * @param dst
+ * @param dd
+ */
+template <typename U, typename T, std::size_t N>
+void
+_copy(const U* src, const Tensor_slice<N>& sd,
+      T* dst, const Tensor_slice<N>& dd)
+{
+    TENSOR_TRACE("copy", Trace_count{sd.size, sd.size * (sizeof(U) + sizeof(T))}, sd, dd);
+    assert(sd.extents == dd.extents);
+    auto l = _make_loop(dd, sd);
+    T* d = dst + dd.start;
+    const U* s = src + sd.start;
+
+    const std::size_t grain = std::max<std::size_t>(
+                _parallel_copy_bytes / sizeof(T), 1);
+    const std::size_t n = l.inner();
+    const std::size_t rk = l.rank;
+
+    /// One long run: split it.
+    if (rk == 1) {
+        const auto dst_s = l.inner_stride(0), src_s = l.inner_stride(1);
+        _parallel_for(n, grain, [&](std::size_t b, std::size_t e) {
+            _copy_run(d + b * dst_s, dst_s, s + b * src_s, src_s, e - b);
+        });
+        return;
+    }
+
+    if constexpr (N >= 2) {
+        const std::size_t d0 = l.strides[0][rk - 2], d1 = l.strides[0][rk - 1];
+        const std::size_t s0 = l.strides[1][rk - 2], s1 = l.strides[1][rk - 1];
+        const bool transposed = (d1 == 1 && s1 != 1 && s0 == 1) ||
+                                (s1 == 1 && d1 != 1 && d0 == 1);
+
+        if (transposed) {
+            /// Walk every (rank - 2) prefix, copying the last two
+            /// dimensions as tiled blocks; the work is split by
+            /// bands of _copy_tile rows.
+            auto outer = l;
+            outer.rank = rk - 1;
+            const std::size_t r = l.extents[rk - 2];
+            const std::size_t bands = (r + _copy_tile - 1) / _copy_tile;
+            _parallel_for(outer.runs() * bands,
+                          std::max<std::size_t>(grain / (_copy_tile * n), 1),
+                          [&](std::size_t b, std::size_t e) {
+                for (std::size_t q = b; q < e; ++q) {
+                    const std::size_t i0 = (q % bands) * _copy_tile;
+                    const std::size_t rows = std::min(_copy_tile, r - i0);
+                    _for_each_run(outer, q / bands, q / bands + 1,
+                                  [&](std::size_t, T* pd, const U* ps) {
+                        _copy_tiled(pd + i0 * d0, d0, d1, ps + i0 * s0, s0, s1,
+                                    rows, n);
+                    }, d, s);
+                }
+            });
+            return;
+        }
+
+        const auto dst_s = l.inner_stride(0), src_s = l.inner_stride(1);
+        _parallel_for(l.runs(), std::max<std::size_t>(grain / n, 1),
+                      [&](std::size_t b, std::size_t e) {
+            _for_each_run(l, b, e, [&](std::size_t m, T* pd, const U* ps) {
+                _copy_run(pd, dst_s, ps, src_s, m);
+            }, d, s);
+        });
+    }
+}
+
+};
+
+NUM_END
+
+#endif // COPY_H
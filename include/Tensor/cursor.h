@@ -0,0 +1,164 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <iostream>
+#include <array>
+#include <cstddef>
+#include <cassert>
+
+#include "tensor_slice.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Tensor_cursor class. A position in a tensor that
+ *        moves by stride deltas instead of recomputing the
+ *        offset from all indexes, for nested loops and
+ *        stencils:
+ *
+ *            auto c = t.cursor(0, 0, 0);
+ *            for (i...) {
+ *                for (j...) {
+ *                    for (k...) { f(*c, c.at<2>(-1), c.at<2>(1)); c.next<2>(); }
+ *                    c.advance<2>(-K).next<1>();
+ *                }
+ *                c.advance<1>(-J).next<0>();
+ *            }
+ *
+ *        No bounds are checked.
+ */
+template <typename T, std::size_t N>
+class Tensor_cursor {
+public:
+
+    /// Aliases.
+    using value_type = T;
+    using reference = T&;
+    using pointer = T*;
+
+    /**
+     * @brief Tensor_cursor ctor. Cursor on the first element.
+     * @param base
+     * @param desc
+     */
+    Tensor_cursor(T* base, const Tensor_slice<N>& desc)
+        : _origin{base + desc.start},
+          _p{_origin}
+    {
+        for (std::size_t d = 0; d < N; ++d)
+            _strides[d] = std::ptrdiff_t(desc.strides[d]);
+    }
+
+    /**
+     * @brief seek. Move to an absolute position.
+     * @param dims
+     * @return *this.
+     */
+    template <typename... Dims>
+    Tensor_cursor&
+    seek(Dims... dims)
+    {
+        static_assert (sizeof...(Dims) == N,
+                       "Tensor_cursor<T, N>::seek: dimensions mismatch");
+        _p = _origin + _offset(std::make_index_sequence<N>{}, dims...);
+        return *this;
+    }
+
+    /**
+     * @brief next. One step forward along dimension D.
+     * @return *this.
+     */
+    template <std::size_t D>
+    Tensor_cursor&
+    next()
+    {
+        static_assert (D < N, "Tensor_cursor<T, N>::next: D must be lower than N");
+        _p += _strides[D];
+        return *this;
+    }
+
+    /**
+     * @brief prev. One step backward along dimension D.
+     * @return *this.
+     */
+    template <std::size_t D>
+    Tensor_cursor&
+    prev()
+    {
+        static_assert (D < N, "Tensor_cursor<T, N>::prev: D must be lower than N");
+        _p -= _strides[D];
+        return *this;
+    }
+
+    /**
+     * @brief advance. n steps along dimension D (n may be
+     *        negative, e.g. to rewind an inner loop).
+     * @param n
+     * @return *this.
+     */
+    template <std::size_t D>
+    Tensor_cursor&
+    advance(std::ptrdiff_t n)
+    {
+        static_assert (D < N, "Tensor_cursor<T, N>::advance: D must be lower than N");
+        _p += n * _strides[D];
+        return *this;
+    }
+
+    /**
+     * @brief at. Element n steps away along dimension D,
+     *        without moving.
+     * @param n
+     * @return reference.
+     */
+    template <std::size_t D>
+    T&
+    at(std::ptrdiff_t n) const
+    {
+        static_assert (D < N, "Tensor_cursor<T, N>::at: D must be lower than N");
+        return _p[n * _strides[D]];
+    }
+
+    /**
+     * @brief operator *.
+     * @return the element under the cursor.
+     */
+    T&
+    operator*() const
+    { return *_p; }
+
+    /**
+     * @brief get.
+     * @return a pointer to the element under the cursor.
+     */
+    T*
+    get() const
+    { return _p; }
+
+    /**
+     * @brief stride. Step of dimension D in elements.
+     * @return stride.
+     */
+    template <std::size_t D>
+    std::ptrdiff_t
+    stride() const
+    { return _strides[D]; }
+
+private:
+
+    template <std::size_t... I, typename... Dims>
+    std::ptrdiff_t
+    _offset(std::index_sequence<I...>, Dims... dims) const
+    { return (std::ptrdiff_t{0} + ... + (std::ptrdiff_t(dims) * _strides[I])); }
+
+    T* _origin;
+    T* _p;
+    std::array<std::ptrdiff_t, N> _strides;
+};
+
+NUM_END
+
+#endif // CURSOR_H
@@ -0,0 +1,542 @@
+#ifndef GATHER_H
+#define GATHER_H
+
+#include <iostream>
+#include <array>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include <cassert>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "tensor.h"
+#include "tensor_slice.h"
+#include "iteration.h"
+#include "copy.h"
+#include "mask.h"
+#include "parallel.h"
+#include "traits.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * Selection of slices by an index tensor. Along dimension D
+ * of in, gather / take pick the slices idx[j...] (an
+ * embedding lookup is take<0>(table, ids)); the dimensions
+ * of idx replace D in the result, as numpy.take:
+ *
+ *     Tensor<float, 2> table(50000, 256);
+ *     Tensor<std::int32_t, 2> ids(32, 128);
+ *     auto e = take<0>(table, ids);       // 32 x 128 x 256
+ *
+ * scatter writes slices of src back at idx along D of out;
+ * repeated indices are resolved as Scatter says.
+ *
+ * Slices of at least _take_short_run elements per run are
+ * copied one after the other (memcpy when contiguous), the
+ * next ones prefetched, split across the pool by index (by
+ * destination for scatter, so that each thread owns its
+ * slices: no atomics, and the result does not depend on
+ * the number of threads). Thinner slices (e.g. along the
+ * last dimension) are walked element by element, all the
+ * indices for each element; a single thin slice (a vector)
+ * is split by index instead, by destination for scatter.
+ */
+
+/// How scatter resolves indices that repeat.
+enum class Scatter {
+    last,   ///< the slice of the last of them is kept
+    first,  ///< the slice of the first of them is kept
+    add,    ///< the slices are summed into out
+    max,    ///< element-wise maximum with out
+    min     ///< element-wise minimum with out
+};
+
+namespace tensor_impl {
+
+/// Slices ahead of the one copied whose start is prefetched.
+constexpr std::size_t _take_prefetch_distance = 8;
+
+/// Bytes prefetched at the start of a slice.
+constexpr std::size_t _take_prefetch_bytes = 512;
+
+/// Run length below which indices are the innermost loop.
+constexpr std::size_t _take_short_run = 16;
+
+/// Destination buckets per thread of a scatter.
+constexpr std::size_t _scatter_buckets = 4;
+
+/**
+ * @brief _prefetch. Bring the first bytes (at most
+ *        _take_prefetch_bytes) at p into the cache.
+ */
+inline void
+_prefetch(const void* p, std::size_t bytes)
+{
+#if defined(__SSE__)
+    const char* c = static_cast<const char*>(p);
+    const std::size_t n = std::min(bytes, _take_prefetch_bytes);
+    for (std::size_t o = 0; o < n; o += 64)
+        _mm_prefetch(c + o, _MM_HINT_T0);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+/**
+ * @brief _indices. Values of idx, in logical order, checked
+ *        against extent.
+ */
+template <typename X>
+std::vector<std::size_t>
+_indices(const X& idx, std::size_t extent)
+{
+    static_assert (std::is_integral<Value_type<X>>::value, "take: integral indices only");
+    constexpr std::size_t R = X::order;
+    const auto& d = idx.descriptor();
+    std::vector<std::size_t> r(d.size);
+    const auto w = _make_walk<R, 1>(d.extents, {&d});
+    const auto* p = idx.data();
+    w(0, d.size, [&](std::size_t i, std::size_t n, const std::array<std::size_t, 1>& o) {
+        for (std::size_t u = 0; u < n; ++u) {
+            r[i + u] = std::size_t(p[o[0] + u * w.step[0]]);
+            assert(r[i + u] < extent);
+        }
+    });
+    (void)extent;
+    return r;
+}
+
+/**
+ * @brief _position_offsets. Offsets of the logical indices
+ *        of a tensor of extents exts, placed at dimensions
+ *        [D, D + R) of d.
+ */
+template <std::size_t D, std::size_t R, std::size_t N>
+std::vector<std::size_t>
+_position_offsets(const std::array<std::size_t, R>& exts, const Tensor_slice<N>& d)
+{
+    const std::size_t m = _calc_size(exts);
+    std::vector<std::size_t> off(m);
+    for (std::size_t j = 0; j < m; ++j) {
+        std::size_t r = j, o = 0;
+        for (std::size_t k = R; k-- > 0;) {
+            o += (r % exts[k]) * d.strides[D + k];
+            r /= exts[k];
+        }
+        off[j] = o;
+    }
+    return off;
+}
+
+/**
+ * @brief _drop_dims. d without dimensions [D, D + R),
+ *        starting at 0.
+ */
+template <std::size_t D, std::size_t R, std::size_t N>
+Tensor_slice<N - R>
+_drop_dims(const Tensor_slice<N>& d)
+{
+    Tensor_slice<N - R> r;
+    r.start = 0;
+    for (std::size_t k = 0, j = 0; k < N; ++k)
+        if (k < D || k >= D + R) {
+            r.extents[j] = d.extents[k];
+            r.strides[j] = d.strides[k];
+            ++j;
+        }
+    r.size = _calc_size(r.extents);
+    return r;
+}
+
+/**
+ * @brief _slice_loop. Loop over a slice of dst (without
+ *        its dimensions [D, D + RD)) and the matching slice
+ *        of src (without [D, D + RS)), from offset 0: a
+ *        single element if they are scalars.
+ */
+template <std::size_t D, std::size_t RD, std::size_t RS, std::size_t ND, std::size_t NS>
+auto
+_slice_loop(const Tensor_slice<ND>& dd, const Tensor_slice<NS>& sd)
+{
+    static_assert (ND - RD == NS - RS, "take: orders mismatch");
+    if constexpr (ND == RD) {
+        Strided_loop<1, 2> l;
+        l.rank = 1;
+        l.extents[0] = 1;
+        for (auto& s : l.strides)
+            s[0] = 1;
+        return l;
+    } else {
+        return _make_loop(_drop_dims<D, RD>(dd), _drop_dims<D, RS>(sd));
+    }
+}
+
+/// Combination of a source element into a destination one.
+struct _Sc_assign {
+    template <typename T>
+    void operator() (T& z, const T& x) const { z = x; }
+};
+
+struct _Sc_add {
+    template <typename T>
+    void operator() (T& z, const T& x) const { z += x; }
+};
+
+struct _Sc_max {
+    template <typename T>
+    void operator() (T& z, const T& x) const { z = z < x ? x : z; }
+};
+
+struct _Sc_min {
+    template <typename T>
+    void operator() (T& z, const T& x) const { z = x < z ? x : z; }
+};
+
+/**
+ * @brief _scatter_run. op(z[i], x[i]) on runs of n
+ *        elements; z and x do not overlap.
+ */
+template <typename Op, typename T>
+void
+_scatter_run(T* __restrict z, std::size_t sz, const T* __restrict x, std::size_t sx,
+             std::size_t n, Op op)
+{
+    if constexpr (std::is_same<Op, _Sc_assign>::value) {
+        _copy_run(z, sz, x, sx, n);
+    } else if (sz == 1 && sx == 1) {
+        constexpr std::size_t V = 64;
+        std::size_t i = 0;
+        for (; i + V <= n; i += V)
+            for (std::size_t v = 0; v < V; ++v)
+                op(z[i + v], x[i + v]);
+        for (; i < n; ++i)
+            op(z[i], x[i]);
+    } else {
+        for (std::size_t i = 0; i < n; ++i)
+            op(z[i * sz], x[i * sx]);
+    }
+}
+
+/**
+ * @brief _take. Slice j of src (at soff[j]) into slice j
+ *        of dst (at doff[j]) for every j, along the slice
+ *        loop l.
+ */
+template <typename T, std::size_t L>
+void
+_take(const Strided_loop<L, 2>& l, T* pd, const std::vector<std::size_t>& doff,
+      const T* ps, const std::vector<std::size_t>& soff)
+{
+    const std::size_t m = doff.size(), n = l.inner();
+    const std::size_t sz = l.inner_stride(0), sx = l.inner_stride(1);
+    const std::size_t slice = l.runs() * n;
+    if (m == 0 || slice == 0)
+        return;
+
+    /// Thin slices: all the indices for each element, split
+    /// by index if there is a single run (e.g. a vector).
+    if (n < _take_short_run && l.runs() == 1) {
+        _parallel_for(m, std::max<std::size_t>(_parallel_grain / n, 1),
+                      [&](std::size_t b, std::size_t e) {
+            for (std::size_t j = b; j < e; ++j)
+                for (std::size_t i = 0; i < n; ++i)
+                    pd[i * sz + doff[j]] = ps[i * sx + soff[j]];
+        });
+        return;
+    }
+    if (n < _take_short_run) {
+        _parallel_for(l.runs(), std::max<std::size_t>(_parallel_grain / (n * m), 1),
+                      [&](std::size_t b, std::size_t e) {
+            _for_each_run(l, b, e, [&](std::size_t k, T* z, const T* x) {
+                for (std::size_t i = 0; i < k; ++i)
+                    for (std::size_t j = 0; j < m; ++j)
+                        z[i * sz + doff[j]] = x[i * sx + soff[j]];
+            }, pd, ps);
+        });
+        return;
+    }
+
+    const std::size_t bytes = sx == 1 ? n * sizeof(T) : 64;
+    _parallel_for(m, std::max<std::size_t>(_parallel_grain / slice, 1),
+                  [&](std::size_t b, std::size_t e) {
+        for (std::size_t j = b; j < std::min(e, b + _take_prefetch_distance); ++j)
+            _prefetch(ps + soff[j], bytes);
+        for (std::size_t j = b; j < e; ++j) {
+            if (j + _take_prefetch_distance < e)
+                _prefetch(ps + soff[j + _take_prefetch_distance], bytes);
+            _for_each_run(l, [&](std::size_t k, T* z, const T* x) {
+                _copy_run(z, sz, x, sx, k);
+            }, pd + doff[j], ps + soff[j]);
+        }
+    });
+}
+
+/**
+ * @brief _scatter. op(slice idx[j] of dst, slice j of src)
+ *        for every j, along the slice loop l; dst slices are
+ *        at doff[idx], src ones at soff[j]. Repeated
+ *        indices are applied in increasing j, or decreasing
+ *        if reverse (first one kept).
+ */
+template <typename Op, typename T, std::size_t L>
+void
+_scatter(const Strided_loop<L, 2>& l, T* pd, std::size_t extent, std::size_t stride,
+         const std::vector<std::size_t>& idx, const T* ps,
+         const std::vector<std::size_t>& soff, bool reverse, Op op)
+{
+    const std::size_t m = idx.size(), n = l.inner();
+    const std::size_t sz = l.inner_stride(0), sx = l.inner_stride(1);
+    const std::size_t slice = l.runs() * n;
+    if (m == 0 || slice == 0)
+        return;
+
+    /// Thin slices: each element takes all its indices, in
+    /// order. A single run (e.g. a vector) goes by destination
+    /// below, unless it is small or there is no thread to
+    /// split it across.
+    const bool serial = Thread_pool::instance().size() == 1 || Thread_pool::in_worker() ||
+                        m * n < _parallel_grain;
+    if (n < _take_short_run && (l.runs() > 1 || serial)) {
+        _parallel_for(l.runs(), std::max<std::size_t>(_parallel_grain / (n * m), 1),
+                      [&](std::size_t b, std::size_t e) {
+            _for_each_run(l, b, e, [&](std::size_t k, T* z, const T* x) {
+                for (std::size_t i = 0; i < k; ++i)
+                    for (std::size_t t = 0; t < m; ++t) {
+                        const std::size_t j = reverse ? m - 1 - t : t;
+                        op(z[i * sz + idx[j] * stride], x[i * sx + soff[j]]);
+                    }
+            }, pd, ps);
+        });
+        return;
+    }
+
+    /// Indices sorted (stably) by bucket of destinations: a
+    /// bucket is a range of 2^shift destinations. Blocks of
+    /// indices are counted, then placed, in parallel; in each
+    /// bucket, block b goes after the blocks before it.
+    const std::size_t threads = Thread_pool::instance().size();
+    unsigned shift = 0;
+    while (((extent - 1) >> shift) >= _scatter_buckets * threads)
+        ++shift;
+    const std::size_t P = ((extent - 1) >> shift) + 1;
+    const std::size_t B = std::max<std::size_t>(std::min(threads, m / _parallel_grain), 1);
+    auto block = [&](std::size_t b) { return m * b / B; };
+    std::vector<std::size_t> count(B * P, 0), first(P + 1);
+    _parallel_for(B, 1, [&](std::size_t b, std::size_t e) {
+        for (; b < e; ++b)
+            for (std::size_t j = block(b); j < block(b + 1); ++j)
+                ++count[b * P + (idx[j] >> shift)];
+    });
+    for (std::size_t q = 0, at = 0; q <= P; ++q) {
+        first[q] = at;
+        for (std::size_t b = 0; q < P && b < B; ++b) {
+            const std::size_t c = count[b * P + q];
+            count[b * P + q] = at;
+            at += c;
+        }
+    }
+    auto place = [&](auto put) {
+        _parallel_for(B, 1, [&](std::size_t b, std::size_t e) {
+            for (; b < e; ++b)
+                for (std::size_t j = block(b); j < block(b + 1); ++j)
+                    put(count[b * P + (idx[j] >> shift)]++, j);
+        });
+    };
+
+    /// A single thin run: its (destination, source) offsets
+    /// are laid out by bucket, so that each thread reads only
+    /// its own range.
+    if (n < _take_short_run) {
+        std::unique_ptr<std::size_t[]> moves(new std::size_t[2 * m]);
+        place([&](std::size_t t, std::size_t j) {
+            moves[2 * t] = idx[j] * stride;
+            moves[2 * t + 1] = soff[j];
+        });
+        _parallel_for(P, 1, [&](std::size_t b, std::size_t e) {
+            for (std::size_t q = b; q < e; ++q) {
+                const std::size_t lo = first[q], c = first[q + 1] - lo;
+                for (std::size_t t = 0; t < c; ++t) {
+                    const std::size_t k = lo + (reverse ? c - 1 - t : t);
+                    for (std::size_t i = 0; i < n; ++i)
+                        op(pd[i * sz + moves[2 * k]], ps[i * sx + moves[2 * k + 1]]);
+                }
+            }
+        });
+        return;
+    }
+
+    std::unique_ptr<std::size_t[]> order(new std::size_t[m]);
+    place([&](std::size_t t, std::size_t j) { order[t] = j; });
+
+    const std::size_t bytes = sz == 1 ? n * sizeof(T) : 64;
+    _parallel_for(P, 1, [&](std::size_t b, std::size_t e) {
+        for (std::size_t q = b; q < e; ++q) {
+            const std::size_t lo = first[q], c = first[q + 1] - lo;
+            auto at = [&](std::size_t t) { return order[lo + (reverse ? c - 1 - t : t)]; };
+            for (std::size_t t = 0; t < c; ++t) {
+                if (t + _take_prefetch_distance < c)
+                    _prefetch(pd + idx[at(t + _take_prefetch_distance)] * stride, bytes);
+                const std::size_t j = at(t);
+                _for_each_run(l, [&](std::size_t k, T* z, const T* x) {
+                    _scatter_run(z, sz, x, sx, k, op);
+                }, pd + idx[j] * stride, ps + soff[j]);
+            }
+        }
+    });
+}
+
+};
+
+/**
+ * @brief gather. Slices idx[j...] of in along dimension D,
+ *        into the preallocated out, whose extents are the
+ *        ones of in with D replaced by the ones of idx.
+ * @param out
+ * @param in
+ * @param idx tensor (or view) of integral indices.
+ * @return out.
+ */
+template <std::size_t D, typename O, typename M, typename X,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() &&
+                                _tensor_type<M>() && _tensor_type<X>())>>
+O&&
+gather(O&& out, const M& in, const X& idx)
+{
+    using T = Value_type<M>;
+    constexpr std::size_t N = M::order, R = X::order;
+    static_assert (D < N, "gather<D>: D must be lower than N");
+    static_assert (std::remove_reference_t<O>::order == N - 1 + R, "gather: orders mismatch");
+    static_assert (std::is_same<Value_type<std::remove_reference_t<O>>, T>::value,
+                   "gather: types mismatch");
+    TENSOR_TRACE("gather", in, out);
+    const auto& od = out.descriptor();
+    const auto& id = in.descriptor();
+    const auto& xd = idx.descriptor();
+    for (std::size_t k = 0; k < N; ++k)
+        assert(k == D || id.extents[k] == od.extents[k < D ? k : k - 1 + R]);
+    for (std::size_t k = 0; k < R; ++k)
+        assert(xd.extents[k] == od.extents[D + k]);
+
+    auto soff = tensor_impl::_indices(idx, id.extents[D]);
+    for (auto& o : soff)
+        o *= id.strides[D];
+    const auto doff = tensor_impl::_position_offsets<D>(xd.extents, od);
+    const auto l = tensor_impl::_slice_loop<D, R, 1>(od, id);
+    tensor_impl::_take(l, out.data() + od.start, doff, in.data() + id.start, soff);
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief take. Slices idx[j...] of in along dimension D.
+ * @param in
+ * @param idx tensor (or view) of integral indices.
+ * @return a new Tensor, the dimensions of idx in place of D.
+ */
+template <std::size_t D, typename M, typename X,
+          typename = Enable_if<(_tensor_type<M>() && _tensor_type<X>())>>
+Tensor<Value_type<M>, M::order - 1 + X::order>
+take(const M& in, const X& idx)
+{
+    constexpr std::size_t N = M::order, R = X::order;
+    static_assert (D < N, "take<D>: D must be lower than N");
+    const auto& id = in.descriptor();
+    std::array<std::size_t, N - 1 + R> exts;
+    for (std::size_t k = 0; k < N - 1 + R; ++k)
+        exts[k] = k < D ? id.extents[k]
+                        : k < D + R ? idx.descriptor().extents[k - D]
+                                    : id.extents[k - R + 1];
+    Tensor<Value_type<M>, N - 1 + R> out(uninitialized, exts);
+    gather<D>(out, in, idx);
+    return out;
+}
+
+/**
+ * @brief scatter. Write the slices j... of src at idx[j...]
+ *        along dimension D of out: src has the extents of
+ *        out with D replaced by the ones of idx. Slices of
+ *        out not indexed are left as they are.
+ * @param out tensor or view.
+ * @param idx tensor (or view) of integral indices.
+ * @param src
+ * @param mode how repeated indices are resolved.
+ * @return out.
+ */
+template <std::size_t D, typename O, typename X, typename S,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() &&
+                                _tensor_type<X>() && _tensor_type<S>())>>
+O&&
+scatter(O&& out, const X& idx, const S& src, Scatter mode = Scatter::last)
+{
+    using T = Value_type<S>;
+    constexpr std::size_t N = std::remove_reference_t<O>::order, R = X::order;
+    static_assert (D < N, "scatter<D>: D must be lower than N");
+    static_assert (S::order == N - 1 + R, "scatter: orders mismatch");
+    static_assert (std::is_same<Value_type<std::remove_reference_t<O>>, T>::value,
+                   "scatter: types mismatch");
+    TENSOR_TRACE("scatter", src, out);
+    const auto& od = out.descriptor();
+    const auto& sd = src.descriptor();
+    const auto& xd = idx.descriptor();
+    for (std::size_t k = 0; k < N; ++k)
+        assert(k == D || od.extents[k] == sd.extents[k < D ? k : k - 1 + R]);
+    for (std::size_t k = 0; k < R; ++k)
+        assert(xd.extents[k] == sd.extents[D + k]);
+
+    const auto ix = tensor_impl::_indices(idx, od.extents[D]);
+    const auto soff = tensor_impl::_position_offsets<D>(xd.extents, sd);
+    const auto l = tensor_impl::_slice_loop<D, 1, R>(od, sd);
+    T* pd = out.data() + od.start;
+    const T* ps = src.data() + sd.start;
+    auto run = [&](auto op, bool reverse) {
+        tensor_impl::_scatter(l, pd, od.extents[D], od.strides[D], ix, ps, soff, reverse, op);
+    };
+    switch (mode) {
+    case Scatter::last:
+        run(tensor_impl::_Sc_assign{}, false);
+        break;
+    case Scatter::first:
+        run(tensor_impl::_Sc_assign{}, true);
+        break;
+    case Scatter::add:
+        run(tensor_impl::_Sc_add{}, false);
+        break;
+    case Scatter::max:
+        run(tensor_impl::_Sc_max{}, false);
+        break;
+    case Scatter::min:
+        run(tensor_impl::_Sc_min{}, false);
+        break;
+    }
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief scatter_add. Add the slices j... of src at
+ *        idx[j...] along dimension D of out; repeated
+ *        indices accumulate, in the order of idx.
+ * @param out tensor or view.
+ * @param idx tensor (or view) of integral indices.
+ * @param src
+ * @return out.
+ */
+template <std::size_t D, typename O, typename X, typename S,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() &&
+                                _tensor_type<X>() && _tensor_type<S>())>>
+O&&
+scatter_add(O&& out, const X& idx, const S& src)
+{ return scatter<D>(std::forward<O>(out), idx, src, Scatter::add); }
+
+NUM_END
+
+#endif // GATHER_H
@@ -0,0 +1,469 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <type_traits>
+#include <cstdlib>
+#include <cassert>
+
+#include "parallel.h"
+#include "trace.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Gemm_params struct. Blocking of the matrix
+ *        product: C is computed by mc x nc blocks, the sum
+ *        over k by slices of kc, and every block by
+ *        micro-kernels of MR x NR registers (kernel is an
+ *        index in gemm_kernels()).
+ */
+struct Gemm_params {
+    std::size_t mc;
+    std::size_t kc;
+    std::size_t nc;
+    std::size_t kernel;
+};
+
+/**
+ * @brief gemm_kernels. Register tiles of the micro-kernel
+ *        variants.
+ * @return list of (MR, NR).
+ */
+inline const std::array<std::array<std::size_t, 2>, 4>&
+gemm_kernels()
+{
+    static const std::array<std::array<std::size_t, 2>, 4> k{{{4, 8}, {6, 8}, {4, 16}, {6, 16}}};
+    return k;
+}
+
+namespace tensor_impl {
+
+/// Products smaller than this (m * n * k) skip packing.
+constexpr std::size_t _gemm_small = std::size_t{1} << 15;
+
+/**
+ * @brief _gemm_type_name.
+ * @return the key of T in the cache file, or nullptr.
+ */
+template <typename T>
+const char*
+_gemm_type_name()
+{
+    if (std::is_same<T, float>::value)
+        return "float";
+    if (std::is_same<T, double>::value)
+        return "double";
+    return nullptr;
+}
+
+/**
+ * @brief _gemm_default. Parameters used when nothing was
+ *        tuned: the A block and a B sliver fit in L2, the
+ *        B panel in a slice of L3.
+ */
+template <typename T>
+Gemm_params
+_gemm_default()
+{
+    if (sizeof(T) <= 4)
+        return {128, 384, 4096, 3};
+    return {96, 256, 4096, 1};
+}
+
+/**
+ * @brief _gemm_cache_path.
+ * @return TENSOR_GEMM_CACHE, or ~/.tensor_gemm.
+ */
+inline std::string
+_gemm_cache_path()
+{
+    if (const char* p = std::getenv("TENSOR_GEMM_CACHE"))
+        return p;
+    if (const char* h = std::getenv("HOME"))
+        return std::string(h) + "/.tensor_gemm";
+    return ".tensor_gemm";
+}
+
+/**
+ * @brief _gemm_read. Parameters of type name in a cache file
+ *        ("name mc kc nc kernel" lines, # for comments).
+ * @return true if they were found and valid.
+ */
+inline bool
+_gemm_read(const std::string& path, const char* name, Gemm_params& p)
+{
+    std::ifstream is(path);
+    std::string line;
+    while (std::getline(is, line)) {
+        std::istringstream ls(line);
+        std::string key;
+        long long v[4];
+        if (!(ls >> key) || key != name || !(ls >> v[0] >> v[1] >> v[2] >> v[3]))
+            continue;
+        if (v[0] <= 0 || v[1] <= 0 || v[2] <= 0 || v[3] < 0 ||
+            std::size_t(v[3]) >= gemm_kernels().size())
+            continue;
+        p = {std::size_t(v[0]), std::size_t(v[1]), std::size_t(v[2]), std::size_t(v[3])};
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief The _Gemm_state struct. Current parameters of T,
+ *        loaded from the cache file at first use.
+ */
+template <typename T>
+struct _Gemm_state {
+
+    static _Gemm_state&
+    instance()
+    {
+        static _Gemm_state s;
+        return s;
+    }
+
+    Gemm_params
+    get()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return params;
+    }
+
+    void
+    set(const Gemm_params& p)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        params = p;
+    }
+
+    _Gemm_state()
+        : params{_gemm_default<T>()}
+    {
+        if (const char* name = _gemm_type_name<T>())
+            _gemm_read(_gemm_cache_path(), name, params);
+    }
+
+    std::mutex mutex;
+    Gemm_params params;
+};
+
+/**
+ * @brief _gemm_micro. MR x NR block of C from a packed
+ *        sliver of A (kc x MR) and of B (kc x NR), kept in
+ *        registers; the NR loop is vectorized. Only the
+ *        mr x nr top-left part is stored.
+ */
+template <std::size_t MR, std::size_t NR, typename T>
+void
+_gemm_micro(std::size_t kc, const T* __restrict a, const T* __restrict b,
+            T* c, std::size_t cs0, std::size_t cs1, std::size_t mr, std::size_t nr,
+            T alpha, T beta)
+{
+    T acc[MR][NR] = {};
+    for (std::size_t p = 0; p < kc; ++p, a += MR, b += NR)
+        for (std::size_t i = 0; i < MR; ++i) {
+            const T ai = a[i];
+            for (std::size_t j = 0; j < NR; ++j)
+                acc[i][j] += ai * b[j];
+        }
+
+    for (std::size_t i = 0; i < mr; ++i)
+        for (std::size_t j = 0; j < nr; ++j) {
+            T& y = c[i * cs0 + j * cs1];
+            y = beta == T(0) ? alpha * acc[i][j] : alpha * acc[i][j] + beta * y;
+        }
+}
+
+/**
+ * @brief _gemm_blocked. C = alpha A B + beta C, Goto style:
+ *        for every kc x nc panel of B, packed once in NR wide
+ *        slivers, the mc x kc blocks of A are packed in MR
+ *        high slivers and multiplied by micro-kernels; the
+ *        blocks of A are split across the thread pool.
+ */
+template <std::size_t MR, std::size_t NR, typename T>
+void
+_gemm_blocked(const Gemm_params& gp, std::size_t m, std::size_t n, std::size_t k, T alpha,
+              const T* a, std::size_t as0, std::size_t as1,
+              const T* b, std::size_t bs0, std::size_t bs1,
+              T beta, T* c, std::size_t cs0, std::size_t cs1)
+{
+    const std::size_t threads = Thread_pool::instance().size();
+    const std::size_t kc = std::min(gp.kc, k);
+    const std::size_t nc = (std::min(gp.nc, n) + NR - 1) / NR * NR;
+
+    /// Smaller blocks of A when there are too few of them.
+    std::size_t mc = std::min(gp.mc, (m + threads - 1) / threads);
+    mc = std::max<std::size_t>((mc + MR - 1) / MR * MR, MR);
+
+    std::vector<T> bp(kc * nc);
+    for (std::size_t jc = 0; jc < n; jc += nc) {
+        const std::size_t nb = std::min(nc, n - jc), ns = (nb + NR - 1) / NR;
+        for (std::size_t pc = 0; pc < k; pc += kc) {
+            const std::size_t kb = std::min(kc, k - pc);
+            const T bt = pc == 0 ? beta : T(1);
+
+            _parallel_for(ns, std::max<std::size_t>(_parallel_grain / (kb * NR), 1),
+                          [&](std::size_t s0, std::size_t s1) {
+                for (std::size_t s = s0; s < s1; ++s) {
+                    T* dst = bp.data() + s * kb * NR;
+                    const std::size_t j0 = jc + s * NR, w = std::min(NR, n - j0);
+                    for (std::size_t p = 0; p < kb; ++p, dst += NR) {
+                        const T* src = b + (pc + p) * bs0 + j0 * bs1;
+                        std::size_t j = 0;
+                        for (; j < w; ++j)
+                            dst[j] = src[j * bs1];
+                        for (; j < NR; ++j)
+                            dst[j] = T(0);
+                    }
+                }
+            });
+
+            const std::size_t blocks = (m + mc - 1) / mc;
+            _parallel_for(blocks, 1, [&](std::size_t q0, std::size_t q1) {
+                std::vector<T> ap(mc * kb);
+                for (std::size_t q = q0; q < q1; ++q) {
+                    const std::size_t ic = q * mc, mb = std::min(mc, m - ic);
+                    const std::size_t ms = (mb + MR - 1) / MR;
+                    for (std::size_t s = 0; s < ms; ++s) {
+                        T* dst = ap.data() + s * kb * MR;
+                        const std::size_t i0 = ic + s * MR, h = std::min(MR, m - i0);
+                        for (std::size_t p = 0; p < kb; ++p, dst += MR) {
+                            const T* src = a + i0 * as0 + (pc + p) * as1;
+                            std::size_t i = 0;
+                            for (; i < h; ++i)
+                                dst[i] = src[i * as0];
+                            for (; i < MR; ++i)
+                                dst[i] = T(0);
+                        }
+                    }
+
+                    for (std::size_t js = 0; js < ns; ++js)
+                        for (std::size_t is = 0; is < ms; ++is) {
+                            const std::size_t i0 = ic + is * MR, j0 = jc + js * NR;
+                            _gemm_micro<MR, NR>(kb, ap.data() + is * kb * MR,
+                                                bp.data() + js * kb * NR,
+                                                c + i0 * cs0 + j0 * cs1, cs0, cs1,
+                                                std::min(MR, m - i0), std::min(NR, n - j0),
+                                                alpha, bt);
+                        }
+                }
+            });
+        }
+    }
+}
+
+/**
+ * @brief _gemm_with. _gemm with explicit parameters.
+ */
+template <typename T>
+void
+_gemm_with(const Gemm_params& gp, std::size_t m, std::size_t n, std::size_t k, T alpha,
+           const T* a, std::size_t as0, std::size_t as1,
+           const T* b, std::size_t bs0, std::size_t bs1,
+           T beta, T* c, std::size_t cs0, std::size_t cs1)
+{
+    if (m == 0 || n == 0)
+        return;
+
+    /// Small or empty products: no packing.
+    if (k == 0 || m * n * k < _gemm_small) {
+        for (std::size_t i = 0; i < m; ++i)
+            for (std::size_t j = 0; j < n; ++j) {
+                T s = T(0);
+                for (std::size_t p = 0; p < k; ++p)
+                    s += a[i * as0 + p * as1] * b[p * bs0 + j * bs1];
+                T& y = c[i * cs0 + j * cs1];
+                y = beta == T(0) ? alpha * s : alpha * s + beta * y;
+            }
+        return;
+    }
+
+    switch (gp.kernel) {
+    case 0:
+        return _gemm_blocked<4, 8>(gp, m, n, k, alpha, a, as0, as1, b, bs0, bs1, beta, c, cs0, cs1);
+    case 1:
+        return _gemm_blocked<6, 8>(gp, m, n, k, alpha, a, as0, as1, b, bs0, bs1, beta, c, cs0, cs1);
+    case 2:
+        return _gemm_blocked<4, 16>(gp, m, n, k, alpha, a, as0, as1, b, bs0, bs1, beta, c, cs0, cs1);
+    default:
+        return _gemm_blocked<6, 16>(gp, m, n, k, alpha, a, as0, as1, b, bs0, bs1, beta, c, cs0, cs1);
+    }
+}
+
+/**
+ * @brief _gemm. C = alpha A B + beta C for strided m x k,
+ *        k x n and m x n matrices, with the current
+ *        parameters of T. C is not read if beta is 0.
+ */
+template <typename T>
+void
+_gemm(std::size_t m, std::size_t n, std::size_t k, T alpha,
+      const T* a, std::size_t as0, std::size_t as1,
+      const T* b, std::size_t bs0, std::size_t bs1,
+      T beta, T* c, std::size_t cs0, std::size_t cs1)
+{
+    _gemm_with(_Gemm_state<T>::instance().get(), m, n, k, alpha,
+               a, as0, as1, b, bs0, bs1, beta, c, cs0, cs1);
+}
+
+};
+
+/**
+ * @brief gemm_params.
+ * @return the parameters used for products of T.
+ */
+template <typename T>
+Gemm_params
+gemm_params()
+{ return tensor_impl::_Gemm_state<T>::instance().get(); }
+
+/**
+ * @brief set_gemm_params. Use p for the next products of T.
+ * @param p
+ */
+template <typename T>
+void
+set_gemm_params(const Gemm_params& p)
+{
+    assert(p.mc > 0 && p.kc > 0 && p.nc > 0 && p.kernel < gemm_kernels().size());
+    tensor_impl::_Gemm_state<T>::instance().set(p);
+}
+
+/**
+ * @brief save_gemm_params. Write the parameters of T to the
+ *        cache file (TENSOR_GEMM_CACHE, or ~/.tensor_gemm),
+ *        keeping the lines of the other types.
+ * @return true on success, false otherwise.
+ */
+template <typename T>
+bool
+save_gemm_params()
+{
+    const char* name = tensor_impl::_gemm_type_name<T>();
+    if (!name)
+        return false;
+    const std::string path = tensor_impl::_gemm_cache_path();
+
+    std::vector<std::string> keep;
+    {
+        std::ifstream is(path);
+        std::string line, key;
+        while (std::getline(is, line)) {
+            std::istringstream ls(line);
+            if (!(ls >> key) || key != name)
+                keep.push_back(line);
+        }
+    }
+    if (keep.empty())
+        keep.push_back("# Tensor GEMM parameters: type mc kc nc kernel");
+
+    const Gemm_params p = gemm_params<T>();
+    std::ofstream os(path, std::ios::trunc);
+    for (const auto& l : keep)
+        os << l << '\n';
+    os << name << ' ' << p.mc << ' ' << p.kc << ' ' << p.nc << ' ' << p.kernel << '\n';
+    return bool(os);
+}
+
+/**
+ * @brief tune_gemm. Time n x n x n products of T for every
+ *        candidate block size and micro-kernel on this
+ *        machine, keep the fastest and, if save, write it
+ *        to the cache file for later processes. Takes a
+ *        few seconds.
+ * @param n
+ * @param save
+ * @return the chosen parameters.
+ */
+template <typename T>
+Gemm_params
+tune_gemm(std::size_t n = 512, bool save = true)
+{
+    static_assert (std::is_arithmetic<T>::value, "tune_gemm: arithmetic types only");
+    using clock = std::chrono::steady_clock;
+
+    std::vector<T> a(n * n), b(n * n), c(n * n);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> u(-8, 8);
+    for (std::size_t i = 0; i < n * n; ++i) {
+        a[i] = T(u(gen));
+        b[i] = T(u(gen));
+    }
+
+    Gemm_params best = gemm_params<T>();
+    double best_t = 1e300;
+    for (std::size_t kernel = 0; kernel < gemm_kernels().size(); ++kernel)
+        for (std::size_t mc : {48, 96, 192})
+            for (std::size_t kc : {128, 256, 512})
+                for (std::size_t nc : {1024, 4096}) {
+                    const Gemm_params p{mc, kc, nc, kernel};
+                    double t = 1e300;
+                    for (int rep = 0; rep < 2; ++rep) {
+                        const auto t0 = clock::now();
+                        tensor_impl::_gemm_with(p, n, n, n, T(1), a.data(), n, 1,
+                                                b.data(), n, 1, T(0), c.data(), n, 1);
+                        t = std::min(t, std::chrono::duration<double>(clock::now() - t0).count());
+                    }
+                    if (t < best_t) {
+                        best_t = t;
+                        best = p;
+                    }
+                }
+
+    set_gemm_params<T>(best);
+    if (save)
+        save_gemm_params<T>();
+    return best;
+}
+
+/**
+ * @brief gemm. c = alpha a b + beta c, in place, for
+ *        matrices (Tensor or Tensor_ref) of any layout with
+ *        the same arithmetic value type. c must not overlap
+ *        a or b; it is not read if beta is 0.
+ * @param c
+ * @param a
+ * @param b
+ * @param alpha
+ * @param beta
+ */
+template <typename C, typename A, typename B,
+          typename T = Value_type<std::remove_reference_t<C>>,
+          typename = Enable_if<(_2d<std::remove_reference_t<C>>() && _2d<A>() && _2d<B>())>>
+void
+gemm(C&& c, const A& a, const B& b, T alpha = T(1), T beta = T(0))
+{
+    static_assert (std::is_arithmetic<T>::value, "gemm: arithmetic types only");
+    static_assert (std::is_same<Value_type<A>, T>::value && std::is_same<Value_type<B>, T>::value,
+                   "gemm: value types mismatch");
+    TENSOR_TRACE("gemm", a, b, c);
+    const auto& ad = a.descriptor();
+    const auto& bd = b.descriptor();
+    const auto& cd = c.descriptor();
+    assert(ad.extents[1] == bd.extents[0]);
+    assert(cd.extents[0] == ad.extents[0] && cd.extents[1] == bd.extents[1]);
+    tensor_impl::_gemm(cd.extents[0], cd.extents[1], ad.extents[1], alpha,
+                       a.data() + ad.start, ad.strides[0], ad.strides[1],
+                       b.data() + bd.start, bd.strides[0], bd.strides[1],
+                       beta, c.data() + cd.start, cd.strides[0], cd.strides[1]);
+}
+
+NUM_END
+
+#endif // GEMM_H
@@ -0,0 +1,513 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <cassert>
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "tensor.h"
+#include "parallel.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+namespace tensor_impl {
+
+/**
+ * @brief _float_bits. Reinterpret a float as its bits.
+ * @param f
+ * @return the IEEE-754 representation of f.
+ */
+inline std::uint32_t
+_float_bits(float f)
+{
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+/**
+ * @brief _bits_float. Reinterpret bits as a float.
+ * @param u
+ * @return the float represented by u.
+ */
+inline float
+_bits_float(std::uint32_t u)
+{
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief _half_from_float. Convert a float to IEEE binary16,
+ *        rounding to nearest even. Overflow goes to infinity,
+ *        NaN stays NaN.
+ * @param f
+ * @return bits of the half.
+ */
+inline std::uint16_t
+_half_from_float(float f)
+{
+    std::uint32_t x = _float_bits(f);
+    std::uint16_t sign = std::uint16_t((x >> 16) & 0x8000u);
+    std::uint32_t abs = x & 0x7fffffffu;
+
+    if (abs >= 0x7f800000u)                       /// Inf or NaN
+        return sign | (abs > 0x7f800000u ? 0x7e00u : 0x7c00u);
+    if (abs >= 0x477ff000u)                       /// rounds to Inf
+        return sign | 0x7c00u;
+    if (abs < 0x38800000u) {                      /// subnormal or zero
+        if (abs < 0x33000000u)
+            return sign;
+        std::uint32_t e = abs >> 23;
+        std::uint32_t m = (abs & 0x007fffffu) | 0x00800000u;
+        std::uint32_t shift = 126 - e;
+        std::uint32_t h = m >> shift;
+        std::uint32_t rem = m & ((1u << shift) - 1);
+        std::uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1u)))
+            ++h;
+        return sign | std::uint16_t(h);
+    }
+
+    /// Normal: rebias exponent and round the 13 dropped bits.
+    std::uint32_t h = (abs - 0x38000000u) >> 13;
+    std::uint32_t rem = abs & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1u)))
+        ++h;
+    return sign | std::uint16_t(h);
+}
+
+/**
+ * @brief _half_to_float. Convert IEEE binary16 bits to float
+ *        (exact).
+ * @param h
+ * @return the float value.
+ */
+inline float
+_half_to_float(std::uint16_t h)
+{
+    std::uint32_t sign = std::uint32_t(h & 0x8000u) << 16;
+    std::uint32_t e = (h >> 10) & 0x1fu;
+    std::uint32_t m = h & 0x3ffu;
+
+    if (e == 0x1fu)                               /// Inf or NaN
+        return _bits_float(sign | 0x7f800000u | (m << 13));
+    if (e == 0) {
+        if (m == 0)
+            return _bits_float(sign);
+        /// Subnormal: value is m * 2^-24.
+        float v = float(m) * _bits_float(0x33800000u);
+        return sign ? -v : v;
+    }
+    return _bits_float(sign | ((e + 112) << 23) | (m << 13));
+}
+
+/**
+ * @brief _bfloat_from_float. Convert a float to bfloat16
+ *        rounding to nearest even. NaN stays NaN.
+ * @param f
+ * @return bits of the bfloat16.
+ */
+inline std::uint16_t
+_bfloat_from_float(float f)
+{
+    std::uint32_t x = _float_bits(f);
+    if ((x & 0x7fffffffu) > 0x7f800000u)
+        return std::uint16_t((x >> 16) | 0x40u);
+    x += 0x7fffu + ((x >> 16) & 1u);
+    return std::uint16_t(x >> 16);
+}
+
+/**
+ * @brief _bfloat_to_float. Convert bfloat16 bits to float (exact).
+ * @param b
+ * @return the float value.
+ */
+inline float
+_bfloat_to_float(std::uint16_t b)
+{ return _bits_float(std::uint32_t(b) << 16); }
+
+};
+
+/**
+ * @brief The float16 struct. IEEE-754 binary16 storage type.
+ *        Arithmetic is done in float: values convert
+ *        implicitly in both directions, so a Tensor<float16, N>
+ *        behaves like a Tensor<float, N> holding half the bytes.
+ */
+struct float16 {
+
+    float16() = default;
+
+    float16(float f)
+        : bits{tensor_impl::_half_from_float(f)}
+    {}
+
+    operator float() const
+    { return tensor_impl::_half_to_float(bits); }
+
+    /**
+     * @brief from_bits. Build a float16 from its representation.
+     * @param b
+     * @return float16.
+     */
+    static float16
+    from_bits(std::uint16_t b)
+    {
+        float16 h;
+        h.bits = b;
+        return h;
+    }
+
+    float16& operator+= (float f) { return *this = float(*this) + f; }
+    float16& operator-= (float f) { return *this = float(*this) - f; }
+    float16& operator*= (float f) { return *this = float(*this) * f; }
+    float16& operator/= (float f) { return *this = float(*this) / f; }
+
+    std::uint16_t bits;
+};
+
+/**
+ * @brief The bfloat16 struct. Brain floating point storage type:
+ *        the upper half of a float, same range, 8 bit mantissa.
+ */
+struct bfloat16 {
+
+    bfloat16() = default;
+
+    bfloat16(float f)
+        : bits{tensor_impl::_bfloat_from_float(f)}
+    {}
+
+    operator float() const
+    { return tensor_impl::_bfloat_to_float(bits); }
+
+    /**
+     * @brief from_bits. Build a bfloat16 from its representation.
+     * @param b
+     * @return bfloat16.
+     */
+    static bfloat16
+    from_bits(std::uint16_t b)
+    {
+        bfloat16 h;
+        h.bits = b;
+        return h;
+    }
+
+    bfloat16& operator+= (float f) { return *this = float(*this) + f; }
+    bfloat16& operator-= (float f) { return *this = float(*this) - f; }
+    bfloat16& operator*= (float f) { return *this = float(*this) * f; }
+    bfloat16& operator/= (float f) { return *this = float(*this) / f; }
+
+    std::uint16_t bits;
+};
+
+static_assert (sizeof(float16) == 2 && sizeof(bfloat16) == 2,
+               "float16/bfloat16 must be 2 bytes");
+
+/// Check if T is one of the reduced precision types.
+template <typename T>
+constexpr bool
+_is_half()
+{ return std::is_same<T, float16>::value || std::is_same<T, bfloat16>::value; }
+
+namespace tensor_impl {
+
+/// Number of elements widened at a time by the kernels.
+constexpr std::size_t _half_block = 256;
+
+/**
+ * @brief _widen. Convert n float16 to float.
+ * @param src
+ * @param dst
+ * @param n
+ */
+inline void
+_widen(const float16* src, float* dst, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = _half_to_float(src[i].bits);
+}
+
+/**
+ * @brief _widen. Convert n bfloat16 to float.
+ * @param src
+ * @param dst
+ * @param n
+ */
+inline void
+_widen(const bfloat16* src, float* dst, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256i w = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(w));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = _bfloat_to_float(src[i].bits);
+}
+
+/**
+ * @brief _narrow. Convert n float to float16.
+ * @param src
+ * @param dst
+ * @param n
+ */
+inline void
+_narrow(const float* src, float16* dst, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                    _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i].bits = _half_from_float(src[i]);
+}
+
+/**
+ * @brief _narrow. Convert n float to bfloat16. The loop is
+ *        branch free, so it vectorizes without intrinsics.
+ * @param src
+ * @param dst
+ * @param n
+ */
+inline void
+_narrow(const float* src, bfloat16* dst, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint32_t x = _float_bits(src[i]);
+        std::uint32_t r = (x + 0x7fffu + ((x >> 16) & 1u)) >> 16;
+        std::uint32_t q = (x >> 16) | 0x40u;
+        dst[i].bits = std::uint16_t((x & 0x7fffffffu) > 0x7f800000u ? q : r);
+    }
+}
+
+/**
+ * @brief _dot. Dot product of n reduced precision values with
+ *        n floats, widening blockwise and accumulating in float.
+ * @param a
+ * @param b
+ * @param n
+ * @return the dot product.
+ */
+template <typename H>
+float
+_dot(const H* a, const float* b, std::size_t n)
+{
+    float buf[_half_block];
+    float acc[8] = {};
+    for (std::size_t i = 0; i < n; i += _half_block) {
+        std::size_t m = std::min(_half_block, n - i);
+        _widen(a + i, buf, m);
+        std::size_t k = 0;
+        for (; k + 8 <= m; k += 8)
+            for (std::size_t l = 0; l < 8; ++l)
+                acc[l] += buf[k + l] * b[i + k + l];
+        for (; k < m; ++k)
+            acc[0] += buf[k] * b[i + k];
+    }
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+           ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+/**
+ * @brief _dot. Dot product of two reduced precision arrays,
+ *        widening blockwise and accumulating in float.
+ * @param a
+ * @param b
+ * @param n
+ * @return the dot product.
+ */
+template <typename H>
+float
+_dot(const H* a, const H* b, std::size_t n)
+{
+    float buf[_half_block];
+    float res = 0;
+    for (std::size_t i = 0; i < n; i += _half_block) {
+        std::size_t m = std::min(_half_block, n - i);
+        _widen(b + i, buf, m);
+        res += _dot(a + i, buf, m);
+    }
+    return res;
+}
+
+/**
+ * @brief _dot. Dot product of n values sa apart with n
+ *        values sb apart: unit strides go straight to the
+ *        kernels above, others are packed blockwise first.
+ * @param a
+ * @param sa
+ * @param b
+ * @param sb
+ * @param n
+ * @return the dot product.
+ */
+template <typename H, typename U>
+float
+_dot(const H* a, std::size_t sa, const U* b, std::size_t sb, std::size_t n)
+{
+    if (sa == 1 && sb == 1)
+        return _dot(a, b, n);
+    H pa[_half_block];
+    U pb[_half_block];
+    float res = 0;
+    for (std::size_t i = 0; i < n; i += _half_block) {
+        std::size_t m = std::min(_half_block, n - i);
+        for (std::size_t k = 0; k < m; ++k) {
+            pa[k] = a[(i + k) * sa];
+            pb[k] = b[(i + k) * sb];
+        }
+        res += _dot(pa, pb, m);
+    }
+    return res;
+}
+
+};
+
+/**
+ * @brief to_float. Widen a reduced precision tensor.
+ * @param t
+ * @return Tensor<float, N> with the same extents and layout.
+ */
+template <typename H, std::size_t N,
+          typename = Enable_if<_is_half<H>()>>
+Tensor<float, N>
+to_float(const Tensor<H, N>& t)
+{
+    Tensor<float, N> result(uninitialized, t.descriptor());
+    tensor_impl::_widen(t.data(), result.data(), t.size());
+    return result;
+}
+
+/**
+ * @brief to_half. Narrow a float tensor to a reduced precision
+ *        type (float16 or bfloat16).
+ * @param t
+ * @return Tensor<H, N> with the same extents and layout.
+ */
+template <typename H, std::size_t N,
+          typename = Enable_if<_is_half<H>()>>
+Tensor<H, N>
+to_half(const Tensor<float, N>& t)
+{
+    Tensor<H, N> result(uninitialized, t.descriptor());
+    tensor_impl::_narrow(t.data(), result.data(), t.size());
+    return result;
+}
+
+/**
+ * @brief dot. Dot product of a reduced precision vector and a
+ *        vector of the same type or of floats (Tensor or
+ *        Tensor_ref, any stride), with float accumulation.
+ * @param a
+ * @param b
+ * @return float.
+ */
+template <typename T1, typename T2,
+          typename = Enable_if<(_1d<T1>() && _1d<T2>() && _is_half<Value_type<T1>>() &&
+                                (std::is_same<Value_type<T2>, Value_type<T1>>::value ||
+                                 std::is_same<Value_type<T2>, float>::value))>>
+float
+dot(const T1& a, const T2& b)
+{
+    assert(a.size() == b.size());
+    const auto& da = a.descriptor();
+    const auto& db = b.descriptor();
+    return tensor_impl::_dot(a.data() + da.start, da.strides[0],
+                             b.data() + db.start, db.strides[0], a.size());
+}
+
+/**
+ * @brief gemv. Matrix (reduced precision) x vector (float),
+ *        each a Tensor or a Tensor_ref. Row-major rows are
+ *        widened on the fly, column-major matrices are
+ *        summed by columns over blocks of rows; other
+ *        layouts go through packed rows. Rows are split
+ *        across the thread pool.
+ * @param m
+ * @param x
+ * @return Tensor<float, 1> with m.rows() elements.
+ */
+template <typename T1, typename T2,
+          typename = Enable_if<(_2d<T1>() && _1d<T2>() && _is_half<Value_type<T1>>() &&
+                                std::is_same<Value_type<T2>, float>::value)>>
+Tensor<float, 1>
+gemv(const T1& m, const T2& x)
+{
+    assert(m.cols() == x.size());
+    const auto& md = m.descriptor();
+    const auto& xd = x.descriptor();
+    const auto* pm = m.data() + md.start;
+    const float* px = x.data() + xd.start;
+    const std::size_t r = m.rows(), c = m.cols();
+    Tensor<float, 1> result(r);
+    float* y = result.data();
+    const std::size_t grain = std::max<std::size_t>(tensor_impl::_parallel_grain /
+                                                    std::max<std::size_t>(c, 1), 1);
+
+    if (md.strides[1] != 1 && md.strides[0] == 1 && c > 1) {
+        constexpr std::size_t B = tensor_impl::_half_block;
+        tensor_impl::_parallel_for((r + B - 1) / B, std::max<std::size_t>(grain / B, 1),
+                                   [&](std::size_t lo, std::size_t hi) {
+            float buf[B];
+            for (std::size_t i = lo * B; i < std::min(r, hi * B); i += B) {
+                std::size_t n = std::min(B, r - i);
+                for (std::size_t j = 0; j < c; ++j) {
+                    tensor_impl::_widen(pm + i + j * md.strides[1], buf, n);
+                    const float xj = px[j * xd.strides[0]];
+                    for (std::size_t k = 0; k < n; ++k)
+                        y[i + k] += xj * buf[k];
+                }
+            }
+        });
+        return result;
+    }
+
+    tensor_impl::_parallel_for(r, grain, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i)
+            y[i] = tensor_impl::_dot(pm + i * md.strides[0], md.strides[1],
+                                     px, xd.strides[0], c);
+    });
+    return result;
+}
+
+///-----------------------------------------------------------------------------------------------------------///
+/// Debug functions
+
+inline std::ostream &operator<<(std::ostream& os, float16 h)
+{ return os << float(h); }
+
+inline std::ostream &operator<<(std::ostream& os, bfloat16 h)
+{ return os << float(h); }
+
+NUM_END
+
+#endif // HALF_H
@@ -0,0 +1,258 @@
+#ifndef IO_H
+#define IO_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "tensor.h"
+#include "tensor_slice.h"
+#include "copy.h"
+#include "storage.h"
+#include "traits.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * Binary tensor files:
+ *
+ *     "TNSR", version, kind, element size, rank  (8 bytes)
+ *     extents                                    (rank x uint64)
+ *     elements in row-major order                (native byte order)
+ *
+ * kind is 0 for floating point, 1 for signed and 2 for
+ * unsigned integers, 3 for anything else trivially copyable.
+ */
+
+namespace tensor_impl {
+
+constexpr char _io_magic[4] = {'T', 'N', 'S', 'R'};
+constexpr std::uint8_t _io_version = 1;
+
+template <typename T>
+constexpr std::uint8_t
+_io_kind()
+{
+    if (std::is_floating_point<T>::value)
+        return 0;
+    if (std::is_integral<T>::value)
+        return std::is_signed<T>::value ? 1 : 2;
+    return 3;
+}
+
+/**
+ * @brief _io_header. Write the header of a T tensor.
+ * @param os
+ * @param exts
+ */
+template <typename T, std::size_t N>
+void
+_io_header(std::ostream& os, const std::array<std::size_t, N>& exts)
+{
+    static_assert (N < 256, "io: rank too large");
+    const std::uint8_t h[4] = {_io_version, _io_kind<T>(),
+                               std::uint8_t(sizeof(T)), std::uint8_t(N)};
+    os.write(_io_magic, 4);
+    os.write(reinterpret_cast<const char*>(h), 4);
+    for (auto e : exts) {
+        const std::uint64_t x = e;
+        os.write(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+}
+
+/**
+ * @brief _io_extents. Read a header and check that it is
+ *        the one of a T tensor of rank N.
+ * @param is
+ * @param exts
+ * @return true if it is, false otherwise.
+ */
+template <typename T, std::size_t N>
+bool
+_io_extents(std::istream& is, std::array<std::size_t, N>& exts)
+{
+    char m[4];
+    std::uint8_t h[4];
+    if (!is.read(m, 4) || std::memcmp(m, _io_magic, 4) != 0 ||
+        !is.read(reinterpret_cast<char*>(h), 4))
+        return false;
+    if (h[0] != _io_version || h[1] != _io_kind<T>() ||
+        h[2] != sizeof(T) || h[3] != N)
+        return false;
+    for (auto& e : exts) {
+        std::uint64_t x;
+        if (!is.read(reinterpret_cast<char*>(&x), sizeof(x)))
+            return false;
+        e = std::size_t(x);
+    }
+    return true;
+}
+
+/// Bytes read at a time from streams that cannot seek.
+constexpr std::size_t _io_piece = std::size_t{1} << 24;
+
+/**
+ * @brief _io_fits. Check that the elements of a tensor of
+ *        extents exts (elem bytes each) can be in is: their
+ *        size does not overflow and, if is can seek, does not
+ *        go past its end; is is left where it was.
+ * @param is
+ * @param exts
+ * @param elem
+ * @param bytes size of the elements.
+ * @param known set to true if the end of is could be found.
+ * @return true if they can, false otherwise.
+ */
+template <std::size_t N>
+bool
+_io_fits(std::istream& is, const std::array<std::size_t, N>& exts, std::size_t elem,
+         std::size_t& bytes, bool& known)
+{
+    constexpr std::size_t max = std::numeric_limits<std::size_t>::max();
+    bytes = elem;
+    for (auto e : exts) {
+        if (e != 0 && bytes > max / e)
+            return false;
+        bytes *= e;
+    }
+    known = false;
+    const auto pos = is.tellg();
+    if (pos == std::istream::pos_type(-1))
+        return true;
+    if (!is.seekg(0, std::ios::end)) {
+        is.clear();
+        return bool(is.seekg(pos));
+    }
+    const auto end = is.tellg();
+    if (!is.seekg(pos) || end == std::istream::pos_type(-1))
+        return false;
+    known = true;
+    return bytes <= std::size_t(end - pos);
+}
+
+};
+
+/**
+ * @brief write. Write a tensor (or a view) to a stream in
+ *        the binary format above. Views that are not dense
+ *        row-major are copied first.
+ * @param os
+ * @param t
+ * @return true on success, false otherwise.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+bool
+write(std::ostream& os, const M& t)
+{
+    using T = std::remove_const_t<Value_type<M>>;
+    constexpr std::size_t N = M::order;
+    static_assert (std::is_trivially_copyable<T>::value,
+                   "write: trivially copyable types only");
+    const auto& d = t.descriptor();
+    TENSOR_TRACE("write", t);
+    tensor_impl::_io_header<T>(os, d.extents);
+
+    Tensor_slice<N> rm(d.extents);
+    if (d.start == 0 && d.strides == rm.strides) {
+        os.write(reinterpret_cast<const char*>(t.data()), std::streamsize(d.size * sizeof(T)));
+    } else {
+        Tensor_storage<T> elems(d.size, uninitialized);
+        tensor_impl::_copy(t.data(), d, elems.data(), rm);
+        os.write(reinterpret_cast<const char*>(elems.data()), std::streamsize(d.size * sizeof(T)));
+    }
+    return bool(os);
+}
+
+/**
+ * @brief read. Read a tensor written by write; t takes the
+ *        extents of the file and is left untouched if the
+ *        element type or the rank do not match, or if the
+ *        stream is shorter than its extents say (checked
+ *        before allocating; streams that cannot seek are
+ *        read in pieces, so memory only grows with the
+ *        bytes actually there).
+ * @param is
+ * @param t
+ * @return true on success, false otherwise.
+ */
+template <typename T, std::size_t N>
+bool
+read(std::istream& is, Tensor<T, N>& t)
+{
+    static_assert (std::is_trivially_copyable<T>::value,
+                   "read: trivially copyable types only");
+    std::array<std::size_t, N> exts;
+    std::size_t bytes;
+    bool known;
+    if (!tensor_impl::_io_extents<T>(is, exts) ||
+        !tensor_impl::_io_fits(is, exts, sizeof(T), bytes, known))
+        return false;
+
+    if (!known) {
+        std::vector<char> buf;
+        while (buf.size() < bytes) {
+            const std::size_t k = std::min(bytes - buf.size(), tensor_impl::_io_piece);
+            buf.resize(buf.size() + k);
+            if (!is.read(buf.data() + buf.size() - k, std::streamsize(k)))
+                return false;
+        }
+        Tensor<T, N> r(uninitialized, exts);
+        TENSOR_TRACE("read", r);
+        if (bytes)
+            std::memcpy(r.data(), buf.data(), bytes);
+        t = std::move(r);
+        return true;
+    }
+
+    Tensor<T, N> r(uninitialized, exts);
+    TENSOR_TRACE("read", r);
+    if (!is.read(reinterpret_cast<char*>(r.data()), std::streamsize(bytes)))
+        return false;
+    t = std::move(r);
+    return true;
+}
+
+/**
+ * @brief save. Write a tensor to a file.
+ * @param path
+ * @param t
+ * @return true on success, false otherwise.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+bool
+save(const std::string& path, const M& t)
+{
+    std::ofstream os(path, std::ios::binary);
+    return write(os, t) && bool(os.flush());
+}
+
+/**
+ * @brief load. Read a tensor from a file.
+ * @param path
+ * @param t
+ * @return true on success, false otherwise.
+ */
+template <typename T, std::size_t N>
+bool
+load(const std::string& path, Tensor<T, N>& t)
+{
+    std::ifstream is(path, std::ios::binary);
+    return is && read(is, t);
+}
+
+NUM_END
+
+#endif // IO_H
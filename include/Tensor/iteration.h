@@ -0,0 +1,414 @@
+#ifndef ITERATION_H
+#define ITERATION_H
+
+#include <iostream>
+#include <array>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor_slice.h"
+#include "parallel.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Strided_loop struct. A loop nest shared by K
+ *        tensors with the same extents. Dimensions are sorted
+ *        by decreasing stride of the first tensor, so the walk
+ *        follows its memory whatever its layout; then adjacent
+ *        dimensions whose strides compose in every tensor are
+ *        merged and dimensions of extent 1 are dropped, so a
+ *        view is walked as an outer loop over long inner runs.
+ *        The innermost dimension (rank - 1) is the run.
+ */
+template <std::size_t N, std::size_t K>
+struct Strided_loop {
+
+    /**
+     * @brief inner. Length of every run.
+     * @return number of elements in the innermost dimension.
+     */
+    std::size_t
+    inner() const
+    { return extents[rank - 1]; }
+
+    /**
+     * @brief inner_stride. Step between the elements of a run.
+     * @param k
+     * @return stride of tensor k in the innermost dimension.
+     */
+    std::size_t
+    inner_stride(std::size_t k) const
+    { return strides[k][rank - 1]; }
+
+    /**
+     * @brief contiguous. Check if runs are unit stride in
+     *        every tensor.
+     * @return true if they are, false otherwise.
+     */
+    bool
+    contiguous() const
+    {
+        for (std::size_t k = 0; k < K; ++k)
+            if (inner_stride(k) != 1 && inner() > 1)
+                return false;
+        return true;
+    }
+
+    /**
+     * @brief runs. Number of inner runs.
+     * @return product of the outer extents.
+     */
+    std::size_t
+    runs() const
+    {
+        std::size_t r = 1;
+        for (std::size_t d = 0; d + 1 < rank; ++d)
+            r *= extents[d];
+        return r;
+    }
+
+    /// Number of dimensions after merging (at least 1).
+    std::size_t rank;
+
+    /// Extents, outermost first.
+    std::array<std::size_t, N> extents;
+
+    /// Strides of each tensor.
+    std::array<std::array<std::size_t, N>, K> strides;
+};
+
+namespace tensor_impl {
+
+/**
+ * @brief _make_loop. Build the collapsed loop nest of
+ *        tensors described by descs, all of them with
+ *        the same extents. Elements are visited in the
+ *        memory order of first, not in index order.
+ * @param descs
+ * @return Strided_loop.
+ */
+template <std::size_t N, typename... Descs>
+Strided_loop<N, sizeof...(Descs) + 1>
+_make_loop(const Tensor_slice<N>& first, const Descs&... descs)
+{
+    constexpr std::size_t K = sizeof...(Descs) + 1;
+    const Tensor_slice<N>* ds[K] = {&first, &descs...};
+
+    /// Outermost (largest stride) first; row-major is unchanged.
+    std::array<std::size_t, N> order;
+    for (std::size_t i = 0; i < N; ++i) {
+        std::size_t j = i;
+        for (; j > 0 && first.strides[order[j - 1]] < first.strides[i]; --j)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    Strided_loop<N, K> l;
+    l.rank = 0;
+    for (auto d : order) {
+        auto e = first.extents[d];
+        if (e == 0) {
+            l.rank = 1;
+            l.extents[0] = 0;
+            for (std::size_t k = 0; k < K; ++k)
+                l.strides[k][0] = 1;
+            return l;
+        }
+        if (e == 1)
+            continue;
+
+        bool merge = l.rank > 0;
+        for (std::size_t k = 0; k < K && merge; ++k)
+            merge = l.strides[k][l.rank - 1] == ds[k]->strides[d] * e;
+
+        if (merge) {
+            l.extents[l.rank - 1] *= e;
+            for (std::size_t k = 0; k < K; ++k)
+                l.strides[k][l.rank - 1] = ds[k]->strides[d];
+        } else {
+            l.extents[l.rank] = e;
+            for (std::size_t k = 0; k < K; ++k)
+                l.strides[k][l.rank] = ds[k]->strides[d];
+            ++l.rank;
+        }
+    }
+
+    if (l.rank == 0) {
+        l.rank = 1;
+        l.extents[0] = 1;
+        for (std::size_t k = 0; k < K; ++k)
+            l.strides[k][0] = 1;
+    }
+    return l;
+}
+
+/**
+ * @brief _call_run. Call f on a run, stopping the walk
+ *        if f returns false.
+ * @return false if the walk must stop, true otherwise.
+ */
+template <typename F, typename... P>
+bool
+_call_run(F& f, std::size_t n, P*... ptrs)
+{
+    using R = decltype(f(n, ptrs...));
+    if constexpr (std::is_same<R, bool>::value)
+        return f(n, ptrs...);
+    else {
+        f(n, ptrs...);
+        return true;
+    }
+}
+
+/**
+ * @brief _for_each_run. Walk runs [r0, r1) of the loop
+ *        nest. For every run calls f(n, p...) where p are
+ *        the pointers to the first element of the run in
+ *        each tensor. If f returns bool, false stops the walk.
+ * @param l
+ * @param r0
+ * @param r1
+ * @param f
+ * @param ptrs base pointers (data() + start).
+ * @return false if the walk was stopped, true otherwise.
+ */
+template <std::size_t N, std::size_t K, typename F,
+          typename... P, std::size_t... I>
+bool
+_for_each_run(const Strided_loop<N, K>& l, std::size_t r0, std::size_t r1,
+              F& f, std::index_sequence<I...>, P*... ptrs)
+{
+    if (r0 >= r1 || l.inner() == 0)
+        return true;
+
+    assert(l.rank >= 1 && l.rank <= N);
+    const std::size_t outer = std::min(l.rank, N) - 1;
+    std::array<std::size_t, N> pos{};
+    std::array<std::size_t, K> off{};
+
+    /// Unravel the first run.
+    for (std::size_t i = 0, r = r0; i < outer; ++i) {
+        std::size_t d = outer - 1 - i;
+        pos[d] = r % l.extents[d];
+        r /= l.extents[d];
+        for (std::size_t k = 0; k < K; ++k)
+            off[k] += pos[d] * l.strides[k][d];
+    }
+
+    const auto n = l.inner();
+    for (std::size_t r = r0; r < r1; ++r) {
+        if (!_call_run(f, n, (ptrs + off[I])...))
+            return false;
+
+        /// Odometer over the outer dimensions.
+        for (std::size_t i = 0; i < outer; ++i) {
+            std::size_t d = outer - 1 - i;
+            for (std::size_t k = 0; k < K; ++k)
+                off[k] += l.strides[k][d];
+            if (++pos[d] != l.extents[d])
+                break;
+            for (std::size_t k = 0; k < K; ++k)
+                off[k] -= l.strides[k][d] * l.extents[d];
+            pos[d] = 0;
+        }
+    }
+    return true;
+}
+
+template <std::size_t N, std::size_t K, typename F, typename... P>
+bool
+_for_each_run(const Strided_loop<N, K>& l, std::size_t r0, std::size_t r1,
+              F f, P*... ptrs)
+{
+    static_assert (sizeof...(P) == K,
+                   "_for_each_run: one pointer for each tensor");
+    return _for_each_run(l, r0, r1, f, std::make_index_sequence<K>{}, ptrs...);
+}
+
+/**
+ * @brief _for_each_run. Walk all runs of the loop nest.
+ * @param l
+ * @param f
+ * @param ptrs
+ * @return false if the walk was stopped, true otherwise.
+ */
+template <std::size_t N, std::size_t K, typename F, typename... P>
+bool
+_for_each_run(const Strided_loop<N, K>& l, F f, P*... ptrs)
+{ return _for_each_run(l, 0, l.runs(), f, ptrs...); }
+
+/**
+ * @brief _for_each. Call f(x...) on every tuple of
+ *        corresponding elements of runs [r0, r1). Unit
+ *        stride runs get a plain indexed loop the compiler
+ *        can vectorize.
+ * @param l
+ * @param r0
+ * @param r1
+ * @param f
+ * @param ptrs
+ */
+template <std::size_t N, std::size_t K, typename F,
+          typename... P, std::size_t... I>
+void
+_for_each(const Strided_loop<N, K>& l, std::size_t r0, std::size_t r1, F& f,
+          std::index_sequence<I...>, P*... ptrs)
+{
+    const std::array<std::size_t, K> st{l.inner_stride(I)...};
+    if (l.contiguous())
+        _for_each_run(l, r0, r1, [&](std::size_t n, P*... p) {
+            for (std::size_t i = 0; i < n; ++i)
+                f(p[i]...);
+        }, ptrs...);
+    else
+        _for_each_run(l, r0, r1, [&](std::size_t n, P*... p) {
+            for (std::size_t i = 0; i < n; ++i)
+                f(p[i * st[I]]...);
+        }, ptrs...);
+}
+
+template <std::size_t N, std::size_t K, typename F, typename... P>
+void
+_for_each(const Strided_loop<N, K>& l, F f, P*... ptrs)
+{ _for_each(l, 0, l.runs(), f, std::make_index_sequence<K>{}, ptrs...); }
+
+/**
+ * @brief _parallel_for_each. As _for_each, split across the
+ *        thread pool: by runs, or inside the run when there
+ *        is only one. f is called concurrently.
+ * @param l
+ * @param f
+ * @param ptrs
+ */
+template <std::size_t N, std::size_t K, typename F,
+          typename... P, std::size_t... I>
+void
+_parallel_for_each(const Strided_loop<N, K>& l, F& f,
+                   std::index_sequence<I...> is, P*... ptrs)
+{
+    const std::size_t n = l.inner();
+    if (l.rank == 1) {
+        _parallel_for(n, _parallel_grain, [&](std::size_t b, std::size_t e) {
+            auto part = l;
+            part.extents[0] = e - b;
+            _for_each(part, 0, 1, f, is, (ptrs + b * l.inner_stride(I))...);
+        });
+        return;
+    }
+    _parallel_for(l.runs(), std::max<std::size_t>(_parallel_grain / std::max<std::size_t>(n, 1), 1),
+                  [&](std::size_t b, std::size_t e) {
+        _for_each(l, b, e, f, is, ptrs...);
+    });
+}
+
+template <std::size_t N, std::size_t K, typename F, typename... P>
+void
+_parallel_for_each(const Strided_loop<N, K>& l, F f, P*... ptrs)
+{ _parallel_for_each(l, f, std::make_index_sequence<K>{}, ptrs...); }
+
+/**
+ * @brief _make_line_loop. Loop nest over the lines along
+ *        dimension D of tensors with the same extents: one
+ *        element per line, its head (a single one if N == 1).
+ * @param descs
+ * @return Strided_loop.
+ */
+template <std::size_t D, std::size_t N, typename... Descs>
+Strided_loop<(N > 1 ? N - 1 : 1), sizeof...(Descs) + 1>
+_make_line_loop(const Tensor_slice<N>& first, const Descs&... descs)
+{
+    static_assert (D < N, "_make_line_loop<D>: D must be lower than N");
+    if constexpr (N == 1) {
+        Strided_loop<1, sizeof...(Descs) + 1> l;
+        l.rank = 1;
+        l.extents[0] = 1;
+        for (auto& s : l.strides)
+            s[0] = 1;
+        return l;
+    } else {
+        auto line = [](const Tensor_slice<N>& d) {
+            Tensor_slice<N - 1> r;
+            _slice_dim<D>(0, d, r);
+            return r;
+        };
+        return _make_loop(line(first), line(descs)...);
+    }
+}
+
+/**
+ * @brief _parallel_for_lines. Call f(n, p...) on blocks of
+ *        at most w neighbouring lines of a line loop, p being
+ *        the heads of the first line of the block (the others
+ *        follow at l.inner_stride(k)). Blocks are split across
+ *        the thread pool, cost is the work of a line.
+ * @param l
+ * @param w
+ * @param cost
+ * @param f
+ * @param ptrs
+ */
+template <std::size_t N, std::size_t K, typename F,
+          typename... P, std::size_t... I>
+void
+_parallel_for_lines(const Strided_loop<N, K>& l, std::size_t w, std::size_t cost,
+                    F& f, std::index_sequence<I...>, P*... ptrs)
+{
+    const std::size_t m = l.inner(), per_run = (m + w - 1) / w;
+    _parallel_for(l.runs() * per_run,
+                  std::max<std::size_t>(_parallel_grain / std::max<std::size_t>(w * cost, 1), 1),
+                  [&](std::size_t b, std::size_t e) {
+        for (std::size_t q = b; q < e; ++q) {
+            const std::size_t r = q / per_run, j0 = (q % per_run) * w;
+            _for_each_run(l, r, r + 1, [&](std::size_t, P*... p) {
+                f(std::min(w, m - j0), (p + j0 * l.inner_stride(I))...);
+            }, ptrs...);
+        }
+    });
+}
+
+template <std::size_t N, std::size_t K, typename F, typename... P>
+void
+_parallel_for_lines(const Strided_loop<N, K>& l, std::size_t w, std::size_t cost,
+                    F f, P*... ptrs)
+{ _parallel_for_lines(l, w, cost, f, std::make_index_sequence<K>{}, ptrs...); }
+
+/**
+ * @brief _all_of. Check pred(x...) on every tuple of
+ *        corresponding elements, stopping at the first
+ *        false.
+ * @param l
+ * @param pred
+ * @param ptrs
+ * @return true if pred holds for all elements.
+ */
+template <std::size_t N, std::size_t K, typename F,
+          typename... P, std::size_t... I>
+bool
+_all_of(const Strided_loop<N, K>& l, F& pred,
+        std::index_sequence<I...>, P*... ptrs)
+{
+    const std::array<std::size_t, K> st{l.inner_stride(I)...};
+    return _for_each_run(l, [&](std::size_t n, P*... p) {
+        for (std::size_t i = 0; i < n; ++i)
+            if (!pred(p[i * st[I]]...))
+                return false;
+        return true;
+    }, ptrs...);
+}
+
+template <std::size_t N, std::size_t K, typename F, typename... P>
+bool
+_all_of(const Strided_loop<N, K>& l, F pred, P*... ptrs)
+{ return _all_of(l, pred, std::make_index_sequence<K>{}, ptrs...); }
+
+};
+
+NUM_END
+
+#endif // ITERATION_H
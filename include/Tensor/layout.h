@@ -0,0 +1,23 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/// Layout tag: last index contiguous (C order, the default).
+struct Row_major_t
+{ explicit constexpr Row_major_t() = default; };
+
+constexpr Row_major_t row_major{};
+
+/// Layout tag: first index contiguous (Fortran order).
+struct Col_major_t
+{ explicit constexpr Col_major_t() = default; };
+
+constexpr Col_major_t col_major{};
+
+NUM_END
+
+#endif // LAYOUT_H
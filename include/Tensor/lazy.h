@@ -0,0 +1,552 @@
+#ifndef LAZY_H
+#define LAZY_H
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+
+#include "tensor.h"
+#include "operands.h"
+#include "copy.h"
+#include "parallel.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/// Operations recorded by a Lazy_graph.
+enum class Lazy_op {
+    input,
+    add, sub, mul, div,
+    add_scalar, mul_scalar, div_scalar, rsub_scalar, rdiv_scalar,
+    neg, map,
+    matmul
+};
+
+template <typename T, std::size_t N>
+class Lazy_graph;
+
+/**
+ * @brief The Lazy class. Handle on a node of a Lazy_graph:
+ *        operators on handles record nodes instead of
+ *        computing, eval() runs the graph. Handles are
+ *        cheap to copy and valid while their graph lives.
+ */
+template <typename T, std::size_t N>
+class Lazy {
+public:
+
+    /// Aliases.
+    using value_type = T;
+
+    Lazy(Lazy_graph<T, N>* g, std::size_t id)
+        : _graph{g},
+          _id{id}
+    {}
+
+    /**
+     * @brief apply. Record f(x) on every element. f must be
+     *        callable from several threads at once.
+     * @param f
+     * @return Lazy handle on the result.
+     */
+    template <typename F>
+    Lazy
+    apply(F f) const
+    { return _graph->_map(_id, std::function<T(T)>(std::move(f))); }
+
+    /**
+     * @brief eval. Run the part of the graph this node
+     *        depends on.
+     * @return Tensor<T, N>.
+     */
+    Tensor<T, N>
+    eval() const
+    { return _graph->eval(*this); }
+
+    /**
+     * @brief extents.
+     * @return extents of the result.
+     */
+    const std::array<std::size_t, N>&
+    extents() const
+    { return _graph->_nodes[_id].extents; }
+
+    Lazy_graph<T, N>* graph() const { return _graph; }
+    std::size_t id() const { return _id; }
+
+private:
+    Lazy_graph<T, N>* _graph;
+    std::size_t _id;
+};
+
+namespace tensor_impl {
+
+/// Elements processed by a fused kernel per step: every
+/// intermediate of the chain lives in a block of this size,
+/// so a chain of k operations reads and writes memory once.
+constexpr std::size_t _lazy_block = 512;
+
+};
+
+/**
+ * @brief The Lazy_graph class. Deferred mode: inputs and
+ *        operations are recorded as a DAG and nothing runs
+ *        until eval(). Then:
+ *        - nodes the result does not depend on are skipped;
+ *        - chains of element-wise operations are fused into
+ *          one pass over blocks that stay in L1, only nodes
+ *          used more than once (or by a matmul) are stored;
+ *        - stored intermediates reuse the buffers of those
+ *          that are no longer needed;
+ *        - every pass runs on the thread pool.
+ *        Inputs are not copied: they must outlive eval().
+ */
+template <typename T, std::size_t N>
+class Lazy_graph {
+public:
+
+    /// Aliases.
+    using value_type = T;
+    using handle = Lazy<T, N>;
+
+    /// Default ctor.
+    Lazy_graph() = default;
+
+    /// Handles point to the graph: no copies, no moves.
+    Lazy_graph(const Lazy_graph&) = delete;
+    Lazy_graph& operator=(const Lazy_graph&) = delete;
+
+    /**
+     * @brief input. Record a tensor as an input.
+     * @param t
+     * @return Lazy handle.
+     */
+    handle
+    input(const Tensor<T, N>& t)
+    {
+        _Node n;
+        n.op = Lazy_op::input;
+        n.extents = t.descriptor().extents;
+        n.source = &t;
+        return _add(std::move(n));
+    }
+
+    /**
+     * @brief size.
+     * @return number of recorded nodes.
+     */
+    std::size_t
+    size() const
+    { return _nodes.size(); }
+
+    /**
+     * @brief eval. Compute the node of h.
+     * @param h
+     * @return Tensor<T, N>.
+     */
+    Tensor<T, N>
+    eval(const handle& h)
+    {
+        assert(h.graph() == this);
+        const std::size_t root = h.id();
+
+        /// Live nodes and their consumers.
+        std::vector<bool> live(root + 1, false);
+        std::vector<std::size_t> uses(root + 1, 0);
+        live[root] = true;
+        for (std::size_t i = root + 1; i-- > 0;) {
+            if (!live[i])
+                continue;
+            for (auto a : _operands(i)) {
+                live[a] = true;
+                ++uses[a];
+            }
+        }
+
+        /// Nodes to store: the root, shared nodes, matmul
+        /// operands and results, inputs not laid out row-major
+        /// (and a root input, which is copied).
+        std::vector<bool> stored(root + 1, false);
+        stored[root] = true;
+        for (std::size_t i = 0; i <= root; ++i) {
+            if (!live[i])
+                continue;
+            const auto& n = _nodes[i];
+            if (n.op == Lazy_op::input)
+                stored[i] = i == root || !_row_major(n.source->descriptor());
+            else if (n.op == Lazy_op::matmul) {
+                stored[i] = true;
+                for (auto a : {n.a, n.b})
+                    if (_nodes[a].op != Lazy_op::input)
+                        stored[a] = true;
+            } else if (uses[i] > 1)
+                stored[i] = true;
+        }
+
+        /// Last step reading each stored node.
+        std::vector<std::size_t> last(root + 1, 0);
+        for (std::size_t i = 0; i <= root; ++i)
+            if (live[i] && (stored[i] || _nodes[i].op == Lazy_op::input))
+                _for_each_leaf(i, stored, [&](std::size_t l) { last[l] = i; });
+
+        std::vector<Tensor<T, N>> buffers(root + 1);
+        std::vector<Tensor<T, N>> pool;
+        for (std::size_t i = 0; i <= root; ++i) {
+            if (!live[i] || !stored[i])
+                continue;
+            const auto& n = _nodes[i];
+            if (n.op == Lazy_op::input) {
+                buffers[i] = Tensor_ref<const T, N>(n.source->descriptor(),
+                                                    n.source->data());
+            } else if (n.op == Lazy_op::matmul) {
+                if constexpr (N == 2)
+                    buffers[i] = _leaf(n.a, buffers) * _leaf(n.b, buffers);
+            } else {
+                buffers[i] = _take(pool, n.extents);
+                _run_fused(i, stored, buffers, buffers[i].data());
+            }
+
+            /// Give back the buffers read for the last time.
+            _for_each_leaf(i, stored, [&](std::size_t l) {
+                if (last[l] == i && l != root && buffers[l].size())
+                    pool.push_back(std::move(buffers[l]));
+            });
+        }
+        return std::move(buffers[root]);
+    }
+
+private:
+
+    friend class Lazy<T, N>;
+
+    template <typename U, std::size_t M>
+    friend Lazy<U, M> _lazy_binary(Lazy_op, const Lazy<U, M>&, const Lazy<U, M>&);
+
+    template <typename U, std::size_t M>
+    friend Lazy<U, M> _lazy_scalar(Lazy_op, const Lazy<U, M>&, const U&);
+
+    template <typename U>
+    friend Lazy<U, 2> matmul(const Lazy<U, 2>&, const Lazy<U, 2>&);
+
+    struct _Node {
+        Lazy_op op;
+        std::size_t a = 0;
+        std::size_t b = 0;
+        T scalar{};
+        std::function<T(T)> f;
+        std::array<std::size_t, N> extents;
+        const Tensor<T, N>* source = nullptr;
+    };
+
+    /// One step of a fused kernel: registers are blocks,
+    /// slots [0, leaves) are stored nodes.
+    struct _Instr {
+        Lazy_op op;
+        std::size_t dst;
+        std::size_t a;
+        std::size_t b;
+        T scalar;
+        const std::function<T(T)>* f;
+    };
+
+    handle
+    _add(_Node n)
+    {
+        _nodes.push_back(std::move(n));
+        return {this, _nodes.size() - 1};
+    }
+
+    handle
+    _binary(Lazy_op op, std::size_t a, std::size_t b)
+    {
+        assert(_nodes[a].extents == _nodes[b].extents);
+        _Node n;
+        n.op = op;
+        n.a = a;
+        n.b = b;
+        n.extents = _nodes[a].extents;
+        return _add(std::move(n));
+    }
+
+    handle
+    _unary(Lazy_op op, std::size_t a, const T& s)
+    {
+        _Node n;
+        n.op = op;
+        n.a = a;
+        n.scalar = s;
+        n.extents = _nodes[a].extents;
+        return _add(std::move(n));
+    }
+
+    handle
+    _map(std::size_t a, std::function<T(T)> f)
+    {
+        _Node n;
+        n.op = Lazy_op::map;
+        n.a = a;
+        n.f = std::move(f);
+        n.extents = _nodes[a].extents;
+        return _add(std::move(n));
+    }
+
+    static bool
+    _binary_op(Lazy_op op)
+    {
+        return op == Lazy_op::add || op == Lazy_op::sub ||
+               op == Lazy_op::mul || op == Lazy_op::div ||
+               op == Lazy_op::matmul;
+    }
+
+    std::vector<std::size_t>
+    _operands(std::size_t i) const
+    {
+        const auto& n = _nodes[i];
+        if (n.op == Lazy_op::input)
+            return {};
+        if (_binary_op(n.op))
+            return {n.a, n.b};
+        return {n.a};
+    }
+
+    static bool
+    _row_major(const Tensor_slice<N>& d)
+    { return d == Tensor_slice<N>(d.extents); }
+
+    /// Call f on the stored nodes (and inputs) read by the
+    /// fused kernel of node i.
+    template <typename F>
+    void
+    _for_each_leaf(std::size_t i, const std::vector<bool>& stored, F f) const
+    {
+        for (auto a : _operands(i)) {
+            if (stored[a] || _nodes[a].op == Lazy_op::input)
+                f(a);
+            else
+                _for_each_leaf(a, stored, f);
+        }
+    }
+
+    /// Stored node or input i as a tensor.
+    const Tensor<T, N>&
+    _leaf(std::size_t i, const std::vector<Tensor<T, N>>& buffers) const
+    { return buffers[i].size() || !_nodes[i].source ? buffers[i] : *_nodes[i].source; }
+
+    static Tensor<T, N>
+    _take(std::vector<Tensor<T, N>>& pool, const std::array<std::size_t, N>& exts)
+    {
+        for (auto it = pool.begin(); it != pool.end(); ++it)
+            if (it->descriptor().extents == exts) {
+                Tensor<T, N> t = std::move(*it);
+                pool.erase(it);
+                return t;
+            }
+        return Tensor<T, N>(uninitialized, exts);
+    }
+
+    /// Flatten the element-wise tree of node i into
+    /// instructions. Slots [0, leaves) are the stored nodes it
+    /// reads, slots from leaves on the registers (blocks).
+    /// Returns the slot holding the value of i.
+    std::size_t
+    _compile(std::size_t i, bool top, const std::vector<bool>& stored,
+             const std::vector<std::size_t>& leaves,
+             std::vector<_Instr>& code, std::size_t& regs) const
+    {
+        const auto& n = _nodes[i];
+        if (!top && (stored[i] || n.op == Lazy_op::input))
+            return std::size_t(std::find(leaves.begin(), leaves.end(), i) - leaves.begin());
+
+        _Instr in{n.op, 0, 0, 0, n.scalar, &n.f};
+        in.a = _compile(n.a, false, stored, leaves, code, regs);
+        if (_binary_op(n.op))
+            in.b = _compile(n.b, false, stored, leaves, code, regs);
+        in.dst = leaves.size() + regs++;
+        code.push_back(in);
+        return in.dst;
+    }
+
+    /// Run the fused kernel of node i into out.
+    void
+    _run_fused(std::size_t i, const std::vector<bool>& stored,
+               const std::vector<Tensor<T, N>>& buffers, T* out) const
+    {
+        std::vector<std::size_t> leaf_ids;
+        _for_each_leaf(i, stored, [&](std::size_t l) {
+            if (std::find(leaf_ids.begin(), leaf_ids.end(), l) == leaf_ids.end())
+                leaf_ids.push_back(l);
+        });
+        std::vector<_Instr> code;
+        std::size_t regs = 0;
+        _compile(i, true, stored, leaf_ids, code, regs);
+
+        const std::size_t nl = leaf_ids.size();
+        std::vector<const T*> leaves(nl);
+        for (std::size_t k = 0; k < nl; ++k)
+            leaves[k] = _leaf(leaf_ids[k], buffers).data();
+
+        const std::size_t size = buffers[i].size();
+        const std::size_t B = tensor_impl::_lazy_block;
+        const std::size_t blocks = (size + B - 1) / B;
+        tensor_impl::_parallel_for(blocks,
+                                   std::max<std::size_t>(tensor_impl::_parallel_grain / B, 1),
+                                   [&](std::size_t b0, std::size_t b1) {
+            /// Registers, then room for a partial last block:
+            /// its leaves are copied and padded with their last
+            /// element (no integer division by a zero padding),
+            /// so every operation runs on exactly B elements.
+            std::vector<T> reg((regs + nl + 1) * B);
+            T* tail = reg.data() + regs * B;
+            std::vector<const T*> src(nl + regs);
+            for (std::size_t r = 0; r < regs; ++r)
+                src[nl + r] = reg.data() + r * B;
+
+            for (std::size_t blk = b0; blk < b1; ++blk) {
+                const std::size_t off = blk * B, n = std::min(B, size - off);
+                for (std::size_t k = 0; k < nl; ++k)
+                    if (n == B)
+                        src[k] = leaves[k] + off;
+                    else {
+                        std::copy(leaves[k] + off, leaves[k] + off + n, tail + k * B);
+                        std::fill(tail + k * B + n, tail + (k + 1) * B, leaves[k][off + n - 1]);
+                        src[k] = tail + k * B;
+                    }
+                for (std::size_t c = 0; c < code.size(); ++c) {
+                    const auto& in = code[c];
+                    T* d = c + 1 != code.size() ? reg.data() + (in.dst - nl) * B
+                         : n == B ? out + off : tail + nl * B;
+                    _exec(in, d, src[in.a], src[in.b]);
+                }
+                if (n != B)
+                    std::copy(tail + nl * B, tail + nl * B + n, out + off);
+            }
+        });
+    }
+
+    /// One operation on a block. Blocks never overlap and the
+    /// count is a constant, so every loop is vectorized whole.
+    static void
+    _exec(const _Instr& in, T* __restrict d, const T* __restrict a,
+          const T* __restrict b)
+    {
+        constexpr std::size_t n = tensor_impl::_lazy_block;
+        const T s = in.scalar;
+        switch (in.op) {
+        case Lazy_op::add:         for (std::size_t i = 0; i < n; ++i) d[i] = a[i] + b[i]; break;
+        case Lazy_op::sub:         for (std::size_t i = 0; i < n; ++i) d[i] = a[i] - b[i]; break;
+        case Lazy_op::mul:         for (std::size_t i = 0; i < n; ++i) d[i] = a[i] * b[i]; break;
+        case Lazy_op::div:         for (std::size_t i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+        case Lazy_op::add_scalar:  for (std::size_t i = 0; i < n; ++i) d[i] = a[i] + s; break;
+        case Lazy_op::mul_scalar:  for (std::size_t i = 0; i < n; ++i) d[i] = a[i] * s; break;
+        case Lazy_op::div_scalar:  for (std::size_t i = 0; i < n; ++i) d[i] = a[i] / s; break;
+        case Lazy_op::rsub_scalar: for (std::size_t i = 0; i < n; ++i) d[i] = s - a[i]; break;
+        case Lazy_op::rdiv_scalar: for (std::size_t i = 0; i < n; ++i) d[i] = s / a[i]; break;
+        case Lazy_op::neg:         for (std::size_t i = 0; i < n; ++i) d[i] = -a[i]; break;
+        case Lazy_op::map:         for (std::size_t i = 0; i < n; ++i) d[i] = (*in.f)(a[i]); break;
+        default: assert(false);
+        }
+    }
+
+    std::vector<_Node> _nodes;
+};
+
+///-----------------------------------------------------------------------------------------------------------///
+/// Operators recording nodes
+
+template <typename T, std::size_t N>
+Lazy<T, N>
+_lazy_binary(Lazy_op op, const Lazy<T, N>& a, const Lazy<T, N>& b)
+{
+    assert(a.graph() == b.graph());
+    return a.graph()->_binary(op, a.id(), b.id());
+}
+
+template <typename T, std::size_t N>
+Lazy<T, N>
+_lazy_scalar(Lazy_op op, const Lazy<T, N>& a, const T& s)
+{ return a.graph()->_unary(op, a.id(), s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator+ (const Lazy<T, N>& a, const Lazy<T, N>& b)
+{ return _lazy_binary(Lazy_op::add, a, b); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator- (const Lazy<T, N>& a, const Lazy<T, N>& b)
+{ return _lazy_binary(Lazy_op::sub, a, b); }
+
+/// Element-wise product (use matmul for the matrix product).
+template <typename T, std::size_t N>
+Lazy<T, N> operator* (const Lazy<T, N>& a, const Lazy<T, N>& b)
+{ return _lazy_binary(Lazy_op::mul, a, b); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator/ (const Lazy<T, N>& a, const Lazy<T, N>& b)
+{ return _lazy_binary(Lazy_op::div, a, b); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator+ (const Lazy<T, N>& a, const typename Lazy<T, N>::value_type& s)
+{ return _lazy_scalar(Lazy_op::add_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator+ (const typename Lazy<T, N>::value_type& s, const Lazy<T, N>& a)
+{ return _lazy_scalar(Lazy_op::add_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator- (const Lazy<T, N>& a, const typename Lazy<T, N>::value_type& s)
+{ return _lazy_scalar(Lazy_op::add_scalar, a, T(-s)); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator- (const typename Lazy<T, N>::value_type& s, const Lazy<T, N>& a)
+{ return _lazy_scalar(Lazy_op::rsub_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator* (const Lazy<T, N>& a, const typename Lazy<T, N>::value_type& s)
+{ return _lazy_scalar(Lazy_op::mul_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator* (const typename Lazy<T, N>::value_type& s, const Lazy<T, N>& a)
+{ return _lazy_scalar(Lazy_op::mul_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator/ (const Lazy<T, N>& a, const typename Lazy<T, N>::value_type& s)
+{ return _lazy_scalar(Lazy_op::div_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator/ (const typename Lazy<T, N>::value_type& s, const Lazy<T, N>& a)
+{ return _lazy_scalar(Lazy_op::rdiv_scalar, a, s); }
+
+template <typename T, std::size_t N>
+Lazy<T, N> operator- (const Lazy<T, N>& a)
+{ return _lazy_scalar(Lazy_op::neg, a, T{}); }
+
+/**
+ * @brief matmul. Record a matrix product. Its operands
+ *        and result are always stored.
+ * @param a
+ * @param b
+ * @return Lazy handle on the result.
+ */
+template <typename T>
+Lazy<T, 2>
+matmul(const Lazy<T, 2>& a, const Lazy<T, 2>& b)
+{
+    assert(a.graph() == b.graph());
+    assert(a.extents()[1] == b.extents()[0]);
+    auto* g = a.graph();
+    typename Lazy_graph<T, 2>::_Node n;
+    n.op = Lazy_op::matmul;
+    n.a = a.id();
+    n.b = b.id();
+    n.extents = {a.extents()[0], b.extents()[1]};
+    return g->_add(std::move(n));
+}
+
+NUM_END
+
+#endif // LAZY_H
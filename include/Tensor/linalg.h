@@ -0,0 +1,484 @@
+#ifndef LINALG_H
+#define LINALG_H
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor.h"
+#include "tensor_ref.h"
+#include "operands.h"
+#include "copy.h"
+#include "gemm.h"
+#include "trace.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/// Factorizations return an info code as LAPACK does:
+/// 0 on success, k > 0 if the k-th pivot (1-based) is zero
+/// (LU, the factorization is completed anyway) or the k-th
+/// leading minor is not positive definite (Cholesky, the
+/// factorization stops there).
+
+namespace tensor_impl {
+
+/// Columns of a panel; trailing updates are products of
+/// panels of this width.
+constexpr std::size_t _linalg_block = 64;
+
+/**
+ * @brief The _Mat_view struct. A strided matrix for the
+ *        factorization kernels: blocks and transposes are
+ *        free, elements are reached without bounds checks.
+ */
+template <typename T>
+struct _Mat_view {
+
+    T&
+    operator()(std::size_t i, std::size_t j) const
+    { return p[i * s0 + j * s1]; }
+
+    _Mat_view
+    block(std::size_t i, std::size_t j, std::size_t r, std::size_t c) const
+    { return {p + i * s0 + j * s1, r, c, s0, s1}; }
+
+    _Mat_view
+    t() const
+    { return {p, cols, rows, s1, s0}; }
+
+    _Mat_view<const T>
+    as_const() const
+    { return {p, rows, cols, s0, s1}; }
+
+    Tensor_ref<T, 2>
+    ref() const
+    { return {Tensor_slice<2>(0, {rows, cols}, {s0, s1}), p}; }
+
+    T* p;
+    std::size_t rows;
+    std::size_t cols;
+    std::size_t s0;
+    std::size_t s1;
+};
+
+/**
+ * @brief _view. View of a matrix, or of a vector as a
+ *        column.
+ * @param m Tensor or Tensor_ref of order 1 or 2.
+ * @return _Mat_view.
+ */
+template <typename M>
+auto
+_view(M& m) -> _Mat_view<std::remove_pointer_t<decltype(m.data())>>
+{
+    const auto& d = m.descriptor();
+    auto* p = m.data() + d.start;
+    if constexpr (M::order == 1)
+        return {p, d.extents[0], 1, d.strides[0], 1};
+    else
+        return {p, d.extents[0], d.extents[1], d.strides[0], d.strides[1]};
+}
+
+/**
+ * @brief _gemm_sub. c -= a * b, with the library product
+ *        (in place by gemm for arithmetic types).
+ * @param c
+ * @param a
+ * @param b
+ */
+template <typename T, typename U>
+void
+_gemm_sub(const _Mat_view<T>& c, const _Mat_view<U>& a, const _Mat_view<U>& b)
+{
+    if (c.rows == 0 || c.cols == 0 || a.cols == 0)
+        return;
+    if constexpr (std::is_arithmetic<T>::value)
+        _gemm(c.rows, c.cols, a.cols, T(-1), a.p, a.s0, a.s1, b.p, b.s0, b.s1,
+              T(1), c.p, c.s0, c.s1);
+    else
+        c.ref() -= a.ref() * b.ref();
+}
+
+/**
+ * @brief _row_axpy. Row i of b += alpha * row q of b.
+ */
+template <typename T>
+void
+_row_axpy(const _Mat_view<T>& b, std::size_t i, std::size_t q, T alpha)
+{
+    T* __restrict y = &b(i, 0);
+    const T* __restrict x = &b(q, 0);
+    if (b.s1 == 1)
+        for (std::size_t c = 0; c < b.cols; ++c)
+            y[c] += alpha * x[c];
+    else
+        for (std::size_t c = 0; c < b.cols; ++c)
+            y[c * b.s1] += alpha * x[c * b.s1];
+}
+
+/**
+ * @brief _row_scale. Row i of b *= alpha.
+ */
+template <typename T>
+void
+_row_scale(const _Mat_view<T>& b, std::size_t i, T alpha)
+{
+    for (std::size_t c = 0; c < b.cols; ++c)
+        b(i, c) *= alpha;
+}
+
+/**
+ * @brief _swap_rows. Exchange rows i and k of a.
+ */
+template <typename T>
+void
+_swap_rows(const _Mat_view<T>& a, std::size_t i, std::size_t k)
+{
+    for (std::size_t c = 0; c < a.cols; ++c)
+        std::swap(a(i, c), a(k, c));
+}
+
+/**
+ * @brief _solve_lower. b := l^-1 b, l lower triangular
+ *        (unit diagonal if unit). Blocks of rows are solved
+ *        by substitution, then subtracted from the rows
+ *        below with one product.
+ */
+template <typename U, typename T>
+void
+_solve_lower(const _Mat_view<U>& l, const _Mat_view<T>& b, bool unit)
+{
+    assert(l.rows == l.cols && l.rows == b.rows);
+    const std::size_t n = b.rows, k = b.cols;
+    for (std::size_t i0 = 0; i0 < n; i0 += _linalg_block) {
+        const std::size_t ib = std::min(_linalg_block, n - i0);
+        for (std::size_t i = i0; i < i0 + ib; ++i) {
+            for (std::size_t q = i0; q < i; ++q)
+                _row_axpy(b, i, q, T(-l(i, q)));
+            if (!unit)
+                _row_scale(b, i, T(1) / T(l(i, i)));
+        }
+        const std::size_t rest = n - i0 - ib;
+        _gemm_sub(b.block(i0 + ib, 0, rest, k),
+                  l.block(i0 + ib, i0, rest, ib),
+                  _Mat_view<U>{b.block(i0, 0, ib, k).p, ib, k, b.s0, b.s1});
+    }
+}
+
+/**
+ * @brief _solve_upper. b := u^-1 b, u upper triangular
+ *        (unit diagonal if unit), blocks from the bottom.
+ */
+template <typename U, typename T>
+void
+_solve_upper(const _Mat_view<U>& u, const _Mat_view<T>& b, bool unit)
+{
+    assert(u.rows == u.cols && u.rows == b.rows);
+    const std::size_t n = b.rows, k = b.cols;
+    for (std::size_t i1 = n; i1 > 0; ) {
+        const std::size_t ib = std::min(_linalg_block, i1), i0 = i1 - ib;
+        for (std::size_t i = i1; i-- > i0; ) {
+            for (std::size_t q = i + 1; q < i1; ++q)
+                _row_axpy(b, i, q, T(-u(i, q)));
+            if (!unit)
+                _row_scale(b, i, T(1) / T(u(i, i)));
+        }
+        _gemm_sub(b.block(0, 0, i0, k),
+                  u.block(0, i0, i0, ib),
+                  _Mat_view<U>{b.block(i0, 0, ib, k).p, ib, k, b.s0, b.s1});
+        i1 = i0;
+    }
+}
+
+/**
+ * @brief _lu_panel. Unblocked LU with partial pivoting of
+ *        columns [j, j + jb), rows [j, n). Whole rows are
+ *        swapped, the update stays inside the panel.
+ */
+template <typename T>
+std::size_t
+_lu_panel(const _Mat_view<T>& a, std::size_t j, std::size_t jb,
+          std::size_t* piv, std::size_t info)
+{
+    const std::size_t n = a.rows;
+    for (std::size_t c = j; c < j + jb; ++c) {
+        std::size_t p = c;
+        auto best = std::abs(a(c, c));
+        for (std::size_t r = c + 1; r < n; ++r)
+            if (std::abs(a(r, c)) > best) {
+                best = std::abs(a(r, c));
+                p = r;
+            }
+        piv[c] = p;
+        if (p != c)
+            _swap_rows(a, c, p);
+
+        if (a(c, c) == T(0)) {
+            if (info == 0)
+                info = c + 1;
+            continue;
+        }
+        const T inv = T(1) / a(c, c);
+        for (std::size_t r = c + 1; r < n; ++r) {
+            const T l = a(r, c) *= inv;
+            for (std::size_t q = c + 1; q < j + jb; ++q)
+                a(r, q) -= l * a(c, q);
+        }
+    }
+    return info;
+}
+
+/**
+ * @brief _lu. Blocked right-looking LU: factor a panel,
+ *        solve the block row of U, update the trailing
+ *        matrix with one product.
+ */
+template <typename T>
+std::size_t
+_lu(const _Mat_view<T>& a, std::size_t* piv)
+{
+    const std::size_t n = a.rows;
+    std::size_t info = 0;
+    for (std::size_t j = 0; j < n; j += _linalg_block) {
+        const std::size_t jb = std::min(_linalg_block, n - j), m = n - j - jb;
+        info = _lu_panel(a, j, jb, piv, info);
+        if (m == 0)
+            break;
+        _solve_lower(a.block(j, j, jb, jb).as_const(), a.block(j, j + jb, jb, m), true);
+        _gemm_sub(a.block(j + jb, j + jb, m, m),
+                  a.block(j + jb, j, m, jb).as_const(),
+                  a.block(j, j + jb, jb, m).as_const());
+    }
+    return info;
+}
+
+/**
+ * @brief _cholesky. Blocked right-looking Cholesky, lower
+ *        triangle: factor the diagonal block, solve the
+ *        panel below it, update the lower trailing matrix
+ *        with products of row blocks. The strictly upper
+ *        triangle is never read nor written.
+ */
+template <typename T>
+std::size_t
+_cholesky(const _Mat_view<T>& a)
+{
+    using std::sqrt;
+    const std::size_t n = a.rows;
+    for (std::size_t j = 0; j < n; j += _linalg_block) {
+        const std::size_t jb = std::min(_linalg_block, n - j), m = n - j - jb;
+        const auto a11 = a.block(j, j, jb, jb);
+        for (std::size_t c = 0; c < jb; ++c) {
+            const T d = a11(c, c);
+            if (!(d > T(0)))
+                return j + c + 1;
+            const T s = sqrt(d);
+            a11(c, c) = s;
+            for (std::size_t r = c + 1; r < jb; ++r)
+                a11(r, c) /= s;
+            for (std::size_t q = c + 1; q < jb; ++q)
+                for (std::size_t r = q; r < jb; ++r)
+                    a11(r, q) -= a11(r, c) * a11(q, c);
+        }
+        if (m == 0)
+            break;
+
+        /// A21 := A21 L11^-T, i.e. A21^T := L11^-1 A21^T.
+        const auto a21 = a.block(j + jb, j, m, jb);
+        const auto a22 = a.block(j + jb, j + jb, m, m);
+        _solve_lower(a11.as_const(), a21.t(), false);
+
+        for (std::size_t i0 = 0; i0 < m; i0 += _linalg_block) {
+            const std::size_t ib = std::min(_linalg_block, m - i0);
+            const auto ai = a21.block(i0, 0, ib, jb);
+            _gemm_sub(a22.block(i0, 0, ib, i0), ai.as_const(),
+                      a21.block(0, 0, i0, jb).t().as_const());
+            for (std::size_t r = 0; r < ib; ++r)
+                for (std::size_t q = 0; q <= r; ++q) {
+                    T s = T(0);
+                    for (std::size_t c = 0; c < jb; ++c)
+                        s += ai(r, c) * ai(q, c);
+                    a22(i0 + r, i0 + q) -= s;
+                }
+        }
+    }
+    return 0;
+}
+
+};
+
+/**
+ * @brief lu_factor. In place LU factorization with partial
+ *        pivoting, P a = L U: a is overwritten by L (unit
+ *        lower, diagonal not stored) and U. Row i was swapped
+ *        with row piv(i), in order.
+ * @param a square matrix (Tensor or Tensor_ref).
+ * @param piv resized to the order of a if needed.
+ * @return info.
+ */
+template <typename A,
+          typename = Enable_if<(_2d<std::remove_reference_t<A>>())>>
+std::size_t
+lu_factor(A&& a, Tensor<std::size_t, 1>& piv)
+{
+    TENSOR_TRACE("lu_factor", a);
+    const auto v = tensor_impl::_view(a);
+    assert(v.rows == v.cols);
+    if (piv.size() != v.rows)
+        piv = Tensor<std::size_t, 1>(uninitialized, v.rows);
+    return tensor_impl::_lu(v, piv.data());
+}
+
+/**
+ * @brief lu_solve. Solve a x = b in place (b := x) from the
+ *        factorization of lu_factor.
+ * @param lu
+ * @param piv
+ * @param b vector or matrix of right-hand sides.
+ */
+template <typename M, typename B,
+          typename = Enable_if<(_2d<M>() &&
+                                _tensor_type<std::remove_reference_t<B>>())>>
+void
+lu_solve(const M& lu, const Tensor<std::size_t, 1>& piv, B&& b)
+{
+    TENSOR_TRACE("lu_solve", lu, b);
+    const auto l = tensor_impl::_view(lu);
+    const auto x = tensor_impl::_view(b);
+    assert(piv.size() == l.rows);
+    for (std::size_t i = 0; i < x.rows; ++i)
+        if (piv(i) != i)
+            tensor_impl::_swap_rows(x, i, piv(i));
+    tensor_impl::_solve_lower(l, x, true);
+    tensor_impl::_solve_upper(l, x, false);
+}
+
+/**
+ * @brief cholesky_factor. In place Cholesky factorization
+ *        a = L L^T of a symmetric positive definite matrix:
+ *        the lower triangle of a is read and overwritten by
+ *        L, the strictly upper one is left untouched.
+ * @param a square matrix (Tensor or Tensor_ref).
+ * @return info.
+ */
+template <typename A,
+          typename = Enable_if<(_2d<std::remove_reference_t<A>>())>>
+std::size_t
+cholesky_factor(A&& a)
+{
+    TENSOR_TRACE("cholesky_factor", a);
+    const auto v = tensor_impl::_view(a);
+    assert(v.rows == v.cols);
+    return tensor_impl::_cholesky(v);
+}
+
+/**
+ * @brief cholesky_solve. Solve a x = b in place (b := x)
+ *        from the factor of cholesky_factor.
+ * @param l
+ * @param b vector or matrix of right-hand sides.
+ */
+template <typename M, typename B,
+          typename = Enable_if<(_2d<M>() &&
+                                _tensor_type<std::remove_reference_t<B>>())>>
+void
+cholesky_solve(const M& l, B&& b)
+{
+    TENSOR_TRACE("cholesky_solve", l, b);
+    const auto v = tensor_impl::_view(l);
+    const auto x = tensor_impl::_view(b);
+    tensor_impl::_solve_lower(v, x, false);
+    tensor_impl::_solve_upper(v.t(), x, false);
+}
+
+/**
+ * @brief solve_lower. Forward substitution in place,
+ *        b := l^-1 b; only the lower triangle of l is read.
+ * @param l
+ * @param b vector or matrix of right-hand sides.
+ * @param unit the diagonal of l is taken as 1.
+ */
+template <typename M, typename B,
+          typename = Enable_if<(_2d<M>() &&
+                                _tensor_type<std::remove_reference_t<B>>())>>
+void
+solve_lower(const M& l, B&& b, bool unit = false)
+{
+    TENSOR_TRACE("solve_lower", l, b);
+    tensor_impl::_solve_lower(tensor_impl::_view(l), tensor_impl::_view(b), unit);
+}
+
+/**
+ * @brief solve_upper. Back substitution in place,
+ *        b := u^-1 b; only the upper triangle of u is read.
+ * @param u
+ * @param b vector or matrix of right-hand sides.
+ * @param unit the diagonal of u is taken as 1.
+ */
+template <typename M, typename B,
+          typename = Enable_if<(_2d<M>() &&
+                                _tensor_type<std::remove_reference_t<B>>())>>
+void
+solve_upper(const M& u, B&& b, bool unit = false)
+{
+    TENSOR_TRACE("solve_upper", u, b);
+    tensor_impl::_solve_upper(tensor_impl::_view(u), tensor_impl::_view(b), unit);
+}
+
+/**
+ * @brief solve. Solve a x = b by LU, a and b unchanged.
+ * @param a
+ * @param b vector or matrix of right-hand sides.
+ * @param info if not null, set to the info of lu_factor.
+ * @return x.
+ */
+template <typename M, typename B,
+          typename = Enable_if<(_2d<M>() && _tensor_type<B>())>>
+Tensor<Value_type<B>, B::order>
+solve(const M& a, const B& b, std::size_t* info = nullptr)
+{
+    Tensor<Value_type<M>, 2> lu(uninitialized, a.rows(), a.cols());
+    tensor_impl::_copy(a.data(), a.descriptor(), lu.data(), lu.descriptor());
+    Tensor<Value_type<B>, B::order> x(uninitialized, b.descriptor().extents);
+    tensor_impl::_copy(b.data(), b.descriptor(), x.data(), x.descriptor());
+
+    Tensor<std::size_t, 1> piv;
+    const std::size_t r = lu_factor(lu, piv);
+    if (info)
+        *info = r;
+    lu_solve(lu, piv, x);
+    return x;
+}
+
+/**
+ * @brief cholesky. Cholesky factor of a, a unchanged.
+ * @param a symmetric positive definite matrix.
+ * @param info if not null, set to the info of cholesky_factor.
+ * @return L, lower triangular.
+ */
+template <typename M,
+          typename = Enable_if<(_2d<M>())>>
+Tensor<Value_type<M>, 2>
+cholesky(const M& a, std::size_t* info = nullptr)
+{
+    Tensor<Value_type<M>, 2> l(uninitialized, a.rows(), a.cols());
+    tensor_impl::_copy(a.data(), a.descriptor(), l.data(), l.descriptor());
+    const std::size_t r = cholesky_factor(l);
+    if (info)
+        *info = r;
+    for (std::size_t i = 0; i < l.rows(); ++i)
+        for (std::size_t j = i + 1; j < l.cols(); ++j)
+            l(i, j) = Value_type<M>(0);
+    return l;
+}
+
+NUM_END
+
+#endif // LINALG_H
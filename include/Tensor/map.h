@@ -0,0 +1,76 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <iostream>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+#include "tensor.h"
+#include "iteration.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief zip_apply. Call f(o, x...) on every element o of out
+ *        and the corresponding elements x of ins, in a single
+ *        pass: extents are checked once, the dimensions of all
+ *        tensors are collapsed together and the work is split
+ *        across the thread pool. out and ins can be Tensor or
+ *        Tensor_ref, of any layout. f is called concurrently.
+ *
+ *            zip_apply(out, [=](float& o, float x, float y) { o = a * x + b * y + c; }, x, y);
+ *
+ * @param out
+ * @param f
+ * @param ins
+ * @return out.
+ */
+template <typename O, typename F, typename... Ms,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>()>>
+O&&
+zip_apply(O&& out, F f, const Ms&... ins)
+{
+    static_assert (All(_tensor_type<Ms>()...),
+                   "zip_apply: inputs must be Tensor or Tensor_ref");
+    const auto& od = out.descriptor();
+    assert(All((ins.descriptor().extents == od.extents)...));
+    tensor_impl::_parallel_for_each(tensor_impl::_make_loop(od, ins.descriptor()...), f,
+                                    out.data() + od.start,
+                                    (ins.data() + ins.descriptor().start)...);
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief map. New tensor with f(x...) of the corresponding
+ *        elements x of ins, computed in a single parallel pass.
+ *
+ *            auto out = map([=](float x, float y) { return a * x + b * y + c; }, x, y);
+ *
+ * @param f
+ * @param first
+ * @param rest
+ * @return Tensor of the type returned by f, with the extents
+ *         of the inputs.
+ */
+template <typename F, typename M, typename... Ms,
+          typename = Enable_if<_tensor_type<M>()>>
+auto
+map(F f, const M& first, const Ms&... rest)
+{
+    using R = std::decay_t<decltype(f(std::declval<const Value_type<M>&>(),
+                                      std::declval<const Value_type<Ms>&>()...))>;
+    Tensor<R, M::order> result(uninitialized, first.descriptor().extents);
+    zip_apply(result, [&f](R& o, const Value_type<M>& x, const Value_type<Ms>&... xs) {
+        o = f(x, xs...);
+    }, first, rest...);
+    return result;
+}
+
+NUM_END
+
+#endif // MAP_H
@@ -0,0 +1,847 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include <iostream>
+#include <array>
+#include <bitset>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cassert>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "tensor.h"
+#include "tensor_slice.h"
+#include "iteration.h"
+#include "parallel.h"
+#include "storage.h"
+#include "traits.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * Element-wise comparisons of tensors (and views) give a
+ * Mask: one bit per element, in row-major order whatever
+ * the layout of the operands, so a 100M-element mask takes
+ * 12.5 MB. Masks combine with &, |, ^ and ~ and drive
+ * where, masked_fill, masked_assign and masked_select:
+ *
+ *     auto keep = greater(scores, 0.5f) & less_equal(scores, 0.9f);
+ *     masked_fill(scores, ~keep, 0.f);
+ *     auto kept = masked_select(scores, keep);
+ *
+ * Kernels run by blocks of _mask_block elements, compared
+ * or selected into bytes by vectorized loops, then packed
+ * into words (or words unpacked into bytes); blocks are
+ * split across the thread pool.
+ */
+
+namespace tensor_impl {
+
+/// Elements per block of the mask kernels (64 words).
+constexpr std::size_t _mask_block = 4096;
+
+/// Words of a mask of n bits.
+inline std::size_t
+_mask_words(std::size_t n)
+{ return (n + 63) / 64; }
+
+/**
+ * @brief _pack_bits. 64 bytes (0 or 1) to a word, byte i
+ *        to bit i.
+ */
+inline std::uint64_t
+_pack_bits(const std::uint8_t* c)
+{
+#if defined(__AVX2__)
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + 32));
+    const std::uint32_t a = std::uint32_t(_mm256_movemask_epi8(_mm256_cmpgt_epi8(lo, z)));
+    const std::uint32_t b = std::uint32_t(_mm256_movemask_epi8(_mm256_cmpgt_epi8(hi, z)));
+    return a | (std::uint64_t(b) << 32);
+#else
+    /// Byte k of x (little-endian) lands in bit 56 + k.
+    std::uint64_t w = 0;
+    for (std::size_t j = 0; j < 8; ++j) {
+        std::uint64_t x;
+        std::memcpy(&x, c + 8 * j, 8);
+        w |= ((x * 0x0102040810204080ull) >> 56) << (8 * j);
+    }
+    return w;
+#endif
+}
+
+/**
+ * @brief _unpack_bits. A word to 64 bytes (0 or 1), bit i
+ *        to byte i.
+ */
+inline void
+_unpack_bits(std::uint64_t w, std::uint8_t* c)
+{
+    for (std::size_t j = 0; j < 8; ++j) {
+        /// Bit k of the byte b kept in byte k, then made 0 or 1.
+        const std::uint64_t b = (w >> (8 * j)) & 0xFF;
+        std::uint64_t x = (b * 0x0101010101010101ull) & 0x8040201008040201ull;
+        x = ((x + 0x7F7F7F7F7F7F7F7Full) >> 7) & 0x0101010101010101ull;
+        std::memcpy(c + 8 * j, &x, 8);
+    }
+}
+
+/**
+ * @brief The _Walk struct. Visit of a range of logical
+ *        (row-major) indices of K operands with the same
+ *        extents, by spans along which each of them has a
+ *        constant step: the whole range if every operand is
+ *        dense row-major or a scalar (step 0), the rows of
+ *        the last dimension otherwise.
+ */
+template <std::size_t N, std::size_t K>
+struct _Walk {
+
+    /**
+     * @brief operator (). Call f(i, n, off) on the spans of
+     *        [b, e), off the offsets of logical index i.
+     */
+    template <typename F>
+    void
+    operator() (std::size_t b, std::size_t e, F&& f) const
+    {
+        std::size_t i = b;
+        while (i < e) {
+            std::size_t r = i / inner;
+            const std::size_t j = i % inner;
+            std::array<std::size_t, K> off;
+            for (std::size_t k = 0; k < K; ++k)
+                off[k] = start[k] + j * step[k];
+            for (std::size_t d = N - 1; d-- > 0 && r > 0;) {
+                const std::size_t x = r % extents[d];
+                r /= extents[d];
+                for (std::size_t k = 0; k < K; ++k)
+                    off[k] += x * strides[k][d];
+            }
+            const std::size_t n = std::min(e - i, inner - j);
+            f(i, n, off);
+            i += n;
+        }
+    }
+
+    std::array<std::size_t, N> extents;
+    std::array<std::size_t, K> start;
+    std::array<std::array<std::size_t, N>, K> strides;
+    std::array<std::size_t, K> step;
+    std::size_t inner;
+};
+
+/**
+ * @brief _make_walk. Walk of operands of extents exts
+ *        described by ds (null for a scalar).
+ */
+template <std::size_t N, std::size_t K>
+_Walk<N, K>
+_make_walk(const std::array<std::size_t, N>& exts,
+           const std::array<const Tensor_slice<N>*, K>& ds)
+{
+    const Tensor_slice<N> rm(exts);
+    _Walk<N, K> w;
+    w.extents = exts;
+    bool dense = true;
+    for (std::size_t k = 0; k < K; ++k) {
+        if (ds[k]) {
+            w.start[k] = ds[k]->start;
+            w.strides[k] = ds[k]->strides;
+            dense = dense && ds[k]->strides == rm.strides;
+        } else {
+            w.start[k] = 0;
+            w.strides[k].fill(0);
+        }
+    }
+    if (dense) {
+        w.inner = std::max<std::size_t>(rm.size, 1);
+        for (std::size_t k = 0; k < K; ++k)
+            w.step[k] = ds[k] ? 1 : 0;
+    } else {
+        w.inner = std::max<std::size_t>(exts[N - 1], 1);
+        for (std::size_t k = 0; k < K; ++k)
+            w.step[k] = w.strides[k][N - 1];
+    }
+    return w;
+}
+
+/**
+ * @brief _for_each_block. Call g(lo, hi, c) on the blocks
+ *        [lo, hi) of _mask_block logical indices of [0, n),
+ *        c a scratch of _mask_block bytes; blocks are split
+ *        across the pool.
+ */
+template <typename G>
+void
+_for_each_block(std::size_t n, std::size_t cost, G g)
+{
+    constexpr std::size_t S = _mask_block;
+    _parallel_for((n + S - 1) / S, std::max<std::size_t>(_parallel_grain / (S * cost), 1),
+                  [&](std::size_t b, std::size_t e) {
+        alignas(64) std::uint8_t c[S];
+        for (std::size_t q = b; q < e; ++q)
+            g(q * S, std::min(n, q * S + S), c);
+    });
+}
+
+/// Operand type: element type of a tensor, or a scalar.
+template <typename A, typename = void>
+struct _Arg_value {
+    using type = A;
+};
+
+template <typename A>
+struct _Arg_value<A, Enable_if<_tensor_type<A>()>> {
+    using type = Value_type<A>;
+};
+
+template <typename A>
+using _Arg_value_t = typename _Arg_value<A>::type;
+
+/// First element of an operand, or the scalar.
+template <typename A>
+const _Arg_value_t<A>*
+_arg_data(const A& a)
+{
+    if constexpr (_tensor_type<A>())
+        return a.data();
+    else
+        return &a;
+}
+
+/// Descriptor of an operand, null for a scalar.
+template <std::size_t N, typename A>
+const Tensor_slice<N>*
+_arg_desc(const A& a)
+{
+    if constexpr (_tensor_type<A>()) {
+        static_assert (A::order == N, "mask: orders mismatch");
+        return &a.descriptor();
+    } else {
+        return nullptr;
+    }
+}
+
+/// Unit stride operand (a scalar always is).
+template <typename A>
+bool
+_arg_unit(std::size_t s)
+{ return !_tensor_type<A>() || s == 1; }
+
+/// Bytes read per element of an operand (none for a scalar).
+template <typename A>
+constexpr std::size_t
+_arg_bytes()
+{ return _tensor_type<A>() ? sizeof(_Arg_value_t<A>) : 0; }
+
+/// Element u of an operand of step s (the scalar itself).
+template <typename A, typename T>
+const T&
+_arg_at(const T* p, std::size_t u, std::size_t s)
+{
+    if constexpr (_tensor_type<A>())
+        return p[u * s];
+    else
+        return *p;
+}
+
+/// Elements per vectorized chunk of a span.
+constexpr std::size_t _mask_chunk = 64;
+
+/**
+ * @brief _compare_chunk. q[v] = op(x[v], y[v]) on a chunk
+ *        of unit-stride operands (or scalars).
+ */
+template <typename A, typename B, typename X, typename Y, typename Op>
+void
+_compare_chunk(std::uint8_t* __restrict q, const X* __restrict x,
+               const Y* __restrict y, Op& op)
+{
+    constexpr std::size_t V = _mask_chunk;
+    if constexpr (_tensor_type<A>() && _tensor_type<B>()) {
+        for (std::size_t v = 0; v < V; ++v)
+            q[v] = std::uint8_t(op(x[v], y[v]));
+    } else if constexpr (_tensor_type<A>()) {
+        const Y b = *y;
+        for (std::size_t v = 0; v < V; ++v)
+            q[v] = std::uint8_t(op(x[v], b));
+    } else {
+        const X a = *x;
+        for (std::size_t v = 0; v < V; ++v)
+            q[v] = std::uint8_t(op(a, y[v]));
+    }
+}
+
+/**
+ * @brief _compare_span. q[u] = op(x[u], y[u]) on a span of
+ *        n elements, x and y of steps sx and sy.
+ */
+template <typename A, typename B, typename X, typename Y, typename Op>
+void
+_compare_span(std::size_t n, std::uint8_t* q, const X* x, std::size_t sx,
+              const Y* y, std::size_t sy, Op& op)
+{
+    constexpr std::size_t V = _mask_chunk;
+    std::size_t u = 0;
+    if (_arg_unit<A>(sx) && _arg_unit<B>(sy))
+        for (; u + V <= n; u += V)
+            _compare_chunk<A, B>(q + u, _tensor_type<A>() ? x + u : x,
+                                 _tensor_type<B>() ? y + u : y, op);
+    for (; u < n; ++u)
+        q[u] = std::uint8_t(op(_arg_at<A>(x, u, sx), _arg_at<B>(y, u, sy)));
+}
+
+/**
+ * @brief _where_chunk. z[v] = q[v] ? x[v] : y[v] on a chunk
+ *        of unit-stride operands (or scalars), through
+ *        buffers: z may be x or y.
+ */
+template <typename A, typename B, typename T, typename X, typename Y>
+void
+_where_chunk(T* z, const std::uint8_t* q, const X* x, const Y* y)
+{
+    constexpr std::size_t V = _mask_chunk;
+    alignas(64) T xb[V];
+    alignas(64) T yb[V];
+    alignas(64) T ob[V];
+    if constexpr (_tensor_type<A>())
+        std::copy(x, x + V, xb);
+    else
+        std::fill(xb, xb + V, T(*x));
+    if constexpr (_tensor_type<B>())
+        std::copy(y, y + V, yb);
+    else
+        std::fill(yb, yb + V, T(*y));
+    for (std::size_t v = 0; v < V; ++v)
+        ob[v] = q[v] ? xb[v] : yb[v];
+    std::copy(ob, ob + V, z);
+}
+
+/**
+ * @brief _where_span. z[u] = q[u] ? x[u] : y[u] on a span
+ *        of n elements, of steps sz, sx and sy.
+ */
+template <typename A, typename B, typename T, typename X, typename Y>
+void
+_where_span(std::size_t n, T* z, std::size_t sz, const std::uint8_t* q,
+            const X* x, std::size_t sx, const Y* y, std::size_t sy)
+{
+    constexpr std::size_t V = _mask_chunk;
+    std::size_t u = 0;
+    if (sz == 1 && _arg_unit<A>(sx) && _arg_unit<B>(sy))
+        for (; u + V <= n; u += V)
+            _where_chunk<A, B>(z + u, q + u, _tensor_type<A>() ? x + u : x,
+                               _tensor_type<B>() ? y + u : y);
+    for (; u < n; ++u)
+        z[u * sz] = q[u] ? T(_arg_at<A>(x, u, sx)) : T(_arg_at<B>(y, u, sy));
+}
+
+};
+
+/**
+ * @brief The Mask class. Bit set with the extents of a
+ *        tensor, bit i for the element of logical
+ *        (row-major) index i. Bits past the last element
+ *        are zero.
+ */
+template <std::size_t N>
+class Mask {
+public:
+
+    static constexpr std::size_t order = N;
+    using word_type = std::uint64_t;
+
+    Mask() = default;
+
+    /**
+     * @brief Mask ctor. All bits set to value.
+     * @param exts
+     * @param value
+     */
+    explicit Mask(const std::array<std::size_t, N>& exts, bool value = false)
+        : _desc(exts),
+          _bits(tensor_impl::_mask_words(_desc.size), value ? ~word_type(0) : word_type(0))
+    { _clear_tail(); }
+
+    template <typename... Exts,
+              typename = Enable_if<(sizeof...(Exts) == N && All(std::is_integral<Exts>::value...))>>
+    explicit Mask(Exts... exts)
+        : Mask(std::array<std::size_t, N>{std::size_t(exts)...})
+    {}
+
+    /// Extents, as the ones of a tensor.
+    const std::array<std::size_t, N>&
+    extents() const
+    { return _desc.extents; }
+
+    std::size_t
+    extent(std::size_t i) const
+    {
+        assert(i < N);
+        return _desc.extents[i];
+    }
+
+    /// Elements (bits).
+    std::size_t
+    size() const
+    { return _desc.size; }
+
+    /// Row-major descriptor of the elements.
+    const Tensor_slice<N>&
+    descriptor() const
+    { return _desc; }
+
+    /// Words, 64 bits each.
+    std::size_t
+    words() const
+    { return _bits.size(); }
+
+    word_type*
+    data()
+    { return _bits.data(); }
+
+    const word_type*
+    data() const
+    { return _bits.data(); }
+
+    /**
+     * @brief test.
+     * @param i logical index.
+     * @return bit i.
+     */
+    bool
+    test(std::size_t i) const
+    {
+        assert(i < size());
+        return (_bits.data()[i / 64] >> (i % 64)) & 1;
+    }
+
+    /**
+     * @brief set. Set bit i to v.
+     * @param i logical index.
+     * @param v
+     */
+    void
+    set(std::size_t i, bool v = true)
+    {
+        assert(i < size());
+        const word_type b = word_type(1) << (i % 64);
+        word_type& w = _bits.data()[i / 64];
+        w = v ? (w | b) : (w & ~b);
+    }
+
+    /**
+     * @brief operator (). Bit of an element.
+     * @param dims indexes.
+     * @return the bit.
+     */
+    template <typename... Dims>
+    bool
+    operator() (Dims... dims) const
+    {
+        static_assert (sizeof...(Dims) == N, "Mask::operator(): dimensions mismatch");
+        return test(_desc.flat_index({std::size_t(dims)...}));
+    }
+
+    /// Bits set.
+    std::size_t
+    count() const
+    {
+        std::size_t c = 0;
+        for (std::size_t k = 0; k < words(); ++k)
+            c += std::bitset<64>(_bits.data()[k]).count();
+        return c;
+    }
+
+    bool
+    any() const
+    {
+        for (std::size_t k = 0; k < words(); ++k)
+            if (_bits.data()[k])
+                return true;
+        return false;
+    }
+
+    bool
+    all() const
+    { return count() == size(); }
+
+    /// Bitwise operations with a mask of the same extents.
+    Mask&
+    operator&=(const Mask& m)
+    { return _combine(m, [](word_type a, word_type b) { return a & b; }); }
+
+    Mask&
+    operator|=(const Mask& m)
+    { return _combine(m, [](word_type a, word_type b) { return a | b; }); }
+
+    Mask&
+    operator^=(const Mask& m)
+    { return _combine(m, [](word_type a, word_type b) { return a ^ b; }); }
+
+    /// Complement every bit.
+    Mask&
+    flip()
+    {
+        word_type* w = _bits.data();
+        for (std::size_t k = 0; k < words(); ++k)
+            w[k] = ~w[k];
+        _clear_tail();
+        return *this;
+    }
+
+private:
+
+    template <typename Op>
+    Mask&
+    _combine(const Mask& m, Op op)
+    {
+        assert(extents() == m.extents());
+        word_type* w = _bits.data();
+        const word_type* v = m._bits.data();
+        for (std::size_t k = 0; k < words(); ++k)
+            w[k] = op(w[k], v[k]);
+        return *this;
+    }
+
+    void
+    _clear_tail()
+    {
+        if (size() % 64)
+            _bits.data()[words() - 1] &= (word_type(1) << (size() % 64)) - 1;
+    }
+
+    Tensor_slice<N> _desc;
+    Tensor_storage<word_type> _bits;
+};
+
+template <std::size_t N>
+Mask<N>
+operator&(Mask<N> a, const Mask<N>& b)
+{ return a &= b; }
+
+template <std::size_t N>
+Mask<N>
+operator|(Mask<N> a, const Mask<N>& b)
+{ return a |= b; }
+
+template <std::size_t N>
+Mask<N>
+operator^(Mask<N> a, const Mask<N>& b)
+{ return a ^= b; }
+
+template <std::size_t N>
+Mask<N>
+operator~(Mask<N> a)
+{ return a.flip(); }
+
+/**
+ * @brief compare. Mask of op(a, b) element-wise; a or b
+ *        may be a scalar.
+ * @param a
+ * @param b
+ * @param op
+ * @return Mask.
+ */
+template <typename A, typename B, typename Op,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+compare(const A& a, const B& b, Op op)
+{
+    constexpr std::size_t N = std::conditional_t<_tensor_type<A>(), A, B>::order;
+    const auto& exts = [&]() -> const std::array<std::size_t, N>& {
+        if constexpr (_tensor_type<A>())
+            return a.descriptor().extents;
+        else
+            return b.descriptor().extents;
+    }();
+    if constexpr (_tensor_type<A>() && _tensor_type<B>())
+        assert(a.descriptor().extents == b.descriptor().extents);
+    TENSOR_TRACE("compare", Trace_count{tensor_impl::_calc_size(exts),
+                 tensor_impl::_calc_size(exts) * (tensor_impl::_arg_bytes<A>() +
+                                                  tensor_impl::_arg_bytes<B>()) +
+                 tensor_impl::_mask_words(tensor_impl::_calc_size(exts)) * sizeof(std::uint64_t)});
+
+    Mask<N> m(exts);
+    const auto w = tensor_impl::_make_walk<N, 2>(exts, {tensor_impl::_arg_desc<N>(a),
+                                                        tensor_impl::_arg_desc<N>(b)});
+    const auto* pa = tensor_impl::_arg_data(a);
+    const auto* pb = tensor_impl::_arg_data(b);
+    auto* bits = m.data();
+    tensor_impl::_for_each_block(m.size(), 1, [&](std::size_t lo, std::size_t hi, std::uint8_t* c) {
+        w(lo, hi, [&](std::size_t i, std::size_t n, const std::array<std::size_t, 2>& off) {
+            tensor_impl::_compare_span<A, B>(n, c + (i - lo), pa + off[0], w.step[0],
+                                             pb + off[1], w.step[1], op);
+        });
+        std::fill(c + (hi - lo), c + tensor_impl::_mask_block, std::uint8_t(0));
+        for (std::size_t k = 0; k < tensor_impl::_mask_words(hi - lo); ++k)
+            bits[lo / 64 + k] = tensor_impl::_pack_bits(c + 64 * k);
+    });
+    return m;
+}
+
+/**
+ * @brief equal, not_equal, less, less_equal, greater,
+ *        greater_equal. Element-wise comparisons; a or b
+ *        may be a scalar.
+ * @return Mask.
+ */
+template <typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+equal(const A& a, const B& b)
+{ return compare(a, b, [](const auto& x, const auto& y) { return x == y; }); }
+
+template <typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+not_equal(const A& a, const B& b)
+{ return compare(a, b, [](const auto& x, const auto& y) { return x != y; }); }
+
+template <typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+less(const A& a, const B& b)
+{ return compare(a, b, [](const auto& x, const auto& y) { return x < y; }); }
+
+template <typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+less_equal(const A& a, const B& b)
+{ return compare(a, b, [](const auto& x, const auto& y) { return x <= y; }); }
+
+template <typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+greater(const A& a, const B& b)
+{ return compare(a, b, [](const auto& x, const auto& y) { return x > y; }); }
+
+template <typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+greater_equal(const A& a, const B& b)
+{ return compare(a, b, [](const auto& x, const auto& y) { return x >= y; }); }
+
+/**
+ * @brief where. out = mask ? a : b, element-wise; a and b
+ *        may be scalars, and either may be out.
+ * @param out
+ * @param mask
+ * @param a
+ * @param b
+ * @return out.
+ */
+template <typename O, std::size_t N, typename A, typename B,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>()>>
+O&&
+where(O&& out, const Mask<N>& mask, const A& a, const B& b)
+{
+    using T = Value_type<std::remove_reference_t<O>>;
+    const auto& od = out.descriptor();
+    assert(od.extents == mask.extents());
+    TENSOR_TRACE("where", out);
+
+    const auto w = tensor_impl::_make_walk<N, 3>(od.extents, {&od, tensor_impl::_arg_desc<N>(a),
+                                                              tensor_impl::_arg_desc<N>(b)});
+    T* po = out.data();
+    const auto* pa = tensor_impl::_arg_data(a);
+    const auto* pb = tensor_impl::_arg_data(b);
+    const auto* bits = mask.data();
+    tensor_impl::_for_each_block(mask.size(), 1, [&](std::size_t lo, std::size_t hi, std::uint8_t* c) {
+        for (std::size_t k = 0; k < tensor_impl::_mask_words(hi - lo); ++k)
+            tensor_impl::_unpack_bits(bits[lo / 64 + k], c + 64 * k);
+        w(lo, hi, [&](std::size_t i, std::size_t n, const std::array<std::size_t, 3>& off) {
+            tensor_impl::_where_span<A, B>(n, po + off[0], w.step[0], c + (i - lo),
+                                           pa + off[1], w.step[1], pb + off[2], w.step[2]);
+        });
+    });
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief where. mask ? a : b, element-wise (a or b may be
+ *        a scalar).
+ * @param mask
+ * @param a
+ * @param b
+ * @return a new Tensor.
+ */
+template <std::size_t N, typename A, typename B,
+          typename = Enable_if<(_tensor_type<A>() || _tensor_type<B>())>>
+auto
+where(const Mask<N>& mask, const A& a, const B& b)
+{
+    using T = std::common_type_t<tensor_impl::_Arg_value_t<A>, tensor_impl::_Arg_value_t<B>>;
+    Tensor<T, N> out(uninitialized, mask.extents());
+    where(out, mask, a, b);
+    return out;
+}
+
+/**
+ * @brief masked_fill. Set to value the elements of t whose
+ *        bit is set.
+ * @param t tensor or view.
+ * @param mask
+ * @param value
+ * @return t.
+ */
+template <typename M, std::size_t N,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<M>>()>>
+M&&
+masked_fill(M&& t, const Mask<N>& mask, Value_type<std::remove_reference_t<M>> value)
+{
+    where(t, mask, value, t);
+    return std::forward<M>(t);
+}
+
+/**
+ * @brief masked_assign. Copy into t the elements of src
+ *        (same extents) whose bit is set.
+ * @param t tensor or view.
+ * @param mask
+ * @param src
+ * @return t.
+ */
+template <typename M, std::size_t N, typename S,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<M>>() && _tensor_type<S>())>>
+M&&
+masked_assign(M&& t, const Mask<N>& mask, const S& src)
+{
+    where(t, mask, src, t);
+    return std::forward<M>(t);
+}
+
+/**
+ * @brief masked_select. The elements of t whose bit is set,
+ *        in logical order.
+ * @param t
+ * @param mask
+ * @return a new vector.
+ */
+template <typename M, std::size_t N,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, 1>
+masked_select(const M& t, const Mask<N>& mask)
+{
+    using T = Value_type<M>;
+    constexpr std::size_t S = tensor_impl::_mask_block;
+    const auto& d = t.descriptor();
+    assert(d.extents == mask.extents());
+    TENSOR_TRACE("masked_select", t);
+
+    /// Offset of the output of every block.
+    const std::size_t nb = (mask.size() + S - 1) / S;
+    std::vector<std::size_t> first(nb + 1, 0);
+    const auto* bits = mask.data();
+    for (std::size_t q = 0; q < nb; ++q) {
+        std::size_t c = 0;
+        for (std::size_t k = q * S / 64; k < std::min(mask.words(), (q + 1) * S / 64); ++k)
+            c += std::bitset<64>(bits[k]).count();
+        first[q + 1] = first[q] + c;
+    }
+
+    Tensor<T, 1> out(uninitialized, first[nb]);
+    T* po = out.data();
+    const T* pt = t.data();
+    const auto w = tensor_impl::_make_walk<N, 1>(d.extents, {&d});
+    tensor_impl::_for_each_block(mask.size(), 1, [&](std::size_t lo, std::size_t hi, std::uint8_t* c) {
+        for (std::size_t k = 0; k < tensor_impl::_mask_words(hi - lo); ++k)
+            tensor_impl::_unpack_bits(bits[lo / 64 + k], c + 64 * k);
+        /// Branch free: every element is written, kept if selected.
+        T sel[S];
+        std::size_t k = 0;
+        w(lo, hi, [&](std::size_t i, std::size_t n, const std::array<std::size_t, 1>& off) {
+            const std::uint8_t* q = c + (i - lo);
+            const T* x = pt + off[0];
+            const std::size_t s = w.step[0];
+            std::size_t u = 0;
+            /// Sparse chunks: only the set bits are visited.
+            if (s == 1)
+                for (; u + 64 <= n; u += 64) {
+                    std::uint64_t b = tensor_impl::_pack_bits(q + u);
+                    if (std::bitset<64>(b).count() <= 16)
+                        for (; b; b &= b - 1)
+                            sel[k++] = x[u + std::bitset<64>((b & (~b + 1)) - 1).count()];
+                    else
+                        for (std::size_t v = 0; v < 64; ++v) {
+                            sel[k] = x[u + v];
+                            k += q[u + v];
+                        }
+                }
+            for (; u < n; ++u) {
+                sel[k] = x[u * s];
+                k += q[u];
+            }
+        });
+        std::copy(sel, sel + k, po + first[lo / S]);
+    });
+    return out;
+}
+
+/**
+ * @brief count_nonzero.
+ * @param mask
+ * @return bits set.
+ */
+template <std::size_t N>
+std::size_t
+count_nonzero(const Mask<N>& mask)
+{ return mask.count(); }
+
+/**
+ * @brief count_nonzero.
+ * @param t
+ * @return elements of t different from zero.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+std::size_t
+count_nonzero(const M& t)
+{
+    using T = Value_type<M>;
+    const auto& d = t.descriptor();
+    TENSOR_TRACE("count_nonzero", t);
+    const auto l = tensor_impl::_make_loop(d);
+    const std::size_t s = l.inner_stride(0), n = l.inner();
+    std::atomic<std::size_t> total{0};
+    tensor_impl::_parallel_for(l.runs(), std::max<std::size_t>(tensor_impl::_parallel_grain / std::max<std::size_t>(n, 1), 1),
+                  [&](std::size_t b, std::size_t e) {
+        std::size_t c = 0;
+        tensor_impl::_for_each_run(l, b, e, [&](std::size_t m, const T* p) {
+            /// Byte counters, flushed before they can wrap.
+            for (std::size_t k = 0; k < m; k += 255 * 64) {
+                std::uint8_t acc[64] = {};
+                const std::size_t h = std::min(m - k, std::size_t(255 * 64));
+                std::size_t u = 0;
+                if (s == 1)
+                    for (; u + 64 <= h; u += 64)
+                        for (std::size_t v = 0; v < 64; ++v)
+                            acc[v] += std::uint8_t(p[k + u + v] != T(0));
+                for (; u < h; ++u)
+                    c += p[(k + u) * s] != T(0);
+                for (std::size_t v = 0; v < 64; ++v)
+                    c += acc[v];
+            }
+        }, t.data() + d.start);
+        total += c;
+    });
+    return total;
+}
+
+NUM_END
+
+#endif // MASK_H
@@ -2,11 +2,17 @@
 #define OPERANDS_H
 
 #include <numeric>
+#include <utility>
 #include <cassert>
 
 #include "tensor_f_decl.h"
 #include "tensor_base.h"
+#include "iteration.h"
+#include "gemm.h"
+#include "storage.h"
+#include "reduction.h"
 #include "support.h"
+#include "trace.h"
 #include "traits.h"
 
 #include "../macros.h"
@@ -26,8 +32,14 @@ inline
 bool
 operator==(const T& x, const T& y)
 {
-    assert(x.descriptor().extents == y.descriptor().extents);
-    return std::equal(x.cbegin(), x.cend(), y.cbegin());
+    TENSOR_TRACE("operator==", x, y);
+    const auto& dx = x.descriptor();
+    const auto& dy = y.descriptor();
+    assert(dx.extents == dy.extents);
+    return tensor_impl::_all_of(tensor_impl::_make_loop(dx, dy),
+                                [](const typename T::value_type& a,
+                                   const typename T::value_type& b) { return a == b; },
+                                x.data() + dx.start, y.data() + dy.start);
 }
 
 /**
@@ -47,6 +59,10 @@ operator!=(const T& x, const T& y)
 }
 
 /// ------------------------------- SUM AND SUB WISE --------------------------------- ///
+///
+/// Every operator has overloads taking an expiring Tensor&&: the
+/// result is computed in its buffer and moved out, so a chain like
+/// f(x) + g(y) - h(z) allocates only for the first temporary.
 
 /**
  * @brief operator +.
@@ -56,15 +72,66 @@ operator!=(const T& x, const T& y)
 */
 template <typename T,
           typename = Enable_if<_tensor_type<T>()>>
-Tensor<typename T::value_type, T::order>
+Tensor<Value_type<T>, T::order>
 operator+ (const T& a,
            const T& b)
 {
-    Tensor<typename T::value_type, T::order> result(a);
+    TENSOR_TRACE("operator+", a, b);
+    Tensor<Value_type<T>, T::order> result(a);
     result += b;
     return result;
 }
 
+/**
+ * @brief operator +. Reuse the buffer of a.
+ * @param a
+ * @param b
+ * @return a
+ */
+template <typename T, std::size_t N, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<T, N>
+operator+ (Tensor<T, N>&& a,
+           const M& b)
+{
+    TENSOR_TRACE("operator+", a, b);
+    a += b;
+    return std::move(a);
+}
+
+/**
+ * @brief operator +. Reuse the buffer of b.
+ * @param a
+ * @param b
+ * @return b
+ */
+template <typename T, std::size_t N, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<T, N>
+operator+ (const M& a,
+           Tensor<T, N>&& b)
+{
+    TENSOR_TRACE("operator+", a, b);
+    b.apply([](T& y, const typename M::value_type& x) { y = x + y; }, a);
+    return std::move(b);
+}
+
+/**
+ * @brief operator +. Reuse the buffer of a.
+ * @param a
+ * @param b
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator+ (Tensor<T, N>&& a,
+           Tensor<T, N>&& b)
+{
+    TENSOR_TRACE("operator+", a, b);
+    a += b;
+    return std::move(a);
+}
+
 /**
  * @brief operator -.
  * @param a
@@ -73,34 +140,275 @@ operator+ (const T& a,
  */
 template <typename T,
           typename = Enable_if<_tensor_type<T>()>>
-T
+Tensor<Value_type<T>, T::order>
 operator- (const T& a,
            const T& b)
 {
-    T result = a;
+    TENSOR_TRACE("operator-", a, b);
+    Tensor<Value_type<T>, T::order> result(a);
     result -= b;
     return result;
 }
 
+/**
+ * @brief operator -. Reuse the buffer of a.
+ * @param a
+ * @param b
+ * @return a
+ */
+template <typename T, std::size_t N, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<T, N>
+operator- (Tensor<T, N>&& a,
+           const M& b)
+{
+    TENSOR_TRACE("operator-", a, b);
+    a -= b;
+    return std::move(a);
+}
+
+/**
+ * @brief operator -. Reuse the buffer of b.
+ * @param a
+ * @param b
+ * @return b
+ */
+template <typename T, std::size_t N, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<T, N>
+operator- (const M& a,
+           Tensor<T, N>&& b)
+{
+    TENSOR_TRACE("operator-", a, b);
+    b.apply([](T& y, const typename M::value_type& x) { y = x - y; }, a);
+    return std::move(b);
+}
+
+/**
+ * @brief operator -. Reuse the buffer of a.
+ * @param a
+ * @param b
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator- (Tensor<T, N>&& a,
+           Tensor<T, N>&& b)
+{
+    TENSOR_TRACE("operator-", a, b);
+    a -= b;
+    return std::move(a);
+}
+
+/**
+ * @brief operator -. Unary minus.
+ * @param a
+ * @return a new Tensor
+ */
+template <typename T,
+          typename = Enable_if<_tensor_type<T>()>>
+Tensor<Value_type<T>, T::order>
+operator- (const T& a)
+{
+    TENSOR_TRACE("operator-", a);
+    Tensor<Value_type<T>, T::order> result(a);
+    result.apply([](Value_type<T>& x) { x = -x; });
+    return result;
+}
+
+/**
+ * @brief operator -. Unary minus, reuse the buffer of a.
+ * @param a
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator- (Tensor<T, N>&& a)
+{
+    TENSOR_TRACE("operator-", a);
+    a.apply([](T& x) { x = -x; });
+    return std::move(a);
+}
+
+/// ------------------------------------- SCALAR ------------------------------------- ///
+
+/**
+ * @brief operator +. Tensor + scalar.
+ * @param a
+ * @param s
+ * @return a new Tensor
+ */
+template <typename T,
+          typename = Enable_if<_tensor_type<T>()>>
+Tensor<Value_type<T>, T::order>
+operator+ (const T& a,
+           const Value_type<T>& s)
+{
+    TENSOR_TRACE("operator+", a);
+    Tensor<Value_type<T>, T::order> result(a);
+    result += s;
+    return result;
+}
+
+/**
+ * @brief operator +. Tensor + scalar, reuse the buffer of a.
+ * @param a
+ * @param s
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator+ (Tensor<T, N>&& a,
+           const T& s)
+{
+    TENSOR_TRACE("operator+", a);
+    a += s;
+    return std::move(a);
+}
+
+/**
+ * @brief operator -. Tensor - scalar.
+ * @param a
+ * @param s
+ * @return a new Tensor
+ */
+template <typename T,
+          typename = Enable_if<_tensor_type<T>()>>
+Tensor<Value_type<T>, T::order>
+operator- (const T& a,
+           const Value_type<T>& s)
+{
+    TENSOR_TRACE("operator-", a);
+    Tensor<Value_type<T>, T::order> result(a);
+    result -= s;
+    return result;
+}
+
+/**
+ * @brief operator -. Tensor - scalar, reuse the buffer of a.
+ * @param a
+ * @param s
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator- (Tensor<T, N>&& a,
+           const T& s)
+{
+    TENSOR_TRACE("operator-", a);
+    a -= s;
+    return std::move(a);
+}
+
+/**
+ * @brief operator *. Tensor * scalar.
+ * @param a
+ * @param s
+ * @return a new Tensor
+ */
+template <typename T,
+          typename = Enable_if<_tensor_type<T>()>>
+Tensor<Value_type<T>, T::order>
+operator* (const T& a,
+           const Value_type<T>& s)
+{
+    TENSOR_TRACE("operator*", a);
+    Tensor<Value_type<T>, T::order> result(a);
+    result *= s;
+    return result;
+}
+
+/**
+ * @brief operator *. Tensor * scalar, reuse the buffer of a.
+ * @param a
+ * @param s
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator* (Tensor<T, N>&& a,
+           const T& s)
+{
+    TENSOR_TRACE("operator*", a);
+    a *= s;
+    return std::move(a);
+}
+
+/**
+ * @brief operator *. scalar * Tensor.
+ * @param s
+ * @param a
+ * @return a new Tensor
+ */
+template <typename T,
+          typename = Enable_if<_tensor_type<T>()>>
+Tensor<Value_type<T>, T::order>
+operator* (const Value_type<T>& s,
+           const T& a)
+{ return a * s; }
+
+/**
+ * @brief operator *. scalar * Tensor, reuse the buffer of a.
+ * @param s
+ * @param a
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator* (const T& s,
+           Tensor<T, N>&& a)
+{ return std::move(a) * s; }
+
+/**
+ * @brief operator /. Tensor / scalar.
+ * @param a
+ * @param s
+ * @return a new Tensor
+ */
+template <typename T,
+          typename = Enable_if<_tensor_type<T>()>>
+Tensor<Value_type<T>, T::order>
+operator/ (const T& a,
+           const Value_type<T>& s)
+{
+    TENSOR_TRACE("operator/", a);
+    Tensor<Value_type<T>, T::order> result(a);
+    result /= s;
+    return result;
+}
+
+/**
+ * @brief operator /. Tensor / scalar, reuse the buffer of a.
+ * @param a
+ * @param s
+ * @return a
+ */
+template <typename T, std::size_t N>
+Tensor<T, N>
+operator/ (Tensor<T, N>&& a,
+           const T& s)
+{
+    TENSOR_TRACE("operator/", a);
+    a /= s;
+    return std::move(a);
+}
+
 /// ------------------------------------- PRODUCT ------------------------------------ ///
 
 /**
- * @brief operator *. Vec x Vec
+ * @brief operator *. Vec x Vec. Accumulates in value_type,
+ *        use dot<Acc> to pick a wider accumulator.
  * @param a
  * @param b
  * @return value_type of the Tensor
  */
 template <typename T1, typename T2,
           typename = Enable_if<(_1d<T1>() && _1d<T2>())>>
-typename T1::value_type
+typename std::remove_const<typename T1::value_type>::type
 operator* (const T1& a,
            const T2& b)
 {
-    assert(a.size() == b.size());
-    return std::inner_product(a.cbegin(),
-                              a.cend(),
-                              b.cbegin(),
-                              typename T1::value_type{0});
+    return dot<typename std::remove_const<typename T1::value_type>::type>(a, b);
 }
 
 /**
@@ -111,14 +419,15 @@ operator* (const T1& a,
  */
 template <typename T1, typename T2,
           typename = Enable_if<(_1d<T1>() && _2d<T2>())>>
-Tensor<typename T1::value_type, 1>
+Tensor<Value_type<T1>, 1>
 operator* (const T1& a,
            const T2& b)
 {
+    TENSOR_TRACE("operator*", a, b);
     assert(a.size() == b.rows());
     auto c = b.cols();
 
-    Tensor<typename T1::value_type, 1> result(c);
+    Tensor<Value_type<T1>, 1> result(c);
 
     for (std::size_t i = 0; i < c; ++i)
         result(i) = a * b.col(i);
@@ -127,27 +436,36 @@ operator* (const T1& a,
 }
 
 /**
- * @brief operator *. Mat x Mat
+ * @brief operator *. Mat x Mat, by the blocked gemm for
+ *        arithmetic types.
  * @param a
  * @param b
  * @return Vec
  */
 template <typename T1, typename T2,
           typename = Enable_if<(_2d<T1>() && _2d<T2>())>>
-Tensor<typename T1::value_type, 2>
+Tensor<Value_type<T1>, 2>
 operator* (const T1& a,
            const T2& b)
 {
+    TENSOR_TRACE("operator*", a, b);
     assert(a.cols() == b.rows());
     auto r = a.rows(), c = b.cols();
 
-    Tensor<typename T1::value_type, 2> result(r, c);
+    using T = Value_type<T1>;
+    if constexpr (std::is_arithmetic<T>::value && std::is_same<T, Value_type<T2>>::value) {
+        Tensor<T, 2> result(uninitialized, r, c);
+        gemm(result, a, b);
+        return result;
+    } else {
+        Tensor<T, 2> result(r, c);
 
-    for (std::size_t i = 0; i < r; ++i)
-        for (std::size_t j = 0; j < c; ++j)
-            result(i, j) = a.row(i) * b.col(j);
+        for (std::size_t i = 0; i < r; ++i)
+            for (std::size_t j = 0; j < c; ++j)
+                result(i, j) = a.row(i) * b.col(j);
 
-    return result;
+        return result;
+    }
 }
 
 NUM_END
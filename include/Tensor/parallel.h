@@ -0,0 +1,228 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <atomic>
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Thread_pool class. Workers shared by all the
+ *        kernels of the library. The number of threads is
+ *        hardware_concurrency(), or TENSOR_NUM_THREADS if
+ *        it is set.
+ */
+class Thread_pool {
+public:
+
+    /**
+     * @brief Thread_pool ctor.
+     * @param n number of threads, the caller included.
+     */
+    explicit Thread_pool(std::size_t n)
+        : _threads{std::max<std::size_t>(n, 1)}
+    {
+        for (std::size_t i = 1; i < _threads; ++i)
+            _workers.emplace_back([this] { _work(); });
+    }
+
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    ~Thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        for (auto& w : _workers)
+            w.join();
+    }
+
+    /**
+     * @brief instance. The pool used by the library.
+     * @return reference to the pool.
+     */
+    static Thread_pool&
+    instance()
+    {
+        static Thread_pool pool(_default_threads());
+        return pool;
+    }
+
+    /**
+     * @brief size.
+     * @return number of threads, the caller included.
+     */
+    std::size_t
+    size() const
+    { return _threads; }
+
+    /**
+     * @brief in_worker. Check if the calling thread is a
+     *        worker of a pool.
+     * @return true if it is, false otherwise.
+     */
+    static bool
+    in_worker()
+    { return _is_worker(); }
+
+    /**
+     * @brief submit. Queue a task.
+     * @param task
+     */
+    void
+    submit(std::function<void()> task)
+    {
+        if (_threads == 1) {
+            task();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push_back(std::move(task));
+        }
+        _cv.notify_one();
+    }
+
+    /**
+     * @brief parallel_for. Split [0, n) in chunks of at
+     *        least grain elements and call f(begin, end) on
+     *        each of them. Chunks are claimed one by one by
+     *        the caller and the workers that are free, so the
+     *        caller goes on alone when every worker is busy
+     *        (e.g. with an async task); it returns when all of
+     *        them are done. Nested calls from a worker run
+     *        serially. If f throws, the first exception is
+     *        rethrown to the caller once every chunk is over.
+     * @param n
+     * @param grain
+     * @param f
+     */
+    template <typename F>
+    void
+    parallel_for(std::size_t n, std::size_t grain, F f)
+    {
+        grain = std::max<std::size_t>(grain, 1);
+        std::size_t chunks = std::min(_threads, (n + grain - 1) / grain);
+        if (chunks <= 1 || _is_worker()) {
+            if (n > 0)
+                f(std::size_t{0}, n);
+            return;
+        }
+
+        /// Shared with the queued helpers, which may start
+        /// after the caller returned: they find no chunk left
+        /// and never touch f.
+        struct Shared {
+            std::atomic<std::size_t> next{0};
+            std::size_t finished = 0;
+            std::exception_ptr error;
+            std::mutex m;
+            std::condition_variable done;
+        };
+        auto s = std::make_shared<Shared>();
+        auto work = [s, n, chunks, pf = &f] {
+            for (std::size_t c; (c = s->next.fetch_add(1)) < chunks;) {
+                std::exception_ptr e;
+                try {
+                    (*pf)(n * c / chunks, n * (c + 1) / chunks);
+                } catch (...) {
+                    e = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(s->m);
+                if (e && !s->error)
+                    s->error = e;
+                if (++s->finished == chunks)
+                    s->done.notify_one();
+            }
+        };
+        for (std::size_t c = 1; c < chunks; ++c)
+            submit(work);
+
+        work();
+        std::unique_lock<std::mutex> lock(s->m);
+        s->done.wait(lock, [&] { return s->finished == chunks; });
+        if (s->error)
+            std::rethrow_exception(s->error);
+    }
+
+private:
+
+    static std::size_t
+    _default_threads()
+    {
+        if (const char* env = std::getenv("TENSOR_NUM_THREADS"))
+            if (std::size_t n = std::strtoul(env, nullptr, 10))
+                return n;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    static bool&
+    _is_worker()
+    {
+        thread_local bool worker = false;
+        return worker;
+    }
+
+    void
+    _work()
+    {
+        _is_worker() = true;
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _stop || !_tasks.empty(); });
+                if (_stop && _tasks.empty())
+                    return;
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::size_t _threads;
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+};
+
+namespace tensor_impl {
+
+/// Elements below which kernels do not go parallel.
+constexpr std::size_t _parallel_grain = std::size_t{1} << 16;
+
+/**
+ * @brief _parallel_for. parallel_for on the library pool.
+ * @param n
+ * @param grain
+ * @param f
+ */
+template <typename F>
+void
+_parallel_for(std::size_t n, std::size_t grain, F f)
+{ Thread_pool::instance().parallel_for(n, grain, f); }
+
+};
+
+NUM_END
+
+#endif // PARALLEL_H
@@ -0,0 +1,389 @@
+#ifndef QUANTIZED_H
+#define QUANTIZED_H
+
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "tensor.h"
+#include "copy.h"
+#include "parallel.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Quant_axis enum. Which dimension of a matrix
+ *        owns a scale and a zero point.
+ */
+enum class Quant_axis { rows, cols };
+
+/**
+ * @brief The Quant_scheme enum. Symmetric maps [-max|x|, max|x|]
+ *        with a zero point of 0, asymmetric maps [min, max].
+ */
+enum class Quant_scheme { symmetric, asymmetric };
+
+/**
+ * @brief The Quantized_mat struct. An int8 matrix with one
+ *        scale and zero point for every row (or column):
+ *        x = scale * (q - zero_point).
+ *        Values are kept in [-127, 127] so the SIMD kernels
+ *        never saturate. quantize lays each row (or column)
+ *        out contiguously: a matrix quantized by cols is
+ *        column-major, ready to be the right operand of
+ *        qgemm.
+ */
+struct Quantized_mat {
+
+    std::size_t
+    rows() const
+    { return values.rows(); }
+
+    std::size_t
+    cols() const
+    { return values.cols(); }
+
+    /// Quantized values.
+    Tensor<std::int8_t, 2> values;
+
+    /// One scale for each row (or column).
+    Tensor<float, 1> scales;
+
+    /// One zero point for each row (or column).
+    Tensor<std::int32_t, 1> zero_points;
+
+    /// Dimension the parameters refer to.
+    Quant_axis axis;
+
+    /// Sum of the quantized values of each row (or column),
+    /// filled by quantize; qgemm computes it when empty.
+    Tensor<std::int32_t, 1> sums;
+};
+
+namespace tensor_impl {
+
+/// Bytes of b that qgemm keeps in cache while rows of a go by.
+constexpr std::size_t _qgemm_block_bytes = std::size_t{1} << 17;
+
+/**
+ * @brief _quant_params. Compute scale and zero point of a
+ *        range of values.
+ * @param lo
+ * @param hi
+ * @param scheme
+ * @param scale
+ * @param zp
+ */
+inline void
+_quant_params(float lo, float hi, Quant_scheme scheme,
+              float& scale, std::int32_t& zp)
+{
+    lo = std::min(lo, 0.0f);
+    hi = std::max(hi, 0.0f);
+    if (scheme == Quant_scheme::symmetric) {
+        scale = std::max(-lo, hi) / 127.0f;
+        zp = 0;
+    } else {
+        scale = (hi - lo) / 254.0f;
+        zp = scale > 0 ? std::int32_t(std::lround(-127.0f - lo / scale)) : 0;
+        zp = std::max(-127, std::min(127, zp));
+    }
+    if (scale == 0)
+        scale = 1;
+}
+
+/**
+ * @brief _quantize. Quantize a single value; NaN maps to
+ *        the zero point.
+ * @param x
+ * @param scale
+ * @param zp
+ * @return int8 value in [-127, 127].
+ */
+inline std::int8_t
+_quantize(float x, float scale, std::int32_t zp)
+{
+    if (std::isnan(x))
+        return std::int8_t(zp);
+    long q = std::lround(x / scale) + zp;
+    return std::int8_t(std::max(-127L, std::min(127L, q)));
+}
+
+/**
+ * @brief _dot_i8. Dot product of two int8 arrays with int32
+ *        accumulation. Values must be in [-127, 127].
+ * @param a
+ * @param b
+ * @param n
+ * @return the dot product.
+ */
+inline std::int32_t
+_dot_i8(const std::int8_t* a, const std::int8_t* b, std::size_t n)
+{
+    std::size_t i = 0;
+    std::int32_t res = 0;
+#if defined(__AVX2__)
+    /// u8 x s8 instructions: move the sign of a on b.
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i ua = _mm256_sign_epi8(va, va);
+        __m256i sb = _mm256_sign_epi8(vb, va);
+#if defined(__AVXVNNI__)
+        acc = _mm256_dpbusd_avx_epi32(acc, ua, sb);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+        acc = _mm256_dpbusd_epi32(acc, ua, sb);
+#else
+        __m256i p = _mm256_maddubs_epi16(ua, sb);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(p, _mm256_set1_epi16(1)));
+#endif
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                              _mm256_extracti128_si256(acc, 1));
+    s = _mm_hadd_epi32(s, s);
+    s = _mm_hadd_epi32(s, s);
+    res = _mm_cvtsi128_si32(s);
+#endif
+    for (; i < n; ++i)
+        res += std::int32_t(a[i]) * std::int32_t(b[i]);
+    return res;
+}
+
+/**
+ * @brief _quant_lines. The rows (or columns if cols) of
+ *        values, each one contiguous and ld elements apart:
+ *        values itself when its layout does, else a copy
+ *        in tmp.
+ * @param values
+ * @param cols
+ * @param tmp
+ * @param ld
+ * @return a pointer to the first line.
+ */
+inline const std::int8_t*
+_quant_lines(const Tensor<std::int8_t, 2>& values, bool cols,
+             Tensor<std::int8_t, 2>& tmp, std::size_t& ld)
+{
+    const auto& d = values.descriptor();
+    const std::size_t along = cols ? 0 : 1, across = 1 - along;
+    if (d.strides[along] == 1 || d.extents[along] == 1) {
+        ld = d.strides[across];
+        return values.data() + d.start;
+    }
+    tmp = cols ? Tensor<std::int8_t, 2>(uninitialized, Tensor_slice<2>(col_major, d.extents))
+               : Tensor<std::int8_t, 2>(uninitialized, d.extents);
+    _copy(values.data(), d, tmp.data(), tmp.descriptor());
+    ld = d.extents[along];
+    return std::as_const(tmp).data();
+}
+
+/**
+ * @brief _quant_sums. Sums of the n lines of len values at
+ *        p (ld apart): q.sums when quantize filled it, else
+ *        computed in tmp.
+ */
+inline const std::int32_t*
+_quant_sums(const Quantized_mat& q, const std::int8_t* p, std::size_t ld,
+            std::size_t n, std::size_t len, Tensor<std::int32_t, 1>& tmp)
+{
+    if (q.sums.size() == n)
+        return q.sums.data();
+    tmp = Tensor<std::int32_t, 1>(uninitialized, n);
+    std::int32_t* s = tmp.data();
+    _parallel_for(n, std::max<std::size_t>(_parallel_grain / std::max<std::size_t>(len, 1), 1),
+                  [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+            std::int32_t acc = 0;
+            for (std::size_t k = 0; k < len; ++k)
+                acc += p[i * ld + k];
+            s[i] = acc;
+        }
+    });
+    return s;
+}
+
+};
+
+/**
+ * @brief quantize. Quantize a matrix (Tensor or Tensor_ref of
+ *        any layout, values converted to float) to int8 with
+ *        a scale and a zero point for each row (or column).
+ *        NaN is quantized to the zero point. Lines are split
+ *        across the thread pool.
+ * @param m
+ * @param axis
+ * @param scheme
+ * @return Quantized_mat, row-major if axis is rows,
+ *         column-major if it is cols.
+ */
+template <typename M,
+          typename = Enable_if<(_tensor_type<M>() && M::order == 2)>>
+Quantized_mat
+quantize(const M& m,
+         Quant_axis axis = Quant_axis::rows,
+         Quant_scheme scheme = Quant_scheme::symmetric)
+{
+    const auto& d = m.descriptor();
+    const std::size_t r = d.extents[0], c = d.extents[1];
+    const bool rows = axis == Quant_axis::rows;
+    const std::size_t n = rows ? r : c, len = rows ? c : r;
+    Quantized_mat q{rows ? Tensor<std::int8_t, 2>(uninitialized, r, c)
+                         : Tensor<std::int8_t, 2>(uninitialized,
+                                                  Tensor_slice<2>(col_major, r, c)),
+                    Tensor<float, 1>(uninitialized, n),
+                    Tensor<std::int32_t, 1>(uninitialized, n),
+                    axis,
+                    Tensor<std::int32_t, 1>(uninitialized, n)};
+
+    const auto* x = m.data() + d.start;
+    const std::size_t sl = d.strides[rows ? 0 : 1], se = d.strides[rows ? 1 : 0];
+    std::int8_t* v = q.values.data();
+    float* scales = q.scales.data();
+    std::int32_t* zps = q.zero_points.data();
+    std::int32_t* sums = q.sums.data();
+    tensor_impl::_parallel_for(n, std::max<std::size_t>(tensor_impl::_parallel_grain /
+                                                        std::max<std::size_t>(len, 1), 1),
+                               [&](std::size_t b, std::size_t e) {
+        for (std::size_t p = b; p < e; ++p) {
+            const auto* xp = x + p * sl;
+            float lo = 0, hi = 0;
+            for (std::size_t k = 0; k < len; ++k) {
+                const float y = float(xp[k * se]);
+                lo = std::min(lo, y);
+                hi = std::max(hi, y);
+            }
+            tensor_impl::_quant_params(lo, hi, scheme, scales[p], zps[p]);
+            std::int32_t acc = 0;
+            for (std::size_t k = 0; k < len; ++k) {
+                const std::int8_t y = tensor_impl::_quantize(float(xp[k * se]),
+                                                             scales[p], zps[p]);
+                v[p * len + k] = y;
+                acc += y;
+            }
+            sums[p] = acc;
+        }
+    });
+    return q;
+}
+
+/**
+ * @brief dequantize. Rebuild a float matrix, rows split
+ *        across the thread pool.
+ * @param q
+ * @return Tensor<float, 2>.
+ */
+inline Tensor<float, 2>
+dequantize(const Quantized_mat& q)
+{
+    const auto& d = q.values.descriptor();
+    const std::size_t r = q.rows(), c = q.cols();
+    const bool rows = q.axis == Quant_axis::rows;
+    Tensor<float, 2> result(uninitialized, r, c);
+    const std::int8_t* v = q.values.data() + d.start;
+    float* out = result.data();
+    tensor_impl::_parallel_for(r, std::max<std::size_t>(tensor_impl::_parallel_grain /
+                                                        std::max<std::size_t>(c, 1), 1),
+                               [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i)
+            for (std::size_t j = 0; j < c; ++j) {
+                const std::size_t p = rows ? i : j;
+                out[i * c + j] = q.scales(p) *
+                        float(std::int32_t(v[i * d.strides[0] + j * d.strides[1]]) -
+                              q.zero_points(p));
+            }
+    });
+    return result;
+}
+
+/**
+ * @brief qgemm. Integer product of quantized matrices:
+ *        sum_k (a_ik - za_i) * (b_kj - zb_j), with int32
+ *        accumulation. a must be quantized by rows and b
+ *        by cols; as quantize lays them out, every output
+ *        is a flat dot of two contiguous lines (other
+ *        layouts are copied first). Rows of a are split
+ *        across the thread pool, and go by tiles of columns
+ *        of b that stay in cache.
+ * @param a
+ * @param b
+ * @return Tensor<int32_t, 2>.
+ */
+inline Tensor<std::int32_t, 2>
+qgemm(const Quantized_mat& a, const Quantized_mat& b)
+{
+    assert(a.cols() == b.rows());
+    assert(a.axis == Quant_axis::rows && b.axis == Quant_axis::cols);
+    const std::size_t r = a.rows(), k = a.cols(), c = b.cols();
+
+    Tensor<std::int8_t, 2> ta, tb;
+    Tensor<std::int32_t, 1> tsa, tsb;
+    std::size_t lda = 0, ldb = 0;
+    const std::int8_t* pa = tensor_impl::_quant_lines(a.values, false, ta, lda);
+    const std::int8_t* pb = tensor_impl::_quant_lines(b.values, true, tb, ldb);
+    const std::int32_t* sa = tensor_impl::_quant_sums(a, pa, lda, r, k, tsa);
+    const std::int32_t* sb = tensor_impl::_quant_sums(b, pb, ldb, c, k, tsb);
+
+    Tensor<std::int32_t, 2> result(uninitialized, r, c);
+    std::int32_t* out = result.data();
+    const std::size_t tile = std::max<std::size_t>(
+                tensor_impl::_qgemm_block_bytes / std::max<std::size_t>(k, 1), 1);
+    tensor_impl::_parallel_for(r, std::max<std::size_t>(tensor_impl::_parallel_grain /
+                                                        std::max<std::size_t>(k * c, 1), 1),
+                               [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t j0 = 0; j0 < c; j0 += tile)
+            for (std::size_t i = lo; i < hi; ++i) {
+                const std::int8_t* ra = pa + i * lda;
+                const std::int32_t za = a.zero_points(i);
+                for (std::size_t j = j0; j < std::min(c, j0 + tile); ++j) {
+                    const std::int32_t zb = b.zero_points(j);
+                    out[i * c + j] = tensor_impl::_dot_i8(ra, pb + j * ldb, k)
+                            - zb * sa[i] - za * sb[j]
+                            + std::int32_t(k) * za * zb;
+                }
+            }
+    });
+    return result;
+}
+
+/**
+ * @brief operator *. Quantized Mat x Quantized Mat, with the
+ *        int32 result scaled back to float.
+ * @param a
+ * @param b
+ * @return Tensor<float, 2>.
+ */
+inline Tensor<float, 2>
+operator* (const Quantized_mat& a,
+           const Quantized_mat& b)
+{
+    auto acc = qgemm(a, b);
+    const std::size_t r = acc.rows(), c = acc.cols();
+
+    Tensor<float, 2> result(uninitialized, r, c);
+    const std::int32_t* x = std::as_const(acc).data();
+    float* out = result.data();
+    tensor_impl::_parallel_for(r, std::max<std::size_t>(tensor_impl::_parallel_grain /
+                                                        std::max<std::size_t>(c, 1), 1),
+                               [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i)
+            for (std::size_t j = 0; j < c; ++j)
+                out[i * c + j] = float(x[i * c + j]) * a.scales(i) * b.scales(j);
+    });
+    return result;
+}
+
+NUM_END
+
+#endif // QUANTIZED_H
@@ -0,0 +1,341 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <iostream>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+#include "tensor.h"
+#include "parallel.h"
+#include "traits.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Philox class. Philox4x32-10 counter-based
+ *        generator (Salmon et al., "Parallel random numbers:
+ *        as easy as 1, 2, 3"): a block of four 32 bit words
+ *        is a pure function of (seed, stream, counter), so
+ *        any element can be drawn on any thread.
+ */
+class Philox {
+public:
+
+    using block_type = std::array<std::uint32_t, 4>;
+
+    /**
+     * @brief Philox ctor.
+     * @param seed the key.
+     * @param stream independent sequences for the same seed.
+     */
+    explicit Philox(std::uint64_t seed = 0, std::uint32_t stream = 0)
+        : _k0{std::uint32_t(seed)},
+          _k1{std::uint32_t(seed >> 32)},
+          _stream{stream}
+    {}
+
+    /**
+     * @brief operator (). Block number counter.
+     * @param counter
+     * @return four random words.
+     */
+    block_type
+    operator() (std::uint64_t counter) const
+    {
+        std::uint32_t w[4][1];
+        blocks<1>(counter, w);
+        return {w[0][0], w[1][0], w[2][0], w[3][0]};
+    }
+
+    /**
+     * @brief blocks. L consecutive blocks from counter, word
+     *        j of block l in w[j][l]; the rounds run across
+     *        the L blocks and are vectorized.
+     * @param counter
+     * @param w
+     */
+    template <std::size_t L>
+    void
+    blocks(std::uint64_t counter, std::uint32_t (&w)[4][L]) const
+    {
+        std::uint32_t x0[L], x1[L], x2[L], x3[L];
+        for (std::size_t l = 0; l < L; ++l) {
+            x0[l] = std::uint32_t(counter + l);
+            x1[l] = std::uint32_t((counter + l) >> 32);
+            x2[l] = _stream;
+            x3[l] = 0;
+        }
+        std::uint32_t k0 = _k0, k1 = _k1;
+        for (std::size_t r = 0; r < 10; ++r) {
+            for (std::size_t l = 0; l < L; ++l) {
+                const std::uint64_t p0 = std::uint64_t(0xD2511F53u) * x0[l];
+                const std::uint64_t p1 = std::uint64_t(0xCD9E8D57u) * x2[l];
+                const std::uint32_t y0 = std::uint32_t(p1 >> 32) ^ x1[l] ^ k0;
+                const std::uint32_t y2 = std::uint32_t(p0 >> 32) ^ x3[l] ^ k1;
+                x1[l] = std::uint32_t(p1);
+                x3[l] = std::uint32_t(p0);
+                x0[l] = y0;
+                x2[l] = y2;
+            }
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        for (std::size_t l = 0; l < L; ++l) {
+            w[0][l] = x0[l];
+            w[1][l] = x1[l];
+            w[2][l] = x2[l];
+            w[3][l] = x3[l];
+        }
+    }
+
+private:
+    std::uint32_t _k0;
+    std::uint32_t _k1;
+    std::uint32_t _stream;
+};
+
+namespace tensor_impl {
+
+/// Philox blocks drawn together.
+constexpr std::size_t _philox_lanes = 16;
+
+/// Uniform in [0, 1) from 24 (float) or 53 (double) bits.
+inline float
+_unit24(std::uint32_t w)
+{ return float(w >> 8) * (1.0f / 16777216.0f); }
+
+inline double
+_unit53(std::uint32_t a, std::uint32_t b)
+{ return double((std::uint64_t(a) << 21) ^ (b >> 11)) * (1.0 / 9007199254740992.0); }
+
+/**
+ * @brief The _Uniform struct. Four floats or two doubles
+ *        per block, in [lo, hi): values that round up to hi
+ *        are taken down to top, the one below it.
+ */
+template <typename T>
+struct _Uniform {
+    static constexpr std::size_t per_block = sizeof(T) <= 4 ? 4 : 2;
+
+    template <std::size_t L>
+    void
+    operator() (const std::uint32_t (&w)[4][L], T* out) const
+    {
+        if constexpr (per_block == 4)
+            for (std::size_t j = 0; j < 4; ++j)
+                for (std::size_t l = 0; l < L; ++l) {
+                    const T v = lo + T(_unit24(w[j][l])) * (hi - lo);
+                    out[j * L + l] = v != hi ? v : top;
+                }
+        else
+            for (std::size_t j = 0; j < 2; ++j)
+                for (std::size_t l = 0; l < L; ++l) {
+                    const T v = lo + T(_unit53(w[2 * j][l], w[2 * j + 1][l])) * (hi - lo);
+                    out[j * L + l] = v != hi ? v : top;
+                }
+    }
+
+    T lo;
+    T hi;
+    T top;
+};
+
+/**
+ * @brief The _Normal struct. Box-Muller on pairs of
+ *        uniforms: four floats or two doubles per block.
+ */
+template <typename T>
+struct _Normal {
+    static constexpr std::size_t per_block = sizeof(T) <= 4 ? 4 : 2;
+
+    template <std::size_t L>
+    void
+    operator() (const std::uint32_t (&w)[4][L], T* out) const
+    {
+        using R = std::conditional_t<per_block == 4, float, double>;
+        const R two_pi = R(6.283185307179586);
+        for (std::size_t j = 0; j < per_block; j += 2)
+            for (std::size_t l = 0; l < L; ++l) {
+                R u1, u2;
+                if constexpr (per_block == 4) {
+                    u1 = R(1) - _unit24(w[j][l]);
+                    u2 = _unit24(w[j + 1][l]);
+                } else {
+                    u1 = R(1) - _unit53(w[0][l], w[1][l]);
+                    u2 = _unit53(w[2][l], w[3][l]);
+                }
+                const R r = std::sqrt(R(-2) * std::log(u1));
+                out[j * L + l] = mean + stddev * T(r * std::cos(two_pi * u2));
+                out[(j + 1) * L + l] = mean + stddev * T(r * std::sin(two_pi * u2));
+            }
+    }
+
+    T mean;
+    T stddev;
+};
+
+/**
+ * @brief The _Bernoulli struct. One when a word is below
+ *        p * 2^32, four per block.
+ */
+template <typename T>
+struct _Bernoulli {
+    static constexpr std::size_t per_block = 4;
+
+    template <std::size_t L>
+    void
+    operator() (const std::uint32_t (&w)[4][L], T* out) const
+    {
+        for (std::size_t j = 0; j < 4; ++j)
+            for (std::size_t l = 0; l < L; ++l)
+                out[j * L + l] = w[j][l] < threshold ? T(1) : T(0);
+    }
+
+    std::uint64_t threshold;
+};
+
+/**
+ * @brief _random_fill. Values are drawn by batches of L
+ *        blocks, K values per block, word by word (value
+ *        j * L + l of a batch comes from word j of block l),
+ *        and element of logical (row-major) index i gets
+ *        value i % (L * K) of batch i / (L * K): the result
+ *        depends neither on the layout nor on the number of
+ *        threads. The logical range is split across the pool;
+ *        each part scatters the values it owns.
+ * @param t
+ * @param g
+ * @param dist
+ */
+template <typename M, typename Dist>
+void
+_random_fill(M& t, const Philox& g, const Dist& dist)
+{
+    using T = Value_type<M>;
+    constexpr std::size_t N = M::order;
+    constexpr std::size_t K = Dist::per_block;
+    constexpr std::size_t L = _philox_lanes;
+
+    const auto& d = t.descriptor();
+    if (d.size == 0)
+        return;
+    T* base = t.data() + d.start;
+    const std::size_t inner = d.extents[N - 1];
+    const std::size_t s = d.strides[N - 1];
+
+    _parallel_for(d.size, _parallel_grain, [&](std::size_t b, std::size_t e) {
+        std::uint32_t w[4][L];
+        T vals[L * K];
+        std::size_t batch = std::size_t(-1);
+
+        std::size_t i = b;
+        while (i < e) {
+            /// Start of the row of i.
+            std::size_t r = i / inner, j = i % inner;
+            T* p = base;
+            for (std::size_t k = N - 1; k-- > 0;) {
+                p += (r % d.extents[k]) * d.strides[k];
+                r /= d.extents[k];
+            }
+            const std::size_t end = std::min(e, i - j + inner);
+            while (i < end) {
+                const std::size_t bt = i / (L * K);
+                if (bt != batch) {
+                    batch = bt;
+                    g.blocks<L>(bt * L, w);
+                    dist(w, vals);
+                }
+                const std::size_t o = i - bt * L * K;
+                const std::size_t n = std::min(end - i, L * K - o);
+                T* q = p + j * s;
+                if (s == 1)
+                    std::copy(vals + o, vals + o + n, q);
+                else
+                    for (std::size_t k = 0; k < n; ++k)
+                        q[k * s] = vals[o + k];
+                i += n;
+                j += n;
+            }
+        }
+    });
+}
+
+};
+
+/**
+ * @brief fill_uniform. Uniform values in [lo, hi), drawn
+ *        by element (logical index) from g.
+ * @param t tensor or view.
+ * @param g
+ * @param lo
+ * @param hi
+ * @return t.
+ */
+template <typename M,
+          typename T = Value_type<std::remove_reference_t<M>>,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<M>>()>>
+M&&
+fill_uniform(M&& t, const Philox& g, T lo = T(0), T hi = T(1))
+{
+    static_assert (std::is_floating_point<T>::value,
+                   "fill_uniform: floating point types only");
+    TENSOR_TRACE("fill_uniform", t);
+    tensor_impl::_random_fill(t, g, tensor_impl::_Uniform<T>{lo, hi, std::nextafter(hi, lo)});
+    return std::forward<M>(t);
+}
+
+/**
+ * @brief fill_normal. Normal values of mean and stddev,
+ *        drawn by element (logical index) from g.
+ * @param t tensor or view.
+ * @param g
+ * @param mean
+ * @param stddev
+ * @return t.
+ */
+template <typename M,
+          typename T = Value_type<std::remove_reference_t<M>>,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<M>>()>>
+M&&
+fill_normal(M&& t, const Philox& g, T mean = T(0), T stddev = T(1))
+{
+    static_assert (std::is_floating_point<T>::value,
+                   "fill_normal: floating point types only");
+    TENSOR_TRACE("fill_normal", t);
+    tensor_impl::_random_fill(t, g, tensor_impl::_Normal<T>{mean, stddev});
+    return std::forward<M>(t);
+}
+
+/**
+ * @brief fill_bernoulli. Ones with probability p, zeros
+ *        otherwise, drawn by element (logical index) from g.
+ * @param t tensor or view.
+ * @param g
+ * @param p
+ * @return t.
+ */
+template <typename M,
+          typename T = Value_type<std::remove_reference_t<M>>,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<M>>()>>
+M&&
+fill_bernoulli(M&& t, const Philox& g, double p = 0.5)
+{
+    static_assert (std::is_arithmetic<T>::value,
+                   "fill_bernoulli: arithmetic types only");
+    TENSOR_TRACE("fill_bernoulli", t);
+    const double q = std::min(std::max(p, 0.0), 1.0);
+    tensor_impl::_random_fill(t, g, tensor_impl::_Bernoulli<T>{
+                                  std::uint64_t(std::ldexp(q, 32))});
+    return std::forward<M>(t);
+}
+
+NUM_END
+
+#endif // RANDOM_H
@@ -0,0 +1,277 @@
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include <iostream>
+#include <cassert>
+
+#include "tensor_f_decl.h"
+#include "tensor.h"
+#include "iteration.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Summation enum. How the terms of a reduction
+ *        are added:
+ *        naive    = one pass over independent lanes.
+ *        kahan    = compensated lanes, error independent of n.
+ *        pairwise = blocks combined as a binary tree,
+ *                   error growing as log(n).
+ */
+enum class Summation { naive, kahan, pairwise };
+
+namespace tensor_impl {
+
+/// Independent accumulators, so the loops can vectorize.
+constexpr std::size_t _lanes = 8;
+
+/// Terms summed in a leaf of the pairwise tree.
+constexpr std::size_t _pairwise_block = 128;
+
+/**
+ * @brief _sum_lanes. Naive sum of n terms over _lanes
+ *        accumulators.
+ * @param n
+ * @param term
+ * @return the sum.
+ */
+template <typename Acc, typename F>
+Acc
+_sum_lanes(std::size_t n, F term)
+{
+    Acc acc[_lanes] = {};
+    std::size_t i = 0;
+    for (; i + _lanes <= n; i += _lanes)
+        for (std::size_t l = 0; l < _lanes; ++l)
+            acc[l] += term(i + l);
+    for (; i < n; ++i)
+        acc[0] += term(i);
+
+    for (std::size_t w = _lanes / 2; w > 0; w /= 2)
+        for (std::size_t l = 0; l < w; ++l)
+            acc[l] += acc[l + w];
+    return acc[0];
+}
+
+/**
+ * @brief _sum_kahan. Compensated sum of n terms over _lanes
+ *        accumulators. Every lane keeps its own compensation,
+ *        lanes are merged with the same scheme.
+ * @param n
+ * @param term
+ * @return the sum.
+ */
+template <typename Acc, typename F>
+Acc
+_sum_kahan(std::size_t n, F term)
+{
+    Acc s[_lanes] = {}, c[_lanes] = {};
+    std::size_t i = 0;
+    for (; i + _lanes <= n; i += _lanes) {
+        Acc x[_lanes];
+        for (std::size_t l = 0; l < _lanes; ++l)
+            x[l] = term(i + l);
+        for (std::size_t l = 0; l < _lanes; ++l) {
+            Acc y = x[l] - c[l];
+            Acc t = s[l] + y;
+            c[l] = (t - s[l]) - y;
+            s[l] = t;
+        }
+    }
+
+    Acc sum = s[0], comp = c[0];
+    auto add = [&](Acc x) {
+        Acc y = x - comp;
+        Acc t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    };
+    for (std::size_t l = 1; l < _lanes; ++l)
+        add(s[l]), add(-c[l]);
+    for (; i < n; ++i)
+        add(term(i));
+    return sum;
+}
+
+/**
+ * @brief _sum_pairwise. Pairwise sum of n terms. Leaves of
+ *        _pairwise_block terms use the lane sum, then leaves
+ *        are merged as in a binary counter, so only
+ *        log(n) partial sums are alive at any time.
+ * @param n
+ * @param term
+ * @return the sum.
+ */
+template <typename Acc, typename F>
+Acc
+_sum_pairwise(std::size_t n, F term)
+{
+    Acc stack[64];
+    std::size_t top = 0;
+
+    std::size_t b = 0;
+    for (std::size_t leaf = 0; b < n; ++leaf, b += _pairwise_block) {
+        std::size_t m = std::min(_pairwise_block, n - b);
+        stack[top++] = _sum_lanes<Acc>(m, [&](std::size_t i) { return term(b + i); });
+        for (std::size_t k = leaf; k & 1; k >>= 1) {
+            --top;
+            stack[top - 1] += stack[top];
+        }
+    }
+
+    Acc sum{0};
+    while (top > 0)
+        sum += stack[--top];
+    return sum;
+}
+
+/**
+ * @brief _reduce. Sum n terms with the requested scheme.
+ * @param n
+ * @param term
+ * @param s
+ * @return the sum.
+ */
+template <typename Acc, typename F>
+Acc
+_reduce(std::size_t n, F term, Summation s)
+{
+    switch (s) {
+    case Summation::kahan:
+        return _sum_kahan<Acc>(n, term);
+    case Summation::pairwise:
+        return _sum_pairwise<Acc>(n, term);
+    default:
+        return _sum_lanes<Acc>(n, term);
+    }
+}
+
+/**
+ * @brief _dot. Dot product of two strided arrays.
+ * @param a
+ * @param sa
+ * @param b
+ * @param sb
+ * @param n
+ * @param s
+ * @return the dot product in Acc.
+ */
+template <typename Acc, typename U, typename V>
+Acc
+_dot(const U* a, std::size_t sa, const V* b, std::size_t sb,
+     std::size_t n, Summation s)
+{
+    if (sa == 1 && sb == 1)
+        return _reduce<Acc>(n, [&](std::size_t i)
+                            { return Acc(a[i]) * Acc(b[i]); }, s);
+    return _reduce<Acc>(n, [&](std::size_t i)
+                        { return Acc(a[i * sa]) * Acc(b[i * sb]); }, s);
+}
+
+/**
+ * @brief _sum. Sum of all elements of a 1-dimensional tensor.
+ * @param t
+ * @param s
+ * @return the sum in Acc.
+ */
+template <typename Acc, typename M>
+Enable_if<_is_1d<M>(), Acc>
+_sum(const M& t, Summation s)
+{
+    auto p = t.data() + t.descriptor().start;
+    auto st = t.descriptor().strides[0];
+    if (st == 1)
+        return _reduce<Acc>(t.size(), [&](std::size_t i) { return Acc(p[i]); }, s);
+    return _reduce<Acc>(t.size(), [&](std::size_t i) { return Acc(p[i * st]); }, s);
+}
+
+/**
+ * @brief _sum. Sum of all elements of a tensor: a single
+ *        pass if its dimensions collapse to one run, slice
+ *        by slice otherwise.
+ * @param t
+ * @param s
+ * @return the sum in Acc.
+ */
+template <typename Acc, typename M>
+Enable_if<!_is_1d<M>(), Acc>
+_sum(const M& t, Summation s)
+{
+    auto l = _make_loop(t.descriptor());
+    if (l.rank == 1) {
+        auto p = t.data() + t.descriptor().start;
+        auto st = l.inner_stride(0);
+        return _reduce<Acc>(t.size(), [&](std::size_t i) { return Acc(p[i * st]); }, s);
+    }
+    return _reduce<Acc>(t.extent(0), [&](std::size_t i)
+                        { return _sum<Acc>(t.template slice<0>(i), s); }, s);
+}
+
+};
+
+/**
+ * @brief dot. Vec x Vec with a selectable accumulator,
+ *        e.g. dot<double>(float_vec, float_vec) or
+ *        dot<std::int32_t>(int16_vec, int16_vec).
+ * @param a
+ * @param b
+ * @param s
+ * @return Acc
+ */
+template <typename Acc, typename T1, typename T2,
+          typename = Enable_if<(_1d<T1>() && _1d<T2>())>>
+Acc
+dot(const T1& a, const T2& b, Summation s = Summation::naive)
+{
+    assert(a.size() == b.size());
+    const auto& da = a.descriptor();
+    const auto& db = b.descriptor();
+    return tensor_impl::_dot<Acc>(a.data() + da.start, da.strides[0],
+                                  b.data() + db.start, db.strides[0],
+                                  a.size(), s);
+}
+
+/**
+ * @brief gemv. Mat x Vec with a selectable accumulator.
+ * @param m
+ * @param x
+ * @param s
+ * @return Tensor<Acc, 1> with m.rows() elements.
+ */
+template <typename Acc, typename T1, typename T2,
+          typename = Enable_if<(_2d<T1>() && _1d<T2>())>>
+Tensor<Acc, 1>
+gemv(const T1& m, const T2& x, Summation s = Summation::naive)
+{
+    assert(m.cols() == x.size());
+    const auto& dm = m.descriptor();
+    const auto& dx = x.descriptor();
+
+    Tensor<Acc, 1> result(m.rows());
+    for (std::size_t i = 0; i < m.rows(); ++i)
+        result(i) = tensor_impl::_dot<Acc>(m.data() + dm.start + i * dm.strides[0],
+                                           dm.strides[1],
+                                           x.data() + dx.start, dx.strides[0],
+                                           m.cols(), s);
+    return result;
+}
+
+/**
+ * @brief sum. Sum of all elements with a selectable accumulator.
+ * @param t
+ * @param s
+ * @return Acc
+ */
+template <typename Acc, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Acc
+sum(const M& t, Summation s = Summation::naive)
+{ return tensor_impl::_sum<Acc>(t, s); }
+
+NUM_END
+
+#endif // REDUCTION_H
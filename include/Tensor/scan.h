@@ -0,0 +1,360 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <iostream>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor.h"
+#include "iteration.h"
+#include "parallel.h"
+#include "support.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/// Inclusive: out[k] = x[0] op ... op x[k].
+/// Exclusive: out[k] = init op x[0] op ... op x[k - 1].
+enum class Scan {
+    inclusive,
+    exclusive
+};
+
+namespace tensor_impl {
+
+/// Lanes scanned together when the axis is strided.
+constexpr std::size_t _scan_lanes_block = 256;
+
+/// Elements per chunk of a long line: lines of at least two
+/// chunks are split, whatever the number of threads.
+constexpr std::size_t _parallel_scan_length = std::size_t{1} << 16;
+
+/// Most chunks a long line is split into.
+constexpr std::size_t _scan_long_chunks = 64;
+
+/**
+ * @brief _scan_line. Serial scan of L elements, starting
+ *        from init.
+ * @param out
+ * @param so
+ * @param in
+ * @param si
+ * @param L
+ * @param op
+ * @param init
+ * @param mode
+ */
+template <typename T, typename U, typename Op>
+void
+_scan_line(T* out, std::size_t so, const U* in, std::size_t si,
+           std::size_t L, Op& op, T init, Scan mode)
+{
+    T acc = init;
+    if (mode == Scan::inclusive)
+        for (std::size_t k = 0; k < L; ++k) {
+            acc = op(acc, T(in[k * si]));
+            out[k * so] = acc;
+        }
+    else
+        for (std::size_t k = 0; k < L; ++k) {
+            T x = T(in[k * si]);
+            out[k * so] = acc;
+            acc = op(acc, x);
+        }
+}
+
+/**
+ * @brief _scan_long. Work-efficient parallel scan of one
+ *        long line: every chunk is reduced, the chunk totals
+ *        are scanned, then every chunk is scanned from its
+ *        carry. Two passes, O(L) operations. The chunks only
+ *        depend on L, so floating point results are the same
+ *        for any number of threads (nested calls from a
+ *        worker run the chunks serially).
+ *        op must be associative and init its identity.
+ */
+template <typename T, typename U, typename Op>
+void
+_scan_long(T* out, std::size_t so, const U* in, std::size_t si,
+           std::size_t L, Op& op, T init, Scan mode)
+{
+    const std::size_t chunks = std::min(_scan_long_chunks,
+                                        L / _parallel_scan_length);
+    if (chunks <= 1) {
+        _scan_line(out, so, in, si, L, op, init, mode);
+        return;
+    }
+
+    auto lo = [&](std::size_t c) { return L * c / chunks; };
+    std::vector<T> carry(chunks, init);
+    _parallel_for(chunks, 1, [&](std::size_t b, std::size_t e) {
+        for (std::size_t c = b; c < e; ++c) {
+            T acc = init;
+            for (std::size_t k = lo(c); k < lo(c + 1); ++k)
+                acc = op(acc, T(in[k * si]));
+            carry[c] = acc;
+        }
+    });
+
+    T acc = init;
+    for (std::size_t c = 0; c < chunks; ++c) {
+        T total = carry[c];
+        carry[c] = acc;
+        acc = op(acc, total);
+    }
+
+    _parallel_for(chunks, 1, [&](std::size_t b, std::size_t e) {
+        for (std::size_t c = b; c < e; ++c)
+            _scan_line(out + lo(c) * so, so, in + lo(c) * si, si,
+                       lo(c + 1) - lo(c), op, carry[c], mode);
+    });
+}
+
+/**
+ * @brief _scan_lanes. Scan w independent lines at once,
+ *        stepping along the axis: the inner loop runs across
+ *        the lanes, so unit stride lanes are vectorized.
+ * @param out
+ * @param so axis stride of out.
+ * @param lo lane stride of out.
+ * @param in
+ * @param si axis stride of in.
+ * @param li lane stride of in.
+ * @param w number of lanes (<= _scan_lanes_block).
+ * @param L
+ * @param op
+ * @param init
+ * @param mode
+ */
+template <typename T, typename U, typename Op>
+void
+_scan_lanes(T* out, std::size_t so, std::size_t lo,
+            const U* in, std::size_t si, std::size_t li,
+            std::size_t w, std::size_t L, Op& op, T init, Scan mode)
+{
+    T acc[_scan_lanes_block];
+    std::fill(acc, acc + w, init);
+    const bool unit = lo == 1 && li == 1;
+    for (std::size_t k = 0; k < L; ++k) {
+        T* y = out + k * so;
+        const U* x = in + k * si;
+        if (unit && mode == Scan::inclusive)
+            for (std::size_t j = 0; j < w; ++j) {
+                acc[j] = op(acc[j], T(x[j]));
+                y[j] = acc[j];
+            }
+        else if (unit)
+            for (std::size_t j = 0; j < w; ++j) {
+                T v = T(x[j]);
+                y[j] = acc[j];
+                acc[j] = op(acc[j], v);
+            }
+        else if (mode == Scan::inclusive)
+            for (std::size_t j = 0; j < w; ++j) {
+                acc[j] = op(acc[j], T(x[j * li]));
+                y[j * lo] = acc[j];
+            }
+        else
+            for (std::size_t j = 0; j < w; ++j) {
+                T v = T(x[j * li]);
+                y[j * lo] = acc[j];
+                acc[j] = op(acc[j], v);
+            }
+    }
+}
+
+/**
+ * @brief _scan. Scan every line along dimension D of in
+ *        into out (same extents, any layout). Lines whose
+ *        axis is unit stride are scanned one by one (long
+ *        ones with _scan_long); otherwise neighbouring lines
+ *        are scanned together by _scan_lanes. Lines are
+ *        split across the thread pool.
+ */
+template <std::size_t D, typename T, typename U, std::size_t N, typename Op>
+void
+_scan(T* out, const Tensor_slice<N>& od, const U* in, const Tensor_slice<N>& id,
+      Op& op, T init, Scan mode)
+{
+    static_assert (D < N, "_scan: D must be lower than N");
+    assert(od.extents == id.extents);
+    const std::size_t L = id.extents[D];
+    const std::size_t so = od.strides[D], si = id.strides[D];
+    if (L == 0 || id.size == 0)
+        return;
+
+    const auto l = _make_line_loop<D>(od, id);
+    const std::size_t lso = l.inner_stride(0), lsi = l.inner_stride(1);
+    T* po = out + od.start;
+    const U* pi = in + id.start;
+
+    /// Strided axis: neighbouring lines are scanned together.
+    if (si != 1 && l.inner() > 1) {
+        _parallel_for_lines(l, _scan_lanes_block, L,
+                            [&](std::size_t n, T* y, const U* x) {
+            _scan_lanes(y, so, lso, x, si, lsi, n, L, op, init, mode);
+        }, po, pi);
+        return;
+    }
+
+    /// Long lines are always chunked, so results do not
+    /// depend on the pool: a few of them are parallelized
+    /// inside, many of them are split across the pool.
+    if (L >= 2 * _parallel_scan_length) {
+        if (l.runs() * l.inner() < Thread_pool::instance().size())
+            _for_each_run(l, [&](std::size_t n, T* y, const U* x) {
+                for (std::size_t j = 0; j < n; ++j)
+                    _scan_long(y + j * lso, so, x + j * lsi, si, L, op, init, mode);
+            }, po, pi);
+        else
+            _parallel_for_lines(l, 1, L, [&](std::size_t, T* y, const U* x) {
+                _scan_long(y, so, x, si, L, op, init, mode);
+            }, po, pi);
+        return;
+    }
+
+    _parallel_for_lines(l, 1, L, [&](std::size_t, T* y, const U* x) {
+        _scan_line(y, so, x, si, L, op, init, mode);
+    }, po, pi);
+}
+
+};
+
+/**
+ * @brief scan. Prefix scan with op along dimension D of in,
+ *        written into the preallocated out (Tensor or
+ *        Tensor_ref with the same extents, any layout). op
+ *        must be associative and init its identity.
+ * @param out
+ * @param in
+ * @param op
+ * @param init
+ * @param mode
+ * @return out.
+ */
+template <std::size_t D, typename O, typename M, typename Op,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>() &&
+                               _tensor_type<M>()>>
+O&&
+scan(O&& out, const M& in, Op op,
+     Value_type<std::remove_reference_t<O>> init,
+     Scan mode = Scan::inclusive)
+{
+    const auto& od = out.descriptor();
+    const auto& id = in.descriptor();
+    tensor_impl::_scan<D>(out.data(), od, in.data(), id, op, init, mode);
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief cumsum. Cumulative sum along D into out.
+ * @param out
+ * @param in
+ * @param mode
+ * @return out.
+ */
+template <std::size_t D, typename O, typename M,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>() &&
+                               _tensor_type<M>()>>
+O&&
+cumsum(O&& out, const M& in, Scan mode = Scan::inclusive)
+{
+    using T = Value_type<std::remove_reference_t<O>>;
+    return scan<D>(std::forward<O>(out), in, std::plus<T>{}, T{}, mode);
+}
+
+/**
+ * @brief cumprod. Cumulative product along D into out.
+ * @param out
+ * @param in
+ * @param mode
+ * @return out.
+ */
+template <std::size_t D, typename O, typename M,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>() &&
+                               _tensor_type<M>()>>
+O&&
+cumprod(O&& out, const M& in, Scan mode = Scan::inclusive)
+{
+    using T = Value_type<std::remove_reference_t<O>>;
+    return scan<D>(std::forward<O>(out), in, std::multiplies<T>{}, T(1), mode);
+}
+
+/**
+ * @brief cummax. Cumulative maximum along D into out. The
+ *        exclusive scan starts from numeric_limits::lowest().
+ * @param out
+ * @param in
+ * @param mode
+ * @return out.
+ */
+template <std::size_t D, typename O, typename M,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>() &&
+                               _tensor_type<M>()>>
+O&&
+cummax(O&& out, const M& in, Scan mode = Scan::inclusive)
+{
+    using T = Value_type<std::remove_reference_t<O>>;
+    return scan<D>(std::forward<O>(out), in,
+                   [](const T& a, const T& b) { return a < b ? b : a; },
+                   std::numeric_limits<T>::lowest(), mode);
+}
+
+/**
+ * @brief cumsum. Cumulative sum along D.
+ * @param in
+ * @param mode
+ * @return a new Tensor.
+ */
+template <std::size_t D, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, M::order>
+cumsum(const M& in, Scan mode = Scan::inclusive)
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    cumsum<D>(out, in, mode);
+    return out;
+}
+
+/**
+ * @brief cumprod. Cumulative product along D.
+ * @param in
+ * @param mode
+ * @return a new Tensor.
+ */
+template <std::size_t D, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, M::order>
+cumprod(const M& in, Scan mode = Scan::inclusive)
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    cumprod<D>(out, in, mode);
+    return out;
+}
+
+/**
+ * @brief cummax. Cumulative maximum along D.
+ * @param in
+ * @param mode
+ * @return a new Tensor.
+ */
+template <std::size_t D, typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, M::order>
+cummax(const M& in, Scan mode = Scan::inclusive)
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    cummax<D>(out, in, mode);
+    return out;
+}
+
+NUM_END
+
+#endif // SCAN_H
@@ -0,0 +1,560 @@
+#ifndef SOFTMAX_H
+#define SOFTMAX_H
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor.h"
+#include "iteration.h"
+#include "parallel.h"
+#include "vmath.h"
+#include "traits.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * Fused row kernels along the last dimension of float and
+ * double tensors (and views): softmax, log_softmax,
+ * logsumexp and layer_norm. A row is read once to get its
+ * statistics (running maximum and rescaled sum of
+ * exponentials, or running mean and variance merged block
+ * by block) and written once; softmax keeps the
+ * exponentials of that first read in out and only rescales
+ * them. Rows are split across the thread pool; out may be
+ * in.
+ */
+
+namespace tensor_impl {
+
+/// Accumulators of the block reductions.
+constexpr std::size_t _row_lanes = 8;
+
+/// Block maxima kept on the stack (rows up to 4096 elements).
+constexpr std::size_t _softmax_stack_blocks = 64;
+
+/**
+ * @brief _row_block. Block of n <= _vmath_block elements of
+ *        a row, the others set to pad: unit-stride whole
+ *        blocks are used in place, the others copied to buf.
+ * @return the block.
+ */
+template <typename T>
+const T*
+_row_block(const T* x, std::size_t s, std::size_t n, T pad, T* buf)
+{
+    constexpr std::size_t B = _vmath_block;
+    if (s == 1 && n == B)
+        return x;
+    for (std::size_t i = 0; i < n; ++i)
+        buf[i] = x[i * s];
+    std::fill(buf + n, buf + B, pad);
+    return buf;
+}
+
+/// Maximum of a block (NaNs are skipped).
+template <typename T>
+T
+_block_max(const T* a)
+{
+    constexpr std::size_t B = _vmath_block, W = _row_lanes;
+    T l[W];
+    for (std::size_t j = 0; j < W; ++j)
+        l[j] = a[j];
+    for (std::size_t k = W; k < B; k += W)
+        for (std::size_t j = 0; j < W; ++j)
+            l[j] = a[k + j] > l[j] ? a[k + j] : l[j];
+    T m = l[0];
+    for (std::size_t j = 1; j < W; ++j)
+        m = l[j] > m ? l[j] : m;
+    return m;
+}
+
+/// Sum of a block.
+template <typename T>
+T
+_block_sum(const T* a)
+{
+    constexpr std::size_t B = _vmath_block, W = _row_lanes;
+    T l[W] = {};
+    for (std::size_t k = 0; k < B; k += W)
+        for (std::size_t j = 0; j < W; ++j)
+            l[j] += a[k + j];
+    T s = T(0);
+    for (std::size_t j = 0; j < W; ++j)
+        s += l[j];
+    return s;
+}
+
+/**
+ * @brief _softmax_stats. Online maximum and sum of
+ *        exponentials of a row of L elements (Milakov and
+ *        Gimelshein): each block is shifted by the running
+ *        maximum m, and the sum rescaled when m grows. If e
+ *        is given, the exponentials of block j are stored in
+ *        it and the maximum they were shifted by in refs[j].
+ * @param L
+ * @param x
+ * @param sx
+ * @param e
+ * @param se
+ * @param refs
+ * @return (m, sum of e^(x - m)).
+ */
+template <typename T>
+std::pair<T, double>
+_softmax_stats(std::size_t L, const T* x, std::size_t sx,
+               T* e = nullptr, std::size_t se = 1, T* refs = nullptr)
+{
+    constexpr std::size_t B = _vmath_block;
+    alignas(64) T buf[B];
+    alignas(64) T t[B];
+    alignas(64) T eb[B];
+    const T inf = std::numeric_limits<T>::infinity();
+    T m = -inf;
+    double sum = 0;
+    for (std::size_t k = 0, j = 0; k < L; k += B, ++j) {
+        const std::size_t n = std::min(B, L - k);
+        const T* a = _row_block(x + k * sx, sx, n, -inf, buf);
+        const T bm = _block_max(a);
+        if (bm > m) {
+            sum *= std::exp(double(m) - double(bm));
+            m = bm;
+        }
+        /// Rows that are -inf so far: e^-inf = 0, not NaN.
+        const T sub = m == -inf ? T(0) : m;
+        for (std::size_t i = 0; i < B; ++i)
+            t[i] = a[i] - sub;
+        T* o = e && se == 1 && n == B ? e + k : eb;
+        _exp(t, o);
+        sum += double(_block_sum(o));
+        if (e) {
+            refs[j] = m;
+            if (o == eb)
+                for (std::size_t i = 0; i < n; ++i)
+                    e[(k + i) * se] = eb[i];
+        }
+    }
+    return {m, sum};
+}
+
+/**
+ * @brief _softmax_row. One read of x leaves the shifted
+ *        exponentials in y, which are then scaled by block.
+ */
+template <typename T>
+void
+_softmax_row(std::size_t L, T* y, std::size_t sy, const T* x, std::size_t sx)
+{
+    constexpr std::size_t B = _vmath_block;
+    const std::size_t nb = (L + B - 1) / B;
+    T stack[_softmax_stack_blocks];
+    std::vector<T> heap;
+    T* refs = stack;
+    if (nb > _softmax_stack_blocks) {
+        heap.resize(nb);
+        refs = heap.data();
+    }
+
+    const auto [m, sum] = _softmax_stats(L, x, sx, y, sy, refs);
+    const double inv = 1.0 / sum;
+    for (std::size_t k = 0, j = 0; k < L; k += B, ++j) {
+        const std::size_t n = std::min(B, L - k);
+        const T f = T(std::exp(double(refs[j]) - double(m)) * inv);
+        T* p = y + k * sy;
+        if (sy == 1 && n == B)
+            for (std::size_t i = 0; i < B; ++i)
+                p[i] *= f;
+        else
+            for (std::size_t i = 0; i < n; ++i)
+                p[i * sy] *= f;
+    }
+}
+
+/**
+ * @brief _log_softmax_row. y = (x - m) - log(sum), the
+ *        statistics of one read of x.
+ */
+template <typename T>
+void
+_log_softmax_row(std::size_t L, T* y, std::size_t sy, const T* x, std::size_t sx)
+{
+    constexpr std::size_t B = _vmath_block;
+    const auto [m, sum] = _softmax_stats(L, x, sx);
+    const T ls = T(std::log(sum));
+    for (std::size_t k = 0; k < L; k += B) {
+        const std::size_t n = std::min(B, L - k);
+        T* p = y + k * sy;
+        const T* a = x + k * sx;
+        if (sy == 1 && sx == 1 && n == B)
+            for (std::size_t i = 0; i < B; ++i)
+                p[i] = (a[i] - m) - ls;
+        else
+            for (std::size_t i = 0; i < n; ++i)
+                p[i * sy] = (a[i * sx] - m) - ls;
+    }
+}
+
+/**
+ * @brief _logsumexp_row.
+ * @return log(sum of e^x) of a row, -inf if it is empty.
+ */
+template <typename T>
+T
+_logsumexp_row(std::size_t L, const T* x, std::size_t sx)
+{
+    const auto [m, sum] = _softmax_stats(L, x, sx);
+    if (m == std::numeric_limits<T>::infinity())
+        return m;
+    return T(double(m) + std::log(sum));
+}
+
+/**
+ * @brief _layer_norm_row. Mean and variance of a row by
+ *        blocks (deviations from the block mean, in cache,
+ *        merged with Chan's update), then
+ *        y = (x - mean) / sqrt(var + eps) * g + b; g and b
+ *        are ignored if null.
+ */
+template <typename T>
+void
+_layer_norm_row(std::size_t L, T* y, std::size_t sy, const T* x, std::size_t sx,
+                const T* g, std::size_t sg, const T* b, std::size_t sb, T eps)
+{
+    constexpr std::size_t B = _vmath_block;
+    alignas(64) T bx[B];
+    alignas(64) T bg[B];
+    alignas(64) T bb[B];
+    alignas(64) T by[B];
+    alignas(64) T t[B];
+
+    double mean = 0, m2 = 0;
+    for (std::size_t k = 0; k < L; k += B) {
+        const std::size_t n = std::min(B, L - k);
+        const T* a = _row_block(x + k * sx, sx, n, T(0), bx);
+        const T bm = _block_sum(a) / T(n);
+        /// Padding at the mean adds nothing to the sums.
+        if (a == bx)
+            std::fill(bx + n, bx + B, bm);
+        for (std::size_t i = 0; i < B; ++i)
+            t[i] = a[i] - bm;
+        /// The rounding error of bm, from the deviations.
+        const double dm = double(_block_sum(t)) / double(n);
+        for (std::size_t i = 0; i < B; ++i)
+            t[i] = t[i] * t[i];
+        const double d = double(bm) + dm - mean;
+        const double c = double(k + n);
+        mean += d * double(n) / c;
+        m2 += double(_block_sum(t)) - dm * dm * double(n) + d * d * double(k) * double(n) / c;
+    }
+
+    /// The mean in two parts, so that x - mean is exact.
+    const T mu = T(mean);
+    const T mu_lo = T(mean - double(mu));
+    const T r = T(1.0 / std::sqrt(std::max(m2, 0.0) / double(L) + double(eps)));
+    for (std::size_t k = 0; k < L; k += B) {
+        const std::size_t n = std::min(B, L - k);
+        const T* a = _row_block(x + k * sx, sx, n, T(0), bx);
+        T* o = sy == 1 && n == B ? y + k : by;
+        if (g) {
+            const T* ga = _row_block(g + k * sg, sg, n, T(0), bg);
+            const T* ba = _row_block(b + k * sb, sb, n, T(0), bb);
+            for (std::size_t i = 0; i < B; ++i)
+                o[i] = ((a[i] - mu) - mu_lo) * r * ga[i] + ba[i];
+        } else {
+            for (std::size_t i = 0; i < B; ++i)
+                o[i] = ((a[i] - mu) - mu_lo) * r;
+        }
+        if (o == by)
+            for (std::size_t i = 0; i < n; ++i)
+                y[(k + i) * sy] = by[i];
+    }
+}
+
+/**
+ * @brief _for_each_row. Call f(y, x) on the heads of the
+ *        rows (last dimension) of out and in, rows split
+ *        across the pool.
+ */
+template <typename O, typename M, typename F>
+void
+_for_each_row(O& out, const M& in, F f)
+{
+    using T = Value_type<M>;
+    static_assert (std::is_same<T, float>::value || std::is_same<T, double>::value,
+                   "softmax: float and double only");
+    static_assert (std::is_same<Value_type<O>, T>::value, "softmax: types mismatch");
+    constexpr std::size_t N = M::order;
+    const auto& od = out.descriptor();
+    const auto& id = in.descriptor();
+    assert(od.extents == id.extents);
+    const std::size_t L = id.extents[N - 1];
+    if (id.size == 0)
+        return;
+
+    const auto l = _make_line_loop<N - 1>(od, id);
+    _parallel_for_lines(l, 1, L, [&](std::size_t, T* y, const T* x) {
+        f(y, x);
+    }, out.data() + od.start, in.data() + id.start);
+}
+
+};
+
+/**
+ * @brief softmax. e^x / sum(e^x) along the last dimension,
+ *        written into out (same extents, any layout; may be
+ *        in).
+ * @param out
+ * @param in
+ * @return out.
+ */
+template <typename O, typename M,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() && _tensor_type<M>())>>
+O&&
+softmax(O&& out, const M& in)
+{
+    TENSOR_TRACE("softmax", in, out);
+    const std::size_t L = in.descriptor().extents[M::order - 1];
+    const std::size_t so = out.descriptor().strides[M::order - 1];
+    const std::size_t si = in.descriptor().strides[M::order - 1];
+    tensor_impl::_for_each_row(out, in, [&](auto* y, const auto* x) {
+        tensor_impl::_softmax_row(L, y, so, x, si);
+    });
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief softmax. Along the last dimension.
+ * @param in
+ * @return a new Tensor.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, M::order>
+softmax(const M& in)
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    softmax(out, in);
+    return out;
+}
+
+/**
+ * @brief log_softmax. x - log(sum(e^x)) along the last
+ *        dimension, written into out (may be in).
+ * @param out
+ * @param in
+ * @return out.
+ */
+template <typename O, typename M,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() && _tensor_type<M>())>>
+O&&
+log_softmax(O&& out, const M& in)
+{
+    TENSOR_TRACE("log_softmax", in, out);
+    const std::size_t L = in.descriptor().extents[M::order - 1];
+    const std::size_t so = out.descriptor().strides[M::order - 1];
+    const std::size_t si = in.descriptor().strides[M::order - 1];
+    tensor_impl::_for_each_row(out, in, [&](auto* y, const auto* x) {
+        tensor_impl::_log_softmax_row(L, y, so, x, si);
+    });
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief log_softmax. Along the last dimension.
+ * @param in
+ * @return a new Tensor.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, M::order>
+log_softmax(const M& in)
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    log_softmax(out, in);
+    return out;
+}
+
+/**
+ * @brief logsumexp. log(sum(e^x)) of every row (last
+ *        dimension) of in, written into out, whose extents
+ *        are the ones of in without the last.
+ * @param out
+ * @param in
+ * @return out.
+ */
+template <typename O, typename M,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() && _tensor_type<M>() &&
+                                std::remove_reference_t<O>::order + 1 == M::order)>>
+O&&
+logsumexp(O&& out, const M& in)
+{
+    using T = Value_type<M>;
+    constexpr std::size_t N = M::order;
+    static_assert (std::is_same<T, float>::value || std::is_same<T, double>::value,
+                   "logsumexp: float and double only");
+    static_assert (std::is_same<Value_type<std::remove_reference_t<O>>, T>::value,
+                   "logsumexp: types mismatch");
+    TENSOR_TRACE("logsumexp", in, out);
+    const auto& od = out.descriptor();
+    const auto& id = in.descriptor();
+    const std::size_t L = id.extents[N - 1];
+    const std::size_t si = id.strides[N - 1];
+    Tensor_slice<N - 1> rows;
+    tensor_impl::_slice_dim<N - 1>(0, id, rows);
+    assert(rows.extents == od.extents);
+    if (od.size == 0)
+        return std::forward<O>(out);
+
+    const auto l = tensor_impl::_make_loop(od, rows);
+    tensor_impl::_parallel_for_lines(l, 1, L, [&](std::size_t, T* y, const T* x) {
+        *y = tensor_impl::_logsumexp_row(L, x, si);
+    }, out.data() + od.start, in.data() + id.start);
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief logsumexp. Of every row of in (rank > 1).
+ * @param in
+ * @return a new Tensor of rank one less.
+ */
+template <typename M,
+          typename = Enable_if<(_tensor_type<M>() && (M::order > 1))>>
+Tensor<Value_type<M>, M::order - 1>
+logsumexp(const M& in)
+{
+    Tensor_slice<M::order - 1> rows;
+    tensor_impl::_slice_dim<M::order - 1>(0, in.descriptor(), rows);
+    Tensor<Value_type<M>, M::order - 1> out(uninitialized, rows.extents);
+    logsumexp(out, in);
+    return out;
+}
+
+/**
+ * @brief logsumexp. Of a vector.
+ * @param in
+ * @return log(sum(e^x)).
+ */
+template <typename M,
+          typename = Enable_if<(_tensor_type<M>() && M::order == 1)>,
+          typename = void>
+Value_type<M>
+logsumexp(const M& in)
+{
+    using T = Value_type<M>;
+    static_assert (std::is_same<T, float>::value || std::is_same<T, double>::value,
+                   "logsumexp: float and double only");
+    TENSOR_TRACE("logsumexp", in);
+    const auto& d = in.descriptor();
+    return tensor_impl::_logsumexp_row(d.extents[0], in.data() + d.start, d.strides[0]);
+}
+
+/**
+ * @brief layer_norm. (x - mean) / sqrt(var + eps) along the
+ *        last dimension (biased variance), written into out
+ *        (may be in).
+ * @param out
+ * @param in
+ * @param eps
+ * @return out.
+ */
+template <typename O, typename M,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() && _tensor_type<M>())>>
+O&&
+layer_norm(O&& out, const M& in, Value_type<M> eps = Value_type<M>(1e-5))
+{
+    using T = Value_type<M>;
+    TENSOR_TRACE("layer_norm", in, out);
+    const std::size_t L = in.descriptor().extents[M::order - 1];
+    const std::size_t so = out.descriptor().strides[M::order - 1];
+    const std::size_t si = in.descriptor().strides[M::order - 1];
+    tensor_impl::_for_each_row(out, in, [&](T* y, const T* x) {
+        tensor_impl::_layer_norm_row<T>(L, y, so, x, si, nullptr, 0, nullptr, 0, eps);
+    });
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief layer_norm. With affine parameters:
+ *        (x - mean) / sqrt(var + eps) * gamma + beta along
+ *        the last dimension, gamma and beta vectors of its
+ *        length.
+ * @param out
+ * @param in
+ * @param gamma
+ * @param beta
+ * @param eps
+ * @return out.
+ */
+template <typename O, typename M, typename G, typename Bt,
+          typename = Enable_if<(_tensor_type<std::remove_reference_t<O>>() && _tensor_type<M>() &&
+                                _is_1d<G>() && _is_1d<Bt>())>>
+O&&
+layer_norm(O&& out, const M& in, const G& gamma, const Bt& beta,
+           Value_type<M> eps = Value_type<M>(1e-5))
+{
+    using T = Value_type<M>;
+    static_assert (std::is_same<Value_type<G>, T>::value && std::is_same<Value_type<Bt>, T>::value,
+                   "layer_norm: types mismatch");
+    TENSOR_TRACE("layer_norm", in, out);
+    const std::size_t L = in.descriptor().extents[M::order - 1];
+    const std::size_t so = out.descriptor().strides[M::order - 1];
+    const std::size_t si = in.descriptor().strides[M::order - 1];
+    const auto& gd = gamma.descriptor();
+    const auto& bd = beta.descriptor();
+    assert(gd.extents[0] == L && bd.extents[0] == L);
+    const T* g = gamma.data() + gd.start;
+    const T* b = beta.data() + bd.start;
+    tensor_impl::_for_each_row(out, in, [&](T* y, const T* x) {
+        tensor_impl::_layer_norm_row(L, y, so, x, si, g, gd.strides[0], b, bd.strides[0], eps);
+    });
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief layer_norm. Along the last dimension.
+ * @param in
+ * @param eps
+ * @return a new Tensor.
+ */
+template <typename M,
+          typename = Enable_if<_tensor_type<M>()>>
+Tensor<Value_type<M>, M::order>
+layer_norm(const M& in, Value_type<M> eps = Value_type<M>(1e-5))
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    layer_norm(out, in, eps);
+    return out;
+}
+
+/**
+ * @brief layer_norm. With affine parameters.
+ * @param in
+ * @param gamma
+ * @param beta
+ * @param eps
+ * @return a new Tensor.
+ */
+template <typename M, typename G, typename Bt,
+          typename = Enable_if<(_tensor_type<M>() && _is_1d<G>() && _is_1d<Bt>())>>
+Tensor<Value_type<M>, M::order>
+layer_norm(const M& in, const G& gamma, const Bt& beta,
+           Value_type<M> eps = Value_type<M>(1e-5))
+{
+    Tensor<Value_type<M>, M::order> out(uninitialized, in.descriptor().extents);
+    layer_norm(out, in, gamma, beta, eps);
+    return out;
+}
+
+NUM_END
+
+#endif // SOFTMAX_H
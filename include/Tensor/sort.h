@@ -0,0 +1,450 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <type_traits>
+#include <cassert>
+
+#include "tensor.h"
+#include "iteration.h"
+#include "parallel.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+namespace tensor_impl {
+
+/// Longest line sorted by a network.
+constexpr std::size_t _sort_network_max = 32;
+
+/// Lines sorted together by a network.
+constexpr std::size_t _sort_lanes = 64;
+
+/// Elements handled by a task when lines are short.
+constexpr std::size_t _sort_block = 4096;
+
+/**
+ * @brief _network_order. Direction of the comparator when
+ *        a sorting network can replace it.
+ * @return 1 (ascending), -1 (descending), 0 (no network).
+ */
+template <typename T, typename Comp>
+constexpr int
+_network_order()
+{
+    if constexpr (!std::is_arithmetic<T>::value)
+        return 0;
+    else if constexpr (std::is_same<Comp, std::less<T>>::value ||
+                       std::is_same<Comp, std::less<>>::value)
+        return 1;
+    else if constexpr (std::is_same<Comp, std::greater<T>>::value ||
+                       std::is_same<Comp, std::greater<>>::value)
+        return -1;
+    else
+        return 0;
+}
+
+/**
+ * @brief _sort_network. Compare-exchange pairs of Batcher's
+ *        odd-even merge sort of p elements (p power of two,
+ *        at most _sort_network_max).
+ * @param p
+ * @return list of (i, j), i < j.
+ */
+inline const std::vector<std::pair<std::uint8_t, std::uint8_t>>&
+_sort_network(std::size_t p)
+{
+    using Network = std::vector<std::pair<std::uint8_t, std::uint8_t>>;
+    static const auto nets = [] {
+        std::array<Network, 6> r;
+        for (std::size_t q = 0; q < r.size(); ++q) {
+            const std::size_t n = std::size_t{1} << q;
+            for (std::size_t s = 1; s < n; s <<= 1)
+                for (std::size_t k = s; k >= 1; k >>= 1)
+                    for (std::size_t j = k % s; j + k < n; j += 2 * k)
+                        for (std::size_t i = 0; i < std::min(k, n - j - k); ++i)
+                            if ((i + j) / (2 * s) == (i + j + k) / (2 * s))
+                                r[q].emplace_back(i + j, i + j + k);
+        }
+        return r;
+    }();
+
+    std::size_t q = 0;
+    while ((std::size_t{1} << q) < p)
+        ++q;
+    assert(q < nets.size());
+    return nets[q];
+}
+
+/**
+ * @brief _sort_lanes_network. Sort n <= _sort_lanes lines of
+ *        L <= _sort_network_max elements with a branchless
+ *        network: lines are transposed into a buffer, so each
+ *        compare-exchange is a min/max across all the lanes.
+ * @param p head of the first line.
+ * @param s stride along the lines.
+ * @param lane stride between lines.
+ * @param n
+ * @param L
+ * @param order 1 ascending, -1 descending.
+ */
+template <typename T>
+void
+_sort_lanes_network(T* p, std::size_t s, std::size_t lane,
+                    std::size_t n, std::size_t L, int order)
+{
+    std::size_t P = 1;
+    while (P < L)
+        P <<= 1;
+
+    /// Padding goes after every element in both directions.
+    const T pad = order > 0
+            ? (std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                                    : std::numeric_limits<T>::max())
+            : (std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                    : std::numeric_limits<T>::lowest());
+
+    T buf[_sort_network_max][_sort_lanes];
+    for (std::size_t k = 0; k < P; ++k)
+        std::fill(buf[k], buf[k] + _sort_lanes, pad);
+    for (std::size_t k = 0; k < L; ++k)
+        for (std::size_t j = 0; j < n; ++j)
+            buf[k][j] = p[k * s + j * lane];
+
+    for (const auto& [a, b] : _sort_network(P)) {
+        T* __restrict x = buf[a];
+        T* __restrict y = buf[b];
+        if (order > 0)
+            for (std::size_t j = 0; j < _sort_lanes; ++j) {
+                T lo = y[j] < x[j] ? y[j] : x[j];
+                T hi = y[j] < x[j] ? x[j] : y[j];
+                x[j] = lo;
+                y[j] = hi;
+            }
+        else
+            for (std::size_t j = 0; j < _sort_lanes; ++j) {
+                T lo = y[j] < x[j] ? y[j] : x[j];
+                T hi = y[j] < x[j] ? x[j] : y[j];
+                x[j] = hi;
+                y[j] = lo;
+            }
+    }
+
+    for (std::size_t k = 0; k < L; ++k)
+        for (std::size_t j = 0; j < n; ++j)
+            p[k * s + j * lane] = buf[k][j];
+}
+
+/**
+ * @brief _sort_line. Sort one line in place; strided lines
+ *        are sorted in buf.
+ * @param p
+ * @param s
+ * @param L
+ * @param comp
+ * @param buf
+ */
+template <typename T, typename Comp>
+void
+_sort_line(T* p, std::size_t s, std::size_t L, Comp& comp, std::vector<T>& buf)
+{
+    if (s == 1) {
+        std::sort(p, p + L, comp);
+        return;
+    }
+    buf.resize(L);
+    for (std::size_t k = 0; k < L; ++k)
+        buf[k] = std::move(p[k * s]);
+    std::sort(buf.begin(), buf.end(), comp);
+    for (std::size_t k = 0; k < L; ++k)
+        p[k * s] = std::move(buf[k]);
+}
+
+/**
+ * @brief _ranked. Strict order on (value, index) pairs:
+ *        by comp on the values, then by index, so equal
+ *        values keep their original order.
+ */
+template <typename T, typename Comp>
+struct _ranked {
+
+    bool
+    operator()(const std::pair<T, std::size_t>& a,
+               const std::pair<T, std::size_t>& b) const
+    {
+        if (comp(a.first, b.first))
+            return true;
+        if (comp(b.first, a.first))
+            return false;
+        return a.second < b.second;
+    }
+
+    Comp& comp;
+};
+
+/**
+ * @brief _topk_line. The k first elements of a line of L
+ *        in the order of comp, written best first. For
+ *        small k a heap of the k best is kept while reading
+ *        the line, so most elements cost one comparison
+ *        with the worst of them; otherwise the line is
+ *        partitioned with nth_element.
+ * @param v values out.
+ * @param sv
+ * @param ix indices out.
+ * @param sx
+ * @param in
+ * @param si
+ * @param L
+ * @param k
+ * @param comp
+ * @param buf
+ */
+template <typename V, typename I, typename U, typename Comp>
+void
+_topk_line(V* v, std::size_t sv, I* ix, std::size_t sx,
+           const U* in, std::size_t si, std::size_t L, std::size_t k,
+           Comp& comp, std::vector<std::pair<U, std::size_t>>& buf)
+{
+    _ranked<U, Comp> ranked{comp};
+    buf.clear();
+    if (8 * k <= L) {
+        for (std::size_t i = 0; i < k; ++i)
+            buf.emplace_back(in[i * si], i);
+        std::make_heap(buf.begin(), buf.end(), ranked);
+        for (std::size_t i = k; i < L; ++i) {
+            const U& x = in[i * si];
+            if (comp(x, buf.front().first)) {
+                std::pop_heap(buf.begin(), buf.end(), ranked);
+                buf.back() = {x, i};
+                std::push_heap(buf.begin(), buf.end(), ranked);
+            }
+        }
+        std::sort_heap(buf.begin(), buf.end(), ranked);
+    } else {
+        for (std::size_t i = 0; i < L; ++i)
+            buf.emplace_back(in[i * si], i);
+        std::nth_element(buf.begin(), buf.begin() + k, buf.end(), ranked);
+        std::sort(buf.begin(), buf.begin() + k, ranked);
+    }
+
+    for (std::size_t i = 0; i < k; ++i) {
+        v[i * sv] = V(buf[i].first);
+        ix[i * sx] = I(buf[i].second);
+    }
+}
+
+/**
+ * @brief _argsort_line. Indexes sorting a line of L, ties
+ *        in original order.
+ * @param ix
+ * @param sx
+ * @param in
+ * @param si
+ * @param L
+ * @param comp
+ * @param buf
+ */
+template <typename I, typename U, typename Comp>
+void
+_argsort_line(I* ix, std::size_t sx, const U* in, std::size_t si, std::size_t L,
+              Comp& comp, std::vector<std::pair<U, std::size_t>>& buf)
+{
+    buf.clear();
+    for (std::size_t i = 0; i < L; ++i)
+        buf.emplace_back(in[i * si], i);
+    std::sort(buf.begin(), buf.end(), _ranked<U, Comp>{comp});
+    for (std::size_t i = 0; i < L; ++i)
+        ix[i * sx] = I(buf[i].second);
+}
+
+/// Lines handled by a task of the generic kernels.
+inline std::size_t
+_sort_lines_per_task(std::size_t L)
+{ return std::max<std::size_t>(_sort_block / std::max<std::size_t>(L, 1), 1); }
+
+};
+
+/**
+ * @brief sort. Sort in place every line along dimension D of
+ *        t (Tensor or Tensor_ref, any layout). Short lines
+ *        with std::less or std::greater are sorted by networks
+ *        across many lines at once; lines are split across
+ *        the thread pool.
+ * @param t
+ * @param comp strict weak order.
+ * @return t.
+ */
+template <std::size_t D, typename M,
+          typename Comp = std::less<Value_type<std::remove_reference_t<M>>>,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<M>>()>>
+M&&
+sort(M&& t, Comp comp = Comp{})
+{
+    using T = Value_type<std::remove_reference_t<M>>;
+    const auto& d = t.descriptor();
+    const std::size_t L = d.extents[D], s = d.strides[D];
+    if (L < 2 || d.size == 0)
+        return std::forward<M>(t);
+
+    const auto l = tensor_impl::_make_line_loop<D>(d);
+    T* p = t.data() + d.start;
+
+    constexpr int order = tensor_impl::_network_order<T, Comp>();
+    if constexpr (order != 0)
+        if (L <= tensor_impl::_sort_network_max) {
+            tensor_impl::_parallel_for_lines(l, tensor_impl::_sort_lanes, L * L,
+                                             [&](std::size_t n, T* q) {
+                tensor_impl::_sort_lanes_network(q, s, l.inner_stride(0), n, L, order);
+            }, p);
+            return std::forward<M>(t);
+        }
+
+    const std::size_t w = tensor_impl::_sort_lines_per_task(L);
+    tensor_impl::_parallel_for_lines(l, w, L, [&](std::size_t n, T* q) {
+        std::vector<T> buf;
+        for (std::size_t j = 0; j < n; ++j)
+            tensor_impl::_sort_line(q + j * l.inner_stride(0), s, L, comp, buf);
+    }, p);
+    return std::forward<M>(t);
+}
+
+/**
+ * @brief argsort. Write into out, along dimension D, the
+ *        indexes that sort every line of in; equal elements
+ *        keep their order.
+ * @param out integer Tensor or Tensor_ref, extents of in.
+ * @param in
+ * @param comp strict weak order.
+ * @return out.
+ */
+template <std::size_t D, typename O, typename M,
+          typename Comp = std::less<Value_type<M>>,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<O>>() &&
+                               _tensor_type<M>()>>
+O&&
+argsort(O&& out, const M& in, Comp comp = Comp{})
+{
+    using I = Value_type<std::remove_reference_t<O>>;
+    using U = Value_type<M>;
+    static_assert (std::is_integral<I>::value, "argsort: indexes must be integers");
+
+    const auto& od = out.descriptor();
+    const auto& id = in.descriptor();
+    assert(od.extents == id.extents);
+    const std::size_t L = id.extents[D];
+    if (L == 0 || id.size == 0)
+        return std::forward<O>(out);
+
+    const auto l = tensor_impl::_make_line_loop<D>(od, id);
+    const std::size_t so = od.strides[D], si = id.strides[D];
+    tensor_impl::_parallel_for_lines(l, tensor_impl::_sort_lines_per_task(L), L,
+                                     [&](std::size_t n, I* x, const U* y) {
+        std::vector<std::pair<U, std::size_t>> buf;
+        for (std::size_t j = 0; j < n; ++j)
+            tensor_impl::_argsort_line(x + j * l.inner_stride(0), so,
+                                       y + j * l.inner_stride(1), si, L, comp, buf);
+    }, out.data() + od.start, in.data() + id.start);
+    return std::forward<O>(out);
+}
+
+/**
+ * @brief argsort. Indexes sorting every line along
+ *        dimension D of in.
+ * @param in
+ * @param comp strict weak order.
+ * @return a new Tensor of indexes.
+ */
+template <std::size_t D, typename M,
+          typename Comp = std::less<Value_type<M>>,
+          typename = Enable_if<_tensor_type<M>() && !_tensor_type<Comp>()>>
+Tensor<std::size_t, M::order>
+argsort(const M& in, Comp comp = Comp{})
+{
+    Tensor<std::size_t, M::order> out(uninitialized, in.descriptor().extents);
+    argsort<D>(out, in, comp);
+    return out;
+}
+
+/**
+ * @brief topk. The k first elements of every line along
+ *        dimension D of in, in the order of comp (largest
+ *        first by default), with their indexes; k is the
+ *        extent D of the outputs, the other extents are the
+ *        ones of in. Ties keep the lowest index first.
+ * @param values Tensor or Tensor_ref.
+ * @param indexes integer Tensor or Tensor_ref.
+ * @param in
+ * @param comp strict weak order.
+ */
+template <std::size_t D, typename V, typename X, typename M,
+          typename Comp = std::greater<Value_type<M>>,
+          typename = Enable_if<_tensor_type<std::remove_reference_t<V>>() &&
+                               _tensor_type<std::remove_reference_t<X>>() &&
+                               _tensor_type<M>()>>
+void
+topk(V&& values, X&& indexes, const M& in, Comp comp = Comp{})
+{
+    using T = Value_type<std::remove_reference_t<V>>;
+    using I = Value_type<std::remove_reference_t<X>>;
+    using U = Value_type<M>;
+    static_assert (std::is_integral<I>::value, "topk: indexes must be integers");
+
+    const auto& vd = values.descriptor();
+    const auto& xd = indexes.descriptor();
+    const auto& id = in.descriptor();
+    const std::size_t L = id.extents[D], k = vd.extents[D];
+    assert(vd.extents == xd.extents && k <= L);
+    if (k == 0 || id.size == 0)
+        return;
+
+    const auto l = tensor_impl::_make_line_loop<D>(vd, xd, id);
+    const std::size_t sv = vd.strides[D], sx = xd.strides[D], si = id.strides[D];
+    tensor_impl::_parallel_for_lines(l, tensor_impl::_sort_lines_per_task(L), L,
+                                     [&](std::size_t n, T* v, I* x, const U* y) {
+        std::vector<std::pair<U, std::size_t>> buf;
+        for (std::size_t j = 0; j < n; ++j)
+            tensor_impl::_topk_line(v + j * l.inner_stride(0), sv,
+                                    x + j * l.inner_stride(1), sx,
+                                    y + j * l.inner_stride(2), si, L, k, comp, buf);
+    }, values.data() + vd.start, indexes.data() + xd.start, in.data() + id.start);
+}
+
+/**
+ * @brief topk. The k first elements of every line along
+ *        dimension D of in (largest first by default).
+ * @param in
+ * @param k
+ * @param comp strict weak order.
+ * @return (values, indexes), extent D equal to k.
+ */
+template <std::size_t D, typename M,
+          typename Comp = std::greater<Value_type<M>>,
+          typename = Enable_if<_tensor_type<M>()>>
+std::pair<Tensor<Value_type<M>, M::order>, Tensor<std::size_t, M::order>>
+topk(const M& in, std::size_t k, Comp comp = Comp{})
+{
+    auto ext = in.descriptor().extents;
+    assert(k <= ext[D]);
+    ext[D] = k;
+    std::pair<Tensor<Value_type<M>, M::order>, Tensor<std::size_t, M::order>> r{
+        Tensor<Value_type<M>, M::order>(uninitialized, ext),
+        Tensor<std::size_t, M::order>(uninitialized, ext)};
+    topk<D>(r.first, r.second, in, comp);
+    return r;
+}
+
+NUM_END
+
+#endif // SORT_H
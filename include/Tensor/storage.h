@@ -0,0 +1,552 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <iostream>
+#include <memory>
+#include <functional>
+#include <new>
+#include <iterator>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <cassert>
+
+#include "parallel.h"
+#include "trace.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/// Tag to build a Tensor without initializing its elements.
+struct Uninitialized_t
+{ explicit constexpr Uninitialized_t() = default; };
+
+constexpr Uninitialized_t uninitialized{};
+
+/// Tag to build a Tensor owning a foreign buffer.
+struct Adopt_buffer_t
+{ explicit constexpr Adopt_buffer_t() = default; };
+
+constexpr Adopt_buffer_t adopt_buffer{};
+
+/// Tag to build a Tensor viewing a foreign buffer without owning it.
+struct Borrow_buffer_t
+{ explicit constexpr Borrow_buffer_t() = default; };
+
+constexpr Borrow_buffer_t borrow_buffer{};
+
+/// Function freeing a buffer.
+template <typename T>
+using Buffer_deleter = std::function<void(T*)>;
+
+/// A buffer handed back by a Tensor, with the function freeing it.
+template <typename T>
+using Tensor_buffer = std::unique_ptr<T[], Buffer_deleter<T>>;
+
+namespace tensor_impl {
+
+/// Alignment of tensor buffers (a cache line, an AVX-512 register).
+constexpr std::size_t _storage_alignment = 64;
+
+/// Bytes below which a fill stays on the calling thread.
+constexpr std::size_t _parallel_fill_bytes = std::size_t{1} << 20;
+
+/**
+ * @brief _parallel_fill. Fill [p, p + n) with copies of
+ *        value. Large buffers of trivially copyable types
+ *        are split across the pool, so every page is first
+ *        touched by the threads that later process it.
+ * @param p
+ * @param n
+ * @param value
+ */
+template <typename T>
+void
+_parallel_fill(T* p, std::size_t n, const T& value)
+{
+    if (std::is_trivially_copyable<T>::value &&
+            n * sizeof(T) >= _parallel_fill_bytes)
+        _parallel_for(n, _parallel_fill_bytes / sizeof(T),
+                      [&](std::size_t b, std::size_t e) {
+            std::fill(p + b, p + e, value);
+        });
+    else
+        std::fill(p, p + n, value);
+}
+
+};
+
+/**
+ * @brief The Tensor_storage class. Contiguous, 64-byte
+ *        aligned buffer of a Tensor. Unlike std::vector it
+ *        can be allocated without touching its memory, and
+ *        large initializations run on the thread pool.
+ *        It can also hold a foreign buffer: adopted (freed
+ *        by a custom deleter) or borrowed (never freed).
+ *        Growing a foreign buffer moves the elements to an
+ *        owned one.
+ *        After share(), the buffer is reference counted:
+ *        copies are O(1) and detach() makes the real copy,
+ *        only when the buffer is seen by other storages.
+ *        Counts are atomic, so shared buffers can be read
+ *        from any thread.
+ */
+template <typename T>
+class Tensor_storage {
+public:
+
+    /// Aliases.
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    /// Default ctor.
+    Tensor_storage() = default;
+
+    /**
+     * @brief Tensor_storage ctor. n value-initialized elements.
+     * @param n
+     */
+    explicit Tensor_storage(std::size_t n)
+        : Tensor_storage(n, uninitialized)
+    {
+        TENSOR_TRACE("Tensor_storage::construct", Trace_count{n, n * sizeof(T)});
+        if (std::is_trivially_copyable<T>::value)
+            tensor_impl::_parallel_fill(_data, n, T{});
+        else
+            _value_construct();
+    }
+
+    /**
+     * @brief Tensor_storage ctor. n elements default-initialized:
+     *        for trivial types memory is not touched.
+     * @param n
+     */
+    Tensor_storage(std::size_t n, Uninitialized_t)
+        : _data{_allocate(n)},
+          _size{n},
+          _capacity{n}
+    {
+        if (!std::is_trivially_default_constructible<T>::value)
+            std::uninitialized_default_construct_n(_data, n);
+    }
+
+    /**
+     * @brief Tensor_storage ctor. n copies of value.
+     * @param n
+     * @param value
+     */
+    Tensor_storage(std::size_t n, const T& value)
+        : Tensor_storage(n, uninitialized)
+    {
+        TENSOR_TRACE("Tensor_storage::construct", Trace_count{n, n * sizeof(T)});
+        if (std::is_trivially_copyable<T>::value)
+            tensor_impl::_parallel_fill(_data, n, value);
+        else
+            std::fill(_data, _data + n, value);
+    }
+
+    /**
+     * @brief Tensor_storage ctor. Copy of a range.
+     * @param first
+     * @param last
+     */
+    template <typename It,
+              typename = typename std::iterator_traits<It>::iterator_category>
+    Tensor_storage(It first, It last)
+    { insert(end(), first, last); }
+
+    /**
+     * @brief Tensor_storage ctor. Take ownership of n elements
+     *        at p, freed by deleter.
+     * @param p
+     * @param n
+     * @param deleter
+     */
+    Tensor_storage(Adopt_buffer_t, T* p, std::size_t n, Buffer_deleter<T> deleter)
+        : _data{p},
+          _size{n},
+          _capacity{n},
+          _deleter{std::move(deleter)}
+    {
+        static_assert (std::is_trivially_copyable<T>::value,
+                       "Tensor_storage: foreign buffers need trivially copyable types");
+        assert(_deleter);
+    }
+
+    /**
+     * @brief Tensor_storage ctor. Use n elements at p,
+     *        owned by someone else.
+     * @param p
+     * @param n
+     */
+    Tensor_storage(Borrow_buffer_t, T* p, std::size_t n)
+        : Tensor_storage(adopt_buffer, p, n, [](T*) {})
+    {}
+
+    /// Copies share shared buffers, and own a copy of the others.
+    Tensor_storage(const Tensor_storage& s)
+    {
+        if (s._shared) {
+            _data = s._data;
+            _size = s._size;
+            _capacity = s._capacity;
+            _shared = s._shared;
+        } else {
+            TENSOR_TRACE("Tensor_storage::copy", Trace_count{s._size, 2 * s._size * sizeof(T)});
+            insert(end(), s.begin(), s.end());
+        }
+    }
+
+    Tensor_storage(Tensor_storage&& s) noexcept
+        : _data{s._data},
+          _size{s._size},
+          _capacity{s._capacity},
+          _deleter{std::move(s._deleter)},
+          _shared{std::move(s._shared)}
+    {
+        s._data = nullptr;
+        s._size = s._capacity = 0;
+        s._deleter = nullptr;
+    }
+
+    Tensor_storage&
+    operator=(const Tensor_storage& s)
+    {
+        if (this == &s)
+            return *this;
+        if (s._shared) {
+            Tensor_storage t(s);
+            swap(t);
+        } else {
+            TENSOR_TRACE("Tensor_storage::copy", Trace_count{s._size, 2 * s._size * sizeof(T)});
+            assign(s.begin(), s.end());
+        }
+        return *this;
+    }
+
+    Tensor_storage&
+    operator=(Tensor_storage&& s) noexcept
+    {
+        swap(s);
+        return *this;
+    }
+
+    ~Tensor_storage()
+    { _free(); }
+
+    /**
+     * @brief swap. Exchange buffers.
+     * @param s
+     */
+    void
+    swap(Tensor_storage& s) noexcept
+    {
+        std::swap(_data, s._data);
+        std::swap(_size, s._size);
+        std::swap(_capacity, s._capacity);
+        std::swap(_deleter, s._deleter);
+        std::swap(_shared, s._shared);
+    }
+
+    /**
+     * @brief foreign. Check if the buffer was adopted
+     *        or borrowed.
+     * @return true if it was, false otherwise.
+     */
+    bool
+    foreign() const
+    { return _shared ? bool(_shared->deleter) : bool(_deleter); }
+
+    /**
+     * @brief share. Make the buffer reference counted, so
+     *        that copies of this storage share it.
+     */
+    void
+    share()
+    {
+        if (_shared)
+            return;
+        _shared = std::make_shared<_Block>();
+        _shared->data = _data;
+        _shared->size = _size;
+        _shared->deleter = std::move(_deleter);
+        _deleter = nullptr;
+    }
+
+    /**
+     * @brief shared. Check if the buffer is reference counted.
+     * @return true if it is, false otherwise.
+     */
+    bool
+    shared() const
+    { return bool(_shared); }
+
+    /**
+     * @brief unique. Check if no other storage sees the buffer.
+     * @return true if none does, false otherwise.
+     */
+    bool
+    unique() const
+    {
+        if (!_shared)
+            return true;
+        if (_shared.use_count() != 1)
+            return false;
+        /// Pairs with the release of the other owners, so their
+        /// reads happen before our writes.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    /**
+     * @brief detach. Copy a buffer seen by other storages
+     *        before writing to it. The copy stays shared.
+     */
+    void
+    detach()
+    {
+        if (unique())
+            return;
+        Tensor_storage t(size(), uninitialized);
+        std::copy(begin(), end(), t.begin());
+        t.share();
+        swap(t);
+    }
+
+    /**
+     * @brief release. Give the buffer away, leaving the
+     *        storage empty. The returned pointer frees it
+     *        the right way: the adopted deleter, nothing for a
+     *        borrowed buffer, destruction and deallocation for
+     *        an owned one. Call release() on it to take
+     *        the raw pointer.
+     * @return Tensor_buffer.
+     */
+    Tensor_buffer<T>
+    release()
+    {
+        _unshare();
+        Buffer_deleter<T> d = std::move(_deleter);
+        if (!d) {
+            std::size_t n = _size;
+            d = [n](T* p) {
+                std::destroy_n(p, n);
+                _deallocate(p);
+            };
+        }
+        Tensor_buffer<T> b(_data, std::move(d));
+        _data = nullptr;
+        _size = _capacity = 0;
+        _deleter = nullptr;
+        return b;
+    }
+
+    T* data() { return _data; }
+    const T* data() const { return _data; }
+
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    iterator begin() { return _data; }
+    iterator end() { return _data + _size; }
+    const_iterator begin() const { return _data; }
+    const_iterator end() const { return _data + _size; }
+    const_iterator cbegin() const { return _data; }
+    const_iterator cend() const { return _data + _size; }
+
+    /**
+     * @brief clear. Destroy all elements, keeping the buffer.
+     */
+    void
+    clear()
+    {
+        if (!unique()) {
+            Tensor_storage t;
+            t.share();
+            swap(t);
+            return;
+        }
+        std::destroy_n(_data, _size);
+        _size = 0;
+        _sync();
+    }
+
+    /**
+     * @brief reserve. Grow the buffer to hold n elements.
+     * @param n
+     */
+    void
+    reserve(std::size_t n)
+    {
+        detach();
+        if (n <= _capacity)
+            return;
+        const bool shared = bool(_shared);
+        _unshare();
+        T* p = _allocate(n);
+        std::uninitialized_move_n(_data, _size, p);
+        auto size = _size;
+        _free();
+        _data = p;
+        _size = size;
+        _capacity = n;
+        if (shared)
+            share();
+    }
+
+    /**
+     * @brief resize. Change the number of elements,
+     *        value-initializing the new ones.
+     * @param n
+     */
+    void
+    resize(std::size_t n)
+    {
+        detach();
+        if (n < _size) {
+            std::destroy(_data + n, _data + _size);
+            _size = n;
+        } else {
+            reserve(n);
+            std::uninitialized_value_construct(_data + _size, _data + n);
+            _size = n;
+        }
+        _sync();
+    }
+
+    /**
+     * @brief insert. Append a range. Only insertion at end()
+     *        is supported.
+     * @param pos
+     * @param first
+     * @param last
+     * @return iterator to the first inserted element.
+     */
+    template <typename It>
+    iterator
+    insert(const_iterator pos, It first, It last)
+    {
+        assert(pos == end());
+        (void) pos;
+        auto n = std::size_t(std::distance(first, last));
+        reserve(_size + n);
+        std::uninitialized_copy(first, last, _data + _size);
+        _size += n;
+        _sync();
+        return _data + _size - n;
+    }
+
+    /**
+     * @brief assign. Replace the elements with a range.
+     * @param first
+     * @param last
+     */
+    template <typename It>
+    void
+    assign(It first, It last)
+    {
+        clear();
+        insert(end(), first, last);
+    }
+
+private:
+
+    /// Owner of a shared buffer, freed by the last storage.
+    struct _Block {
+        ~_Block()
+        {
+            if (!data)
+                return;
+            if (deleter)
+                deleter(data);
+            else {
+                std::destroy_n(data, size);
+                _deallocate(data);
+            }
+        }
+
+        T* data = nullptr;
+        std::size_t size = 0;
+        Buffer_deleter<T> deleter;
+    };
+
+    /// Keep the size seen by the block up to date (unique only).
+    void
+    _sync()
+    {
+        if (_shared)
+            _shared->size = _size;
+    }
+
+    /// Take back a unique shared buffer as a plain one.
+    void
+    _unshare()
+    {
+        if (!_shared)
+            return;
+        detach();
+        _deleter = std::move(_shared->deleter);
+        _shared->data = nullptr;
+        _shared.reset();
+    }
+
+    /// Free the buffer, whatever its owner.
+    void
+    _free()
+    {
+        if (_shared) {
+            _shared.reset();
+        } else if (_deleter) {
+            _deleter(_data);
+            _deleter = nullptr;
+        } else {
+            clear();
+            _deallocate(_data);
+        }
+        _data = nullptr;
+        _size = _capacity = 0;
+    }
+
+    void
+    _value_construct()
+    {
+        std::destroy_n(_data, _size);
+        std::uninitialized_value_construct_n(_data, _size);
+    }
+
+    static T*
+    _allocate(std::size_t n)
+    {
+        if (n == 0)
+            return nullptr;
+        return static_cast<T*>(::operator new(
+                    n * sizeof(T),
+                    std::align_val_t{std::max(tensor_impl::_storage_alignment,
+                                              alignof(T))}));
+    }
+
+    static void
+    _deallocate(T* p)
+    {
+        if (p)
+            ::operator delete(p, std::align_val_t{std::max(tensor_impl::_storage_alignment,
+                                                           alignof(T))});
+    }
+
+    T* _data = nullptr;
+    std::size_t _size = 0;
+    std::size_t _capacity = 0;
+
+    /// Set for foreign buffers only.
+    Buffer_deleter<T> _deleter;
+
+    /// Set for shared buffers only: owns the buffer instead.
+    std::shared_ptr<_Block> _shared;
+};
+
+NUM_END
+
+#endif // STORAGE_H
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <numeric>
 #include <array>
+#include <utility>
+#include <algorithm>
 #include <cassert>
 
 #include "tensor_f_decl.h"
@@ -147,6 +149,26 @@ _calc_strides(const std::array<std::size_t, N>& exts,
     return st;
 }
 
+/**
+ * @brief _calc_strides_col. As _calc_strides, but
+ *        column-major: the first dimension is contiguous.
+ * @param exts
+ * @param strs
+ * @return the number of element in the structure.
+ */
+template <size_t N>
+std::size_t
+_calc_strides_col(const std::array<std::size_t, N>& exts,
+                  std::array<std::size_t, N>& strs)
+{
+    std::size_t st = 1;
+    for (std::size_t i = 0; i < N; ++i) {
+        strs[i] = st;
+        st *= exts[i];
+    }
+    return st;
+}
+
 /**
  * @brief _calc_size. Calculate number of elements
  *        in the N-dimensional structure.
@@ -159,6 +181,35 @@ _calc_size(const V& exts)
 { return std::accumulate(exts.begin(), exts.end(), 1,
                          std::multiplies<std::size_t>{}); }
 
+/**
+ * @brief _is_dense. Check if a descriptor covers exactly
+ *        [0, size) of its buffer, in any order of the
+ *        dimensions (row-major, column-major, ...).
+ * @param ts
+ * @return true if it does, false otherwise.
+ */
+template <std::size_t N>
+bool
+_is_dense(const Tensor_slice<N>& ts)
+{
+    if (ts.start != 0)
+        return false;
+    std::array<std::size_t, N> dims;
+    std::iota(dims.begin(), dims.end(), std::size_t{0});
+    std::sort(dims.begin(), dims.end(), [&](std::size_t a, std::size_t b) {
+        return ts.strides[a] < ts.strides[b];
+    });
+    std::size_t st = 1;
+    for (auto d : dims) {
+        if (ts.extents[d] == 1)
+            continue;
+        if (ts.strides[d] != st)
+            return false;
+        st *= ts.extents[d];
+    }
+    return st == ts.size || ts.size == 0;
+}
+
 /**
  * @brief _slice_dim. Calculate the new descriptor of the
  *        N-dimensional structure, from a descriptor,
@@ -196,16 +247,30 @@ _slice_dim(std::size_t offset, const Tensor_slice<N>& src, Tensor_slice<N - 1>&
  * @param dims
  * @return true if they are, false otherwise.
  */
+template <std::size_t N, typename... Dims, std::size_t... I>
+bool _check_bounds(const Tensor_slice<N>& ts, std::index_sequence<I...>, Dims... dims)
+{ return ((std::size_t(dims) < ts.extents[I]) && ...); }
+
 template <std::size_t N, typename... Dims>
 bool _check_bounds(const Tensor_slice<N>& ts, Dims... dims)
 {
-    std::size_t indexes[N] {std::size_t(dims)...};
-    return std::equal(indexes,
-                      indexes + N,
-                      ts.extents.begin(),
-                      std::less<std::size_t>{});
+    static_assert (sizeof...(Dims) == N,
+                   "_check_bounds: dimensions mismatch");
+    return _check_bounds(ts, std::make_index_sequence<N>{}, dims...);
 }
 
+/**
+ * @brief _flat_offset. start + sum_i dims_i * strides_i,
+ *        expanded at compile time into a chain of multiply-adds.
+ * @param ts
+ * @param dims
+ * @return the index of the element in the flat structure.
+ */
+template <std::size_t N, typename... Dims, std::size_t... I>
+std::size_t
+_flat_offset(const Tensor_slice<N>& ts, std::index_sequence<I...>, Dims... dims)
+{ return (ts.start + ... + (std::size_t(dims) * ts.strides[I])); }
+
 /**
  * @brief _requesting_element. Checks that all args
  *        are size_t
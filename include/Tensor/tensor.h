@@ -2,11 +2,16 @@
 #define TENSOR_H
 
 #include <iostream>
+#include <utility>
 #include <vector>
 
 #include "tensor_base.h"
 #include "tensor_initializer.h"
 #include "tensor_ref.h"
+#include "storage.h"
+#include "layout.h"
+#include "cursor.h"
+#include "trace.h"
 
 #include "../macros.h"
 
@@ -21,8 +26,8 @@ public:
     using value_type = T;
     using reference = T&;
     using const_reference = const T&;
-    using iterator = typename std::vector<T>::iterator;
-    using const_iterator = typename std::vector<T>::const_iterator;
+    using iterator = typename Tensor_storage<T>::iterator;
+    using const_iterator = typename Tensor_storage<T>::const_iterator;
 
     /// Default ctors.
     Tensor() = default;
@@ -36,26 +41,90 @@ public:
     template <typename U>
     Tensor(const Tensor_ref<U, N>& t_ref)
         : Tensor_base<T, N> (t_ref.descriptor().extents),
-          _elems(t_ref.cbegin(), t_ref.cend())
-    { static_assert (Convertible<U, T>(),
-                     "Tensor constructor: types mismatch"); }
+          _elems(this->_desc.size, uninitialized)
+    {
+        static_assert (Convertible<U, T>(),
+                       "Tensor constructor: types mismatch");
+        tensor_impl::_copy(t_ref.data(), t_ref.descriptor(),
+                           _elems.data(), this->_desc);
+    }
 
-    /// Assignement from Tensor_ref
+    /// Assignement from Tensor_ref. A column-major tensor stays so.
     template <typename U>
     Tensor& operator= (const Tensor_ref<U, N>& t_ref)
     {
-        this->_desc = t_ref.descriptor();
-        _elems.assign(t_ref.cbegin(), t_ref.cend());
+        const auto& exts = t_ref.descriptor().extents;
+        Tensor_slice<N> desc = N > 1 && this->_desc.col_major()
+                ? Tensor_slice<N>(col_major, exts)
+                : Tensor_slice<N>(exts);
+        Tensor_storage<T> elems(desc.size, uninitialized);
+        tensor_impl::_copy(t_ref.data(), t_ref.descriptor(),
+                           elems.data(), desc);
+        if (_elems.shared())
+            elems.share();
+        this->_desc = desc;
+        _elems = std::move(elems);
         return *this;
     }
 
-    /// Ctor by passing extents
+    /**
+     * Ctor by passing extents. Elements are value-initialized;
+     * large tensors are filled by the thread pool, so pages
+     * are first touched by the threads that process them.
+     */
     template <typename... Exts>
     explicit Tensor(Exts... exts)
         : Tensor_base<T, N> (exts...),
           _elems(this->_desc.size)
     {}
 
+    /**
+     * Ctor by passing a layout and extents, e.g.
+     * Tensor<double, 2> m(col_major, r, c) for a Fortran
+     * ordered matrix. Elements are value-initialized.
+     */
+    template <typename... Exts>
+    explicit Tensor(Row_major_t, Exts... exts)
+        : Tensor(exts...)
+    {}
+
+    template <typename... Exts>
+    explicit Tensor(Col_major_t, Exts... exts)
+        : Tensor_base<T, N> (col_major, exts...),
+          _elems(this->_desc.size)
+    {}
+
+    /**
+     * Ctor by passing extents, without initializing elements
+     * of trivial types: no page is touched until written.
+     */
+    template <typename... Exts>
+    Tensor(Uninitialized_t, Exts... exts)
+        : Tensor_base<T, N> (exts...),
+          _elems(this->_desc.size, uninitialized)
+    {}
+
+    /**
+     * Ctor from a foreign buffer: the tensor takes ownership
+     * of the desc.size elements at p and frees them with
+     * deleter. desc must be dense (see _is_dense). No copy.
+     */
+    template <typename D>
+    Tensor(Adopt_buffer_t, T* p, const Tensor_slice<N>& desc, D deleter)
+        : Tensor_base<T, N> (desc),
+          _elems(adopt_buffer, p, desc.size, Buffer_deleter<T>(std::move(deleter)))
+    { assert(tensor_impl::_is_dense(desc)); }
+
+    /**
+     * Ctor from a foreign buffer owned by someone else, who
+     * must keep it alive. desc must be dense. No copy; copies
+     * of this tensor own their elements.
+     */
+    Tensor(Borrow_buffer_t, T* p, const Tensor_slice<N>& desc)
+        : Tensor_base<T, N> (desc),
+          _elems(borrow_buffer, p, desc.size)
+    { assert(tensor_impl::_is_dense(desc)); }
+
     /// Ctor from Tensor_initializer
     Tensor(Tensor_initializer<T, N> t_init)
     {
@@ -108,12 +177,16 @@ public:
     Tensor& operator= (std::initializer_list<U>) = delete;
 
     /**
-     * @brief data.
+     * @brief data. On a shared tensor, copy the buffer first
+     *        if other tensors see it.
      * @return a pointer to the first element.
      */
     T*
     data()
-    { return _elems.data(); }
+    {
+        _elems.detach();
+        return _elems.data();
+    }
 
     /**
      * @brief data.
@@ -123,16 +196,57 @@ public:
     data() const
     { return _elems.data(); }
 
+    /**
+     * @brief share. Opt in to shared storage: copies of this
+     *        tensor become O(1) and share its buffer, which is
+     *        copied only on the first write through a non-const
+     *        member (operator(), data(), views, apply, fill,
+     *        compound operators, ...). Reference counts are
+     *        atomic, so shared tensors can be read by many
+     *        threads at no cost. Views taken before a copy
+     *        write to the buffer both tensors see.
+     * @return *this.
+     */
+    Tensor&
+    share()
+    {
+        _elems.share();
+        return *this;
+    }
+
+    /**
+     * @brief shared. Check if the tensor is in shared mode.
+     * @return true if it is, false otherwise.
+     */
+    bool
+    shared() const
+    { return _elems.shared(); }
+
+    /**
+     * @brief release. Hand the buffer back without copying,
+     *        leaving the tensor empty. Its layout is the one
+     *        descriptor() had before the call. The returned
+     *        pointer frees the buffer as its owner would: call
+     *        release() on it to take the raw pointer instead.
+     * @return Tensor_buffer<T>.
+     */
+    Tensor_buffer<T>
+    release()
+    {
+        this->_desc = Tensor_slice<N>{};
+        return _elems.release();
+    }
+
     /**
      * @brief slice. Get a slice of a N-dimensional
      *        structure by a specific dimension.
      *        Create a new descriptor and return a
      *        Tensor_ref with N - 1 dimensions.
      * @param i
-     * @return Tensor_ref<T, N- 1> (const).
+     * @return Tensor_ref<const T, N- 1>.
      */
     template<std::size_t D>
-    const Tensor_ref<T, N - 1>
+    Tensor_ref<const T, N - 1>
     slice(std::size_t i) const
     {
         static_assert (D < N, "Tensor_ref<T, N - 1>::Dimension of slice "
@@ -162,7 +276,7 @@ public:
         assert(i < this->_desc.extents[D]);
         Tensor_slice<N - 1> t;
         tensor_impl::_slice_dim<D>(i, this->_desc, t);
-        return {t, _elems.data()};
+        return {t, data()};
     }
 
     /// Access to elements
@@ -171,7 +285,7 @@ public:
     operator()(Args... args)
     {
         assert(tensor_impl::_check_bounds(this->_desc, args...));
-        return *(_elems.data() + this->_desc(args...));
+        return *(data() + this->_desc(args...));
     }
 
     /// Access to elements (const)
@@ -183,6 +297,28 @@ public:
         return *(_elems.data() + this->_desc(args...));
     }
 
+    /**
+     * @brief cursor. Get a cursor on the element indexed by
+     *        dims, moving by strides (see Tensor_cursor).
+     * @param dims
+     * @return Tensor_cursor<T, N>.
+     */
+    template <typename... Dims>
+    Tensor_cursor<T, N>
+    cursor(Dims... dims)
+    { return Tensor_cursor<T, N>(data(), this->_desc).seek(dims...); }
+
+    /**
+     * @brief cursor. Get a cursor on the element indexed by
+     *        dims (const).
+     * @param dims
+     * @return Tensor_cursor<const T, N>.
+     */
+    template <typename... Dims>
+    Tensor_cursor<const T, N>
+    cursor(Dims... dims) const
+    { return Tensor_cursor<const T, N>(data(), this->_desc).seek(dims...); }
+
     /**
      * @brief row. Only in a matrix, return a row slice.
      * @param i
@@ -196,7 +332,7 @@ public:
         assert(i < this->rows());
         Tensor_slice<N - 1> t_slice;
         tensor_impl::_slice_dim<0>(i, this->_desc, t_slice);
-        return {t_slice, _elems.data()};
+        return {t_slice, data()};
     }
 
     /**
@@ -228,7 +364,7 @@ public:
         assert(i < this->cols());
         Tensor_slice<N - 1> t_slice;
         tensor_impl::_slice_dim<1>(i, this->_desc, t_slice);
-        return {t_slice, _elems.data()};
+        return {t_slice, data()};
     }
 
     /**
@@ -300,6 +436,8 @@ public:
     template <typename F>
     Tensor& apply(F f)
     {
+        TENSOR_TRACE("Tensor::apply", *this);
+        _elems.detach();
         for (auto& x : _elems) f(x);
         return *this;
     }
@@ -311,7 +449,45 @@ public:
      */
     Tensor&
     operator= (const T& value)
-    { return apply([&](T& a) { a = value; }); }
+    { return fill(value); }
+
+    /**
+     * @brief fill. Assign value to all elements, in parallel
+     *        for large tensors.
+     * @param value
+     * @return *this
+     */
+    Tensor&
+    fill(const T& value)
+    {
+        TENSOR_TRACE("Tensor::fill", *this);
+        tensor_impl::_parallel_fill(_overwrite(), _elems.size(), value);
+        return *this;
+    }
+
+    /**
+     * @brief generate. Assign g(i) to the i-th element (in
+     *        storage order), in parallel for large tensors.
+     *        g is called concurrently, so it must not keep
+     *        shared mutable state.
+     * @param g
+     * @return *this
+     */
+    template <typename G>
+    Tensor&
+    generate(G g)
+    {
+        TENSOR_TRACE("Tensor::generate", *this);
+        T* p = _overwrite();
+        tensor_impl::_parallel_for(_elems.size(),
+                                   std::max<std::size_t>(
+                                       tensor_impl::_parallel_fill_bytes / sizeof(T), 1),
+                                   [&](std::size_t b, std::size_t e) {
+            for (std::size_t i = b; i < e; ++i)
+                p[i] = g(i);
+        });
+        return *this;
+    }
 
     /**
      * @brief operator +=. Sum a and b and put in a.
@@ -362,7 +538,8 @@ public:
     /**
      * @brief apply. For each element, apply the
      *        predicate f, using values of another
-     *        tensor.
+     *        tensor. m is only read, so a shared m
+     *        keeps its buffer.
      * @param f
      * @param value
      * @return *this.
@@ -371,9 +548,11 @@ public:
     Enable_if<_tensor_type<M>(), Tensor&>
     apply(F f, M& m)
     {
-        assert(this->_desc.extents == m.descriptor().extents);
-        for (auto i = begin(), j = m.cbegin(); i != end(); ++i, ++j)
-            f(*i, *j);
+        TENSOR_TRACE("Tensor::apply", *this, m);
+        const auto& md = m.descriptor();
+        assert(this->_desc.extents == md.extents);
+        tensor_impl::_for_each(tensor_impl::_make_loop(this->_desc, md), f,
+                               data(), std::as_const(m).data() + md.start);
         return *this;
     }
 
@@ -406,7 +585,7 @@ public:
      * @return iterator pointing to begin position.
      */
     iterator begin()
-    { return _elems.begin(); }
+    { return data(); }
 
     /**
      * @brief end.
@@ -414,7 +593,7 @@ public:
      *         after end position.
      */
     iterator end()
-    { return _elems.end(); }
+    { return data() + _elems.size(); }
 
     /**
      * @brief cbegin.
@@ -432,8 +611,26 @@ public:
     { return _elems.cend(); }
 
 private:
+
+    /**
+     * @brief _overwrite. Buffer about to be written in full:
+     *        a shared one seen by other tensors is replaced,
+     *        not copied.
+     * @return a pointer to the first element.
+     */
+    T*
+    _overwrite()
+    {
+        if (!_elems.unique()) {
+            Tensor_storage<T> elems(_elems.size(), uninitialized);
+            elems.share();
+            _elems = std::move(elems);
+        }
+        return _elems.data();
+    }
+
     /// Elements
-    std::vector<T> _elems;
+    Tensor_storage<T> _elems;
 
 };
 
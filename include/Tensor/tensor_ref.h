@@ -6,6 +6,10 @@
 #include <cassert>
 
 #include "tensor_base.h"
+#include "copy.h"
+#include "iteration.h"
+#include "cursor.h"
+#include "trace.h"
 #include "tensor_initializer.h"
 #include "tensor_f_decl.h"
 
@@ -47,14 +51,22 @@ public:
     /// assignement
     Tensor_ref& operator=(Tensor_ref& t) {
         assert(this->_desc.extents == t.descriptor().extents);
-        std::copy(t.begin(), t.end(), begin());
+        tensor_impl::_copy(t.data(), t.descriptor(), _elems, this->_desc);
         return *this;
     }
 
     /// assignement const
     Tensor_ref& operator=(const Tensor_ref& t) {
         assert(this->_desc.extents == t.descriptor().extents);
-        std::copy(t.cbegin(), t.cend(), begin());
+        tensor_impl::_copy(t.data(), t.descriptor(), _elems, this->_desc);
+        return *this;
+    }
+
+    /// assignement from a Tensor_ref of another type
+    template <typename U>
+    Tensor_ref& operator=(const Tensor_ref<U, N>& t) {
+        assert(this->_desc.extents == t.descriptor().extents);
+        tensor_impl::_copy(t.data(), t.descriptor(), _elems, this->_desc);
         return *this;
     }
 
@@ -69,7 +81,7 @@ public:
     Tensor_ref& operator=(const Tensor<U, N>& t)
     {
         assert(this->_desc.extents == t.descriptor().extents);
-        std::copy(t.cbegin(), t.cend(), begin());
+        tensor_impl::_copy(t.data(), t.descriptor(), _elems, this->_desc);
         return *this;
     }
 
@@ -190,8 +202,9 @@ public:
     Tensor_ref<T, N>&
     apply(F f)
     {
-        for (auto x = begin(); x != end(); ++x)
-            f(*x);
+        TENSOR_TRACE("Tensor_ref::apply", *this);
+        tensor_impl::_for_each(tensor_impl::_make_loop(this->_desc), f,
+                               _elems + this->_desc.start);
         return *this;
     }
 
@@ -262,9 +275,11 @@ public:
     Enable_if<_tensor_type<M>(), Tensor_ref&>
     apply(F f, M& m)
     {
-        assert(this->_desc.extents == m.descriptor().extents);
-        for (auto i = begin(), j = m.cbegin(); i != end(); ++i, ++j)
-            f(*i, *j);
+        TENSOR_TRACE("Tensor_ref::apply", *this, m);
+        const auto& md = m.descriptor();
+        assert(this->_desc.extents == md.extents);
+        tensor_impl::_for_each(tensor_impl::_make_loop(this->_desc, md), f,
+                               _elems + this->_desc.start, m.data() + md.start);
         return *this;
     }
 
@@ -308,6 +323,17 @@ public:
     data() const
     { return _elems; }
 
+    /**
+     * @brief cursor. Get a cursor on the element indexed by
+     *        dims, moving by strides (see Tensor_cursor).
+     * @param dims
+     * @return Tensor_cursor<T, N>.
+     */
+    template <typename... Dims>
+    Tensor_cursor<T, N>
+    cursor(Dims... dims) const
+    { return Tensor_cursor<T, N>(_elems, this->_desc).seek(dims...); }
+
     /// Iterators
     /**
      * @brief begin.
@@ -386,6 +412,14 @@ public:
     descriptor() const
     { return _desc; }
 
+    /**
+     * @brief position. Get the indexes of the element.
+     * @return const reference to the indexes.
+     */
+    const std::array<std::size_t, N>&
+    position() const
+    { return _pos; }
+
     /**
      * @brief operator ++ (pre-increment). Make sequentially increment
      * @return *this
@@ -459,7 +493,7 @@ inline bool operator==(const Tensor_iterator<T, N>& a,
                        const Tensor_iterator<T, N>& b)
 {
     assert(a.descriptor() == b.descriptor());
-    return &*a == &*b;
+    return &*a == &*b && a.position() == b.position();
 }
 
 template <typename T, std::size_t N>
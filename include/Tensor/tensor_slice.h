@@ -7,6 +7,7 @@
 
 #include "traits.h"
 #include "support.h"
+#include "layout.h"
 
 #include "../macros.h"
 
@@ -90,6 +91,47 @@ struct Tensor_slice {
         size = tensor_impl::_calc_strides<N>(extents, strides);
     }
 
+    /**
+     * @brief tensor_slice ctor. Dimensions of a tensor with
+     *        the given layout.
+     * @param dims
+     */
+    template <typename... Dims>
+    Tensor_slice(Row_major_t, Dims... dims)
+        : Tensor_slice(dims...)
+    {}
+
+    /**
+     * @brief tensor_slice ctor. Dimensions of a column-major
+     *        tensor (first index contiguous).
+     * @param dims
+     */
+    template <typename... Dims>
+    Tensor_slice(Col_major_t, Dims... dims)
+        : Tensor_slice(dims...)
+    { size = tensor_impl::_calc_strides_col(extents, strides); }
+
+    /**
+     * @brief Tensor_slice ctor. Column-major, extents as array.
+     * @param exts.
+     */
+    Tensor_slice(Col_major_t, const std::array<std::size_t, N>& exts)
+        : Tensor_slice(exts)
+    { size = tensor_impl::_calc_strides_col(extents, strides); }
+
+    /**
+     * @brief col_major. Check if the first index is the
+     *        contiguous one (and the others follow in order).
+     * @return true if it is, false otherwise.
+     */
+    bool
+    col_major() const
+    {
+        std::array<std::size_t, N> strs;
+        tensor_impl::_calc_strides_col(extents, strs);
+        return strs == strides;
+    }
+
     /**
      * @brief operator () overload.
      * @param dims... parameter pack
@@ -109,8 +151,7 @@ struct Tensor_slice {
         static_assert (sizeof... (Dims) == N,
                        "tensor_slice<N>::operator(): dimensions mismatch");
 
-        size_t args[N] { size_t(dims)... };
-        return start + std::inner_product(args, args + N, strides.begin(), size_t {0});
+        return tensor_impl::_flat_offset(*this, std::make_index_sequence<N>{}, dims...);
     }
 
     /**
@@ -0,0 +1,246 @@
+#ifndef TILED_H
+#define TILED_H
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+#include "tensor.h"
+#include "tensor_ref.h"
+#include "copy.h"
+#include "parallel.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+/**
+ * @brief The Tiled_tensor class. A matrix stored as BR x BC
+ *        tiles, each of them contiguous and row-major, the
+ *        tiles themselves in row-major order. Neighbours in
+ *        both directions share a few cache lines, so 2D-local
+ *        accesses (stencils, blocked kernels) stay in cache.
+ *        Extents are padded up to whole tiles; padding is
+ *        value-initialized and never visible through
+ *        operator() or to_tensor().
+ */
+template <typename T, std::size_t BR, std::size_t BC = BR>
+class Tiled_tensor {
+public:
+
+    static_assert (BR > 0 && BC > 0, "Tiled_tensor: empty tiles");
+
+    /// Aliases.
+    static constexpr std::size_t order = 2;
+    static constexpr std::size_t tile_size = BR * BC;
+    using value_type = T;
+
+    /// Default ctors.
+    Tiled_tensor() = default;
+    Tiled_tensor(Tiled_tensor&&) = default;
+    Tiled_tensor& operator=(Tiled_tensor&&) = default;
+    Tiled_tensor(const Tiled_tensor&) = default;
+    Tiled_tensor& operator=(const Tiled_tensor&) = default;
+    ~Tiled_tensor() = default;
+
+    /**
+     * @brief Tiled_tensor ctor. r x c value-initialized elements.
+     * @param r
+     * @param c
+     */
+    Tiled_tensor(std::size_t r, std::size_t c)
+        : _rows{r},
+          _cols{c},
+          _tiles(_blocks(r, BR), _blocks(c, BC), BR, BC)
+    {}
+
+    /**
+     * @brief Tiled_tensor ctor. Copy of a matrix (Tensor or
+     *        Tensor_ref, any layout).
+     * @param m
+     */
+    template <typename M,
+              typename = Enable_if<(_2d<M>())>>
+    explicit Tiled_tensor(const M& m)
+        : Tiled_tensor(m.rows(), m.cols())
+    {
+        const auto& md = m.descriptor();
+        _for_each_tile(_tiles.data(), [&](std::size_t i0, std::size_t j0,
+                                          std::size_t h, std::size_t w, T* tile) {
+            Tensor_slice<2> src(md.start + i0 * md.strides[0] + j0 * md.strides[1],
+                                {h, w}, {md.strides[0], md.strides[1]});
+            tensor_impl::_copy(m.data(), src, tile, Tensor_slice<2>(0, {h, w}, {BC, 1}));
+        });
+    }
+
+    /**
+     * @brief rows.
+     * @return number of rows.
+     */
+    std::size_t
+    rows() const
+    { return _rows; }
+
+    /**
+     * @brief cols.
+     * @return number of cols.
+     */
+    std::size_t
+    cols() const
+    { return _cols; }
+
+    /**
+     * @brief size.
+     * @return number of elements (padding excluded).
+     */
+    std::size_t
+    size() const
+    { return _rows * _cols; }
+
+    /**
+     * @brief tile_rows.
+     * @return number of tiles along the rows.
+     */
+    std::size_t
+    tile_rows() const
+    { return _tiles.extent(0); }
+
+    /**
+     * @brief tile_cols.
+     * @return number of tiles along the cols.
+     */
+    std::size_t
+    tile_cols() const
+    { return _tiles.extent(1); }
+
+    /// Access to elements
+    T&
+    operator()(std::size_t i, std::size_t j)
+    {
+        assert(i < _rows && j < _cols);
+        return _tiles.data()[_offset(i, j)];
+    }
+
+    /// Access to elements (const)
+    const T&
+    operator()(std::size_t i, std::size_t j) const
+    {
+        assert(i < _rows && j < _cols);
+        return _tiles.data()[_offset(i, j)];
+    }
+
+    /**
+     * @brief tile. Get a contiguous BR x BC tile, padding
+     *        included.
+     * @param bi
+     * @param bj
+     * @return Tensor_ref<T, 2>.
+     */
+    Tensor_ref<T, 2>
+    tile(std::size_t bi, std::size_t bj)
+    {
+        assert(bi < tile_rows() && bj < tile_cols());
+        return {Tensor_slice<2>((bi * tile_cols() + bj) * tile_size, {BR, BC}),
+                _tiles.data()};
+    }
+
+    /**
+     * @brief tile. Get a contiguous BR x BC tile (const).
+     * @param bi
+     * @param bj
+     * @return Tensor_ref<const T, 2>.
+     */
+    Tensor_ref<const T, 2>
+    tile(std::size_t bi, std::size_t bj) const
+    {
+        assert(bi < tile_rows() && bj < tile_cols());
+        return {Tensor_slice<2>((bi * tile_cols() + bj) * tile_size, {BR, BC}),
+                _tiles.data()};
+    }
+
+    /**
+     * @brief tiles. The storage, as a 4-D tensor indexed by
+     *        (tile row, tile col, row in tile, col in tile).
+     * @return const reference to the tiles.
+     */
+    const Tensor<T, 4>&
+    tiles() const
+    { return _tiles; }
+
+    /**
+     * @brief apply. Apply the predicate f to all elements,
+     *        padding included.
+     * @param f
+     * @return *this.
+     */
+    template <typename F>
+    Tiled_tensor&
+    apply(F f)
+    {
+        _tiles.apply(f);
+        return *this;
+    }
+
+    /**
+     * @brief to_tensor. Copy to a row-major matrix.
+     * @return Tensor<T, 2>.
+     */
+    Tensor<T, 2>
+    to_tensor() const
+    {
+        Tensor<T, 2> result(uninitialized, _rows, _cols);
+        T* d = result.data();
+        const std::size_t c = _cols;
+        _for_each_tile(_tiles.data(), [&](std::size_t i0, std::size_t j0,
+                                          std::size_t h, std::size_t w, const T* tile) {
+            tensor_impl::_copy(tile, Tensor_slice<2>(0, {h, w}, {BC, 1}),
+                               d, Tensor_slice<2>(i0 * c + j0, {h, w}, {c, 1}));
+        });
+        return result;
+    }
+
+private:
+
+    static std::size_t
+    _blocks(std::size_t n, std::size_t b)
+    { return (n + b - 1) / b; }
+
+    /// Position of (i, j); BR, BC are constants, so powers of
+    /// two turn divisions into shifts.
+    std::size_t
+    _offset(std::size_t i, std::size_t j) const
+    {
+        return ((i / BR) * tile_cols() + j / BC) * tile_size
+                + (i % BR) * BC + j % BC;
+    }
+
+    /// Call f(i0, j0, h, w, tile) on the visible part of every
+    /// tile of base, in parallel on large matrices.
+    template <typename P, typename F>
+    void
+    _for_each_tile(P* base, F f) const
+    {
+        const std::size_t tc = tile_cols();
+        tensor_impl::_parallel_for(tile_rows() * tc,
+                                   std::max<std::size_t>(tensor_impl::_parallel_grain / tile_size, 1),
+                                   [&](std::size_t b, std::size_t e) {
+            for (std::size_t t = b; t < e; ++t) {
+                const std::size_t i0 = (t / tc) * BR, j0 = (t % tc) * BC;
+                f(i0, j0, std::min(BR, _rows - i0), std::min(BC, _cols - j0),
+                  base + t * tile_size);
+            }
+        });
+    }
+
+    std::size_t _rows = 0;
+    std::size_t _cols = 0;
+
+    /// Tiles
+    Tensor<T, 4> _tiles;
+};
+
+NUM_END
+
+#endif // TILED_H
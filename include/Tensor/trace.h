@@ -0,0 +1,460 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Opt-in tracing of tensor operations. Define TENSOR_TRACING
+ * before including the library to record, for every traced
+ * operation, its wall time, thread, element count, bytes
+ * touched and shapes; then export them with
+ *
+ *     Math::Tracer::instance().save("trace.json");
+ *
+ * and open the file in chrome://tracing or Perfetto. Without
+ * TENSOR_TRACING the TENSOR_TRACE macro expands to nothing
+ * and none of the classes below exist.
+ */
+
+#ifdef TENSOR_TRACING
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "tensor_slice.h"
+#include "traits.h"
+
+#include "../macros.h"
+
+NUM_BEGIN
+
+
+namespace tensor_impl {
+
+/// Events in a chunk of a thread buffer.
+constexpr std::size_t _trace_chunk = 4096;
+
+/// Shapes kept by an event, and dimensions for all of them.
+constexpr std::size_t _trace_shapes = 3;
+constexpr std::size_t _trace_dims = 12;
+
+};
+
+/**
+ * @brief The Trace_event struct. One traced operation.
+ *        Times are in nanoseconds since the tracer started.
+ */
+struct Trace_event {
+    const char* name;
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::size_t elements;
+    std::size_t bytes;
+
+    /// Rank of each shape (0 for none), extents of all of
+    /// them one after the other.
+    std::array<std::uint8_t, tensor_impl::_trace_shapes> ranks;
+    std::array<std::size_t, tensor_impl::_trace_dims> dims;
+};
+
+/**
+ * @brief The Trace_count struct. Explicit counts for a scope
+ *        not made of whole tensors (copies of views, storage).
+ */
+struct Trace_count {
+    std::size_t elements;
+    std::size_t bytes;
+};
+
+/**
+ * @brief The Trace_buffer class. Events of one thread, in a
+ *        list of chunks that never move. Only the owner
+ *        appends; readers see the events published by the
+ *        release store of the chunk size, so recording takes
+ *        no lock.
+ */
+class Trace_buffer {
+public:
+
+    explicit Trace_buffer(std::uint32_t tid)
+        : _tid{tid},
+          _head{new _Chunk},
+          _tail{_head}
+    {}
+
+    Trace_buffer(const Trace_buffer&) = delete;
+    Trace_buffer& operator=(const Trace_buffer&) = delete;
+
+    ~Trace_buffer()
+    { _free(_head); }
+
+    /**
+     * @brief push. Append an event (owner thread only).
+     * @param e
+     */
+    void
+    push(const Trace_event& e)
+    {
+        std::size_t n = _tail->size.load(std::memory_order_relaxed);
+        if (n == tensor_impl::_trace_chunk) {
+            _Chunk* c = new _Chunk;
+            _tail->next.store(c, std::memory_order_release);
+            _tail = c;
+            n = 0;
+        }
+        _tail->events[n] = e;
+        _tail->size.store(n + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief for_each. Call f on every published event.
+     * @param f
+     */
+    template <typename F>
+    void
+    for_each(F f) const
+    {
+        for (const _Chunk* c = _head; c; c = c->next.load(std::memory_order_acquire)) {
+            const std::size_t n = c->size.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < n; ++i)
+                f(c->events[i]);
+        }
+    }
+
+    /**
+     * @brief clear. Drop all events; the owner must not be
+     *        recording.
+     */
+    void
+    clear()
+    {
+        _free(_head->next.exchange(nullptr));
+        _head->size.store(0);
+        _tail = _head;
+    }
+
+    /**
+     * @brief tid.
+     * @return the thread number, in order of first event.
+     */
+    std::uint32_t
+    tid() const
+    { return _tid; }
+
+private:
+
+    struct _Chunk {
+        std::array<Trace_event, tensor_impl::_trace_chunk> events;
+        std::atomic<std::size_t> size{0};
+        std::atomic<_Chunk*> next{nullptr};
+    };
+
+    static void
+    _free(_Chunk* c)
+    {
+        while (c) {
+            _Chunk* n = c->next.load();
+            delete c;
+            c = n;
+        }
+    }
+
+    std::uint32_t _tid;
+    _Chunk* _head;
+    _Chunk* _tail;
+};
+
+/**
+ * @brief The Tracer class. Registry of the thread buffers
+ *        and export. A thread takes the lock once, to
+ *        register its buffer at its first event.
+ */
+class Tracer {
+public:
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /**
+     * @brief instance. The tracer used by the library.
+     * @return reference to the tracer.
+     */
+    static Tracer&
+    instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    /// Resume and pause recording (on by default).
+    void
+    start()
+    { _active.store(true, std::memory_order_relaxed); }
+
+    void
+    stop()
+    { _active.store(false, std::memory_order_relaxed); }
+
+    /**
+     * @brief active.
+     * @return true if events are recorded.
+     */
+    bool
+    active() const
+    { return _active.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief now.
+     * @return nanoseconds since the tracer was created.
+     */
+    std::uint64_t
+    now() const
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - _epoch).count());
+    }
+
+    /**
+     * @brief local.
+     * @return the buffer of the calling thread.
+     */
+    Trace_buffer&
+    local()
+    {
+        thread_local Trace_buffer* b = _register();
+        return *b;
+    }
+
+    /**
+     * @brief clear. Drop all events. No traced operation may
+     *        be running.
+     */
+    void
+    clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& b : _buffers)
+            b->clear();
+    }
+
+    /**
+     * @brief size.
+     * @return number of recorded events.
+     */
+    std::size_t
+    size() const
+    {
+        std::size_t n = 0;
+        _for_each([&](const Trace_buffer&, const Trace_event&) { ++n; });
+        return n;
+    }
+
+    /**
+     * @brief write_chrome. Write the events in the Chrome
+     *        trace event format ("X" events, microseconds).
+     * @param os
+     */
+    void
+    write_chrome(std::ostream& os) const
+    {
+        os << "{\"traceEvents\":[";
+        bool first = true;
+        _for_each([&](const Trace_buffer& b, const Trace_event& e) {
+            os << (first ? "\n" : ",\n");
+            first = false;
+            os << "{\"name\":\"";
+            _escape(os, e.name);
+            os << "\",\"cat\":\"tensor\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b.tid()
+               << ",\"ts\":" << e.begin / 1000 << '.' << _frac(e.begin)
+               << ",\"dur\":" << (e.end - e.begin) / 1000 << '.' << _frac(e.end - e.begin)
+               << ",\"args\":{\"elements\":" << e.elements
+               << ",\"bytes\":" << e.bytes << ",\"shapes\":\"";
+            for (std::size_t s = 0, d = 0; s < e.ranks.size() && e.ranks[s]; ++s) {
+                os << (s ? " [" : "[");
+                for (std::size_t i = 0; i < e.ranks[s]; ++i, ++d)
+                    os << (i ? "x" : "") << e.dims[d];
+                os << ']';
+            }
+            os << "\"}}";
+        });
+        os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    }
+
+    /**
+     * @brief save. Write the Chrome trace to a file.
+     * @param path
+     * @return true on success, false otherwise.
+     */
+    bool
+    save(const std::string& path) const
+    {
+        std::ofstream os(path);
+        write_chrome(os);
+        return bool(os);
+    }
+
+private:
+
+    Tracer()
+        : _epoch{std::chrono::steady_clock::now()}
+    {}
+
+    Trace_buffer*
+    _register()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _buffers.push_back(std::make_unique<Trace_buffer>(std::uint32_t(_buffers.size())));
+        return _buffers.back().get();
+    }
+
+    template <typename F>
+    void
+    _for_each(F f) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& b : _buffers)
+            b->for_each([&](const Trace_event& e) { f(*b, e); });
+    }
+
+    static void
+    _escape(std::ostream& os, const char* s)
+    {
+        for (; *s; ++s) {
+            if (*s == '"' || *s == '\\')
+                os << '\\';
+            os << *s;
+        }
+    }
+
+    static std::string
+    _frac(std::uint64_t ns)
+    {
+        std::string r = std::to_string(ns % 1000);
+        return std::string(3 - r.size(), '0') + r;
+    }
+
+    std::chrono::steady_clock::time_point _epoch;
+    std::atomic<bool> _active{true};
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Trace_buffer>> _buffers;
+};
+
+/**
+ * @brief The Trace_scope class. Records an event from its
+ *        construction to its destruction, on the buffer of
+ *        the calling thread. Use the TENSOR_TRACE macros.
+ */
+class Trace_scope {
+public:
+
+    /**
+     * @brief Trace_scope ctor. Elements of the first tensor,
+     *        bytes and shapes of all of them.
+     * @param name a string literal.
+     * @param ms tensors.
+     */
+    template <typename... Ms>
+    explicit Trace_scope(const char* name, const Ms&... ms)
+        : _active{Tracer::instance().active()}
+    {
+        if (!_active)
+            return;
+        _init(name);
+        _e.elements = _first_size(ms...);
+        _e.bytes = (std::size_t{0} + ... + (ms.descriptor().size * sizeof(Value_type<Ms>)));
+        (_shape(ms.descriptor()), ...);
+        _e.begin = Tracer::instance().now();
+    }
+
+    /**
+     * @brief Trace_scope ctor. Explicit counts, shapes from
+     *        descriptors.
+     * @param name a string literal.
+     * @param c
+     * @param ds Tensor_slice.
+     */
+    template <typename... Ds>
+    Trace_scope(const char* name, Trace_count c, const Ds&... ds)
+        : _active{Tracer::instance().active()}
+    {
+        if (!_active)
+            return;
+        _init(name);
+        _e.elements = c.elements;
+        _e.bytes = c.bytes;
+        (_shape(ds), ...);
+        _e.begin = Tracer::instance().now();
+    }
+
+    Trace_scope(const Trace_scope&) = delete;
+    Trace_scope& operator=(const Trace_scope&) = delete;
+
+    ~Trace_scope()
+    {
+        if (!_active)
+            return;
+        auto& t = Tracer::instance();
+        _e.end = t.now();
+        t.local().push(_e);
+    }
+
+private:
+
+    void
+    _init(const char* name)
+    {
+        _e.name = name;
+        _e.ranks.fill(0);
+    }
+
+    static std::size_t
+    _first_size()
+    { return 0; }
+
+    template <typename M, typename... Ms>
+    static std::size_t
+    _first_size(const M& m, const Ms&...)
+    { return m.descriptor().size; }
+
+    /// Keep a shape if there is room for it.
+    template <std::size_t N>
+    void
+    _shape(const Tensor_slice<N>& d)
+    {
+        if (_s == _e.ranks.size() || _d + N > _e.dims.size() || N > 255)
+            return;
+        _e.ranks[_s++] = std::uint8_t(N);
+        for (std::size_t i = 0; i < N; ++i)
+            _e.dims[_d++] = d.extents[i];
+    }
+
+    Trace_event _e;
+    bool _active;
+    std::size_t _s = 0;
+    std::size_t _d = 0;
+};
+
+NUM_END
+
+#define TENSOR_TRACE_CAT_(a, b) a##b
+#define TENSOR_TRACE_CAT(a, b) TENSOR_TRACE_CAT_(a, b)
+
+/// Trace the enclosing scope:
+///     TENSOR_TRACE("name", tensors...), or
+///     TENSOR_TRACE("name", Trace_count{elements, bytes}, descriptors...).
+#define TENSOR_TRACE(...) \
+    ::Math::Trace_scope TENSOR_TRACE_CAT(_tensor_trace_, __LINE__)(__VA_ARGS__)
+
+#else
+
+#define TENSOR_TRACE(...) ((void)0)
+
+#endif // TENSOR_TRACING
+
+#endif // TRACE_H
@@ -14,6 +14,10 @@ NUM_BEGIN
 template <bool B, typename T = void>
 using Enable_if = typename std::enable_if<B, T>::type;
 
+/// Element type of a Tensor or Tensor_ref, without const.
+template <typename M>
+using Value_type = typename std::remove_const<typename M::value_type>::type;
+
 /// Element to create a "false" case.
 struct _failure
 {};
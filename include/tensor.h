@@ -2,11 +2,36 @@
 #define TENSOR_I_H
 
 #include "Tensor/tensor.h"
+#include "Tensor/trace.h"
 #include "Tensor/tensor_ref.h"
 #include "Tensor/tensor_slice.h"
+#include "Tensor/iteration.h"
+#include "Tensor/cursor.h"
+#include "Tensor/copy.h"
+#include "Tensor/parallel.h"
+#include "Tensor/storage.h"
+#include "Tensor/layout.h"
+#include "Tensor/tiled.h"
+#include "Tensor/gemm.h"
 #include "Tensor/operands.h"
+#include "Tensor/map.h"
+#include "Tensor/vmath.h"
+#include "Tensor/softmax.h"
+#include "Tensor/mask.h"
+#include "Tensor/gather.h"
+#include "Tensor/reduction.h"
+#include "Tensor/scan.h"
+#include "Tensor/sort.h"
+#include "Tensor/random.h"
+#include "Tensor/linalg.h"
+#include "Tensor/io.h"
+#include "Tensor/chunked.h"
+#include "Tensor/async.h"
 #include "Tensor/tensor_initializer.h"
 #include "Tensor/aliases.h"
+#include "Tensor/half.h"
+#include "Tensor/quantized.h"
+#include "Tensor/lazy.h"
 
 
 #endif // TENSOR_I_H
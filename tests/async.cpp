@@ -0,0 +1,67 @@
+// Async tasks: kernels on the caller keep running while tasks
+// hold the workers.
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+int
+main()
+{
+    /// One worker besides the caller.
+    setenv("TENSOR_NUM_THREADS", "2", 1);
+    using clock = std::chrono::steady_clock;
+
+    Tensor<double, 2> a(uninitialized, 300, 300), b(uninitialized, 300, 300);
+    fill_uniform(a, Philox(1));
+    fill_uniform(b, Philox(2));
+    Tensor<double, 2> ref = a * b;
+
+    /// A task that holds the worker until released (10 s at most).
+    std::atomic<bool> release{false};
+    auto busy = run_async([&] {
+        const auto limit = clock::now() + std::chrono::seconds(10);
+        while (!release && clock::now() < limit)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return 1;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    const auto t0 = clock::now();
+    Tensor<double, 2> c = a * b;
+    Tensor<double, 1> big(uninitialized, std::size_t{1} << 22);
+    big.fill(3.0);
+    const double s = sum<double>(big);
+    const double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    release = true;
+
+    check(elapsed < 5, "kernels do not wait for the busy worker");
+    check(c == ref, "matmul next to a task");
+    check(s == 3.0 * double(big.size()), "fill and sum next to a task");
+    check(busy.get() == 1, "task result");
+
+    /// Overlap: a product while a task works on other data.
+    auto t = async_matmul(a, b);
+    Tensor<double, 2> d = b * a;
+    check(t.get() == ref, "async_matmul");
+    check(d.size() == ref.size(), "matmul while async_matmul runs");
+
+    if (failures == 0)
+        std::printf("async: ok (%.3f s next to a busy worker)\n", elapsed);
+    return failures == 0 ? 0 : 1;
+}
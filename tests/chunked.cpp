@@ -0,0 +1,164 @@
+// Chunked files: round trips, boxes, and damaged files.
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static const char* path = "chunked_test.tnc";
+
+static std::string
+slurp()
+{
+    std::ifstream is(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+}
+
+static void
+spit(const std::string& s)
+{
+    std::ofstream os(path, std::ios::binary);
+    os.write(s.data(), std::streamsize(s.size()));
+}
+
+template <typename T>
+static void
+put(std::string& s, std::size_t at, T x)
+{ std::memcpy(&s[at], &x, sizeof(x)); }
+
+/// Damaged copies of a valid file must be refused, not crash.
+static bool
+refused(const std::string& s)
+{
+    spit(s);
+    Chunked_file<float, 2> f(path);
+    Tensor<float, 2> t;
+    return !f.is_open() || !f.read(t);
+}
+
+int
+main()
+{
+    /// Compressible (smooth, quantized) and incompressible data.
+    Tensor<float, 3> smooth(uninitialized, 37, 50, 23);
+    for (std::size_t i = 0; i < 37; ++i)
+        for (std::size_t j = 0; j < 50; ++j)
+            for (std::size_t k = 0; k < 23; ++k)
+                smooth(i, j, k) = std::round(std::sin(0.1 * double(i + j)) * 64) / 64 + float(k);
+    Tensor<float, 3> noise(uninitialized, 37, 50, 23);
+    fill_uniform(noise, Philox(1));
+
+    for (Chunk_codec codec : {Chunk_codec::raw, Chunk_codec::lz, Chunk_codec::shuffle_lz})
+        for (const Tensor<float, 3>* t : {&smooth, &noise}) {
+            /// Edge tiles are 5 x 2 x 3.
+            check(save_chunked(path, *t, {8, 16, 5}, codec), "save_chunked");
+            Tensor<float, 3> back;
+            check(load_chunked(path, back) && back == *t, "round trip");
+
+            Chunked_file<float, 3> f(path);
+            check(f.is_open() && f.chunks() == 5 * 4 * 5 && f.codec() == codec, "open");
+            Tensor<float, 3> box;
+            check(f.read({3, 10, 2}, {30, 40, 21}, box), "read a box");
+            bool same = true;
+            for (std::size_t i = 0; i < 30; ++i)
+                for (std::size_t j = 0; j < 40; ++j)
+                    for (std::size_t k = 0; k < 21; ++k)
+                        same = same && box(i, j, k) == (*t)(3 + i, 10 + j, 2 + k);
+            check(same, "box contents");
+            check(!f.read({30, 0, 0}, {8, 1, 1}, box), "box out of the tensor");
+        }
+
+    /// Into views: column-major and strided.
+    {
+        Tensor<double, 2> m(uninitialized, 45, 70);
+        fill_normal(m, Philox(2));
+        check(save_chunked(path, m, {16, 16}), "save_chunked 2-D");
+        Chunked_file<double, 2> f(path);
+        Tensor<double, 2> cm(col_major, 20, 33);
+        check(f.read_into({7, 30}, cm), "read_into column-major");
+        bool same = true;
+        for (std::size_t i = 0; i < 20; ++i)
+            for (std::size_t j = 0; j < 33; ++j)
+                same = same && cm(i, j) == m(7 + i, 30 + j);
+        check(same, "read_into column-major contents");
+
+        Tensor<double, 3> big(3, 45, 70);
+        check(f.read_into({0, 0}, big.slice<0>(1)), "read_into a slice");
+        Tensor<double, 3> wide(45, 4, 70);
+        check(f.read_into({0, 0}, wide.slice<1>(2)), "read_into a strided slice");
+        same = true;
+        for (std::size_t i = 0; i < 45; ++i)
+            for (std::size_t j = 0; j < 70; ++j)
+                same = same && big(1, i, j) == m(i, j) && wide(i, 2, j) == m(i, j) &&
+                       big(0, i, j) == 0 && wide(i, 1, j) == 0;
+        check(same, "read_into slices contents");
+    }
+
+    /// Damaged files.
+    {
+        Tensor<float, 2> m(uninitialized, 40, 30);
+        for (std::size_t i = 0; i < m.size(); ++i)
+            m.data()[i] = float(i % 17);
+        check(save_chunked(path, m, {16, 16}), "save_chunked small");
+        const std::string good = slurp();
+        const std::size_t exts = 16, chunk = exts + 16, index = chunk + 16;
+
+        bool ok = true;
+        for (std::size_t n = 0; n < good.size(); ++n)
+            ok = ok && refused(good.substr(0, n));
+        check(ok, "truncated files");
+
+        std::string s = good;
+        put(s, exts, std::uint64_t{1} << 40);
+        put(s, exts + 8, std::uint64_t{1} << 40);
+        put(s, chunk, std::uint64_t{1});
+        put(s, chunk + 8, std::uint64_t{1});
+        check(refused(s), "huge extents, 1 x 1 tiles");
+
+        s = good;
+        put(s, exts, std::uint64_t{1} << 62);
+        put(s, chunk, std::uint64_t{1});
+        check(refused(s), "grid count overflowing");
+
+        s = good;
+        put(s, index + 8, std::uint64_t{1} << 50);
+        check(refused(s), "tile size larger than the file");
+
+        s = good;
+        put(s, index, std::uint64_t(good.size()));
+        check(refused(s), "tile offset past the end");
+
+        s = good;
+        put(s, index + 16, std::uint64_t{0});
+        check(refused(s), "tile offset inside the header");
+
+        s = good;
+        for (std::size_t i = s.size() - 40; i < s.size(); ++i)
+            s[i] = char(s[i] ^ 0x5a);
+        spit(s);
+        Chunked_file<float, 2> f(path);
+        Tensor<float, 2> t;
+        check(f.is_open() && (!f.read(t) || t.size() == m.size()), "corrupted tile bytes");
+    }
+
+    std::remove(path);
+    if (failures == 0)
+        std::printf("chunked: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+// Gather / scatter along an axis against element-wise loops.
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+    std::uint32_t seed = 7;
+    auto next = [&] { return seed = seed * 1664525u + 1013904223u, seed >> 8; };
+
+    /// take along each dimension, row and column-major.
+    Tensor<float, 3> a(uninitialized, 6, 9, 40);
+    fill_uniform(a, Philox(1));
+    Tensor<float, 3> ac(col_major, 6, 9, 40);
+    for (std::size_t i = 0; i < 6; ++i)
+        for (std::size_t j = 0; j < 9; ++j)
+            for (std::size_t k = 0; k < 40; ++k)
+                ac(i, j, k) = a(i, j, k);
+    for (const Tensor<float, 3>* in : {&a, &ac}) {
+        Tensor<std::int32_t, 2> i0(4, 5), i1(4, 5), i2(4, 5);
+        for (auto& v : i0) v = std::int32_t(next() % 6);
+        for (auto& v : i1) v = std::int32_t(next() % 9);
+        for (auto& v : i2) v = std::int32_t(next() % 40);
+        const auto o0 = take<0>(*in, i0);
+        const auto o1 = take<1>(*in, i1);
+        const auto o2 = take<2>(*in, i2);
+        bool ok = true;
+        for (std::size_t p = 0; p < 4; ++p)
+            for (std::size_t q = 0; q < 5; ++q)
+                for (std::size_t x = 0; x < 6; ++x)
+                    for (std::size_t y = 0; y < 9; ++y)
+                        for (std::size_t z = 0; z < 40; ++z) {
+                            if (x == 0)
+                                ok = ok && o0(p, q, y, z) == a(i0(p, q), y, z);
+                            if (y == 0)
+                                ok = ok && o1(x, p, q, z) == a(x, i1(p, q), z);
+                            if (z == 0)
+                                ok = ok && o2(x, y, p, q) == a(x, y, i2(p, q));
+                        }
+        check(ok, "take along each dimension");
+    }
+
+    /// A vector: one thin slice, split by index.
+    {
+        Tensor<double, 1> v(uninitialized, 1000);
+        for (std::size_t i = 0; i < v.size(); ++i)
+            v(i) = double(i);
+        Tensor<std::uint32_t, 1> ids(uninitialized, std::size_t{1} << 20);
+        for (auto& x : ids)
+            x = next() % 1000;
+        Tensor<double, 1> out(uninitialized, ids.size());
+        gather<0>(out, v, ids);
+        bool ok = true;
+        for (std::size_t j = 0; j < ids.size(); ++j)
+            ok = ok && out(j) == double(ids(j));
+        check(ok, "take from a vector");
+    }
+
+    /// scatter, every mode, repeated indices, wide and thin slices.
+    for (std::size_t c : {1, 3, 64, 200}) {
+        const std::size_t e = 37, m = 500;
+        Tensor<std::int64_t, 1> ids(m);
+        for (auto& x : ids)
+            x = std::int64_t(next() % e);
+        Tensor<double, 2> src(uninitialized, m, c), base(uninitialized, e, c);
+        fill_normal(src, Philox(5));
+        fill_normal(base, Philox(6));
+        for (Scatter mode : {Scatter::last, Scatter::first, Scatter::add,
+                             Scatter::max, Scatter::min}) {
+            Tensor<double, 2> out = base, ref = base;
+            scatter<0>(out, ids, src, mode);
+            std::vector<bool> seen(e);
+            for (std::size_t j = 0; j < m; ++j) {
+                const std::size_t d = std::size_t(ids(j));
+                for (std::size_t k = 0; k < c; ++k) {
+                    double& r = ref(d, k);
+                    const double s = src(j, k);
+                    switch (mode) {
+                    case Scatter::last:  r = s; break;
+                    case Scatter::first: r = seen[d] ? r : s; break;
+                    case Scatter::add:   r += s; break;
+                    case Scatter::max:   r = std::max(r, s); break;
+                    case Scatter::min:   r = std::min(r, s); break;
+                    }
+                }
+                seen[d] = true;
+            }
+            check(out == ref, "scatter");
+        }
+    }
+
+    /// scatter into a vector: one thin slice, split by destination.
+    {
+        const std::size_t e = 5000, m = std::size_t{1} << 20;
+        Tensor<std::uint32_t, 1> ids(uninitialized, m);
+        for (auto& x : ids)
+            x = next() % e;
+        Tensor<double, 1> src(uninitialized, m);
+        fill_normal(src, Philox(7));
+        for (Scatter mode : {Scatter::first, Scatter::add}) {
+            Tensor<double, 1> out(e), ref(e);
+            std::vector<bool> seen(e);
+            scatter<0>(out, ids, src, mode);
+            for (std::size_t j = 0; j < m; ++j) {
+                const std::size_t d = ids(j);
+                if (mode == Scatter::add)
+                    ref(d) += src(j);
+                else if (!seen[d])
+                    ref(d) = src(j);
+                seen[d] = true;
+            }
+            check(out == ref, "scatter into a vector");
+        }
+    }
+
+    if (failures == 0)
+        std::printf("gather: ok\n");
+    return failures == 0 ? 0 : 1;
+}
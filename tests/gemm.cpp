@@ -0,0 +1,212 @@
+// gemm against a scalar loop for every micro-kernel, layouts and
+// views, and the loading of the parameters cache file.
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <unistd.h>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static std::uint64_t state = 88172645463325252ull;
+
+/// Small integers, so that every product is exact.
+template <typename M>
+static void
+ints(M&& m)
+{
+    for (std::size_t i = 0; i < m.rows(); ++i)
+        for (std::size_t j = 0; j < m.cols(); ++j) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            m(i, j) = Value_type<std::remove_reference_t<M>>(int(state % 17) - 8);
+        }
+}
+
+/// c = alpha a b + beta c0, exactly, compared with the c of gemm.
+template <typename C, typename A, typename B, typename C0, typename T>
+static bool
+same(const C& c, const A& a, const B& b, const C0& c0, T alpha, T beta)
+{
+    bool ok = true;
+    for (std::size_t i = 0; i < c.rows(); ++i)
+        for (std::size_t j = 0; j < c.cols(); ++j) {
+            T s = T(0);
+            for (std::size_t p = 0; p < a.cols(); ++p)
+                s += a(i, p) * b(p, j);
+            ok = ok && c(i, j) == (beta == T(0) ? alpha * s : alpha * s + beta * c0(i, j));
+        }
+    return ok;
+}
+
+/// Sizes around the register tiles and the blocks of p, alpha and
+/// beta, with a row-major and a column-major (transposed) operand.
+template <typename T>
+static void
+products(const Gemm_params& p)
+{
+    set_gemm_params<T>(p);
+    const std::size_t sizes[][3] = {{1, 1, 1}, {7, 9, 5}, {33, 41, 37}, {67, 131, 45},
+                                    {130, 29, 300}, {5, 300, 70}, {97, 97, 97}};
+    for (const auto& s : sizes) {
+        const std::size_t m = s[0], n = s[1], k = s[2];
+        Tensor<T, 2> a(m, k), bt(col_major, k, n), c0(m, n);
+        ints(a);
+        ints(bt);
+        ints(c0);
+
+        Tensor<T, 2> c = c0;
+        gemm(c, a, bt);
+        check(same(c, a, bt, c0, T(1), T(0)), "gemm: c = a b");
+
+        c = c0;
+        gemm(c, a, bt, T(2), T(-3));
+        check(same(c, a, bt, c0, T(2), T(-3)), "gemm: alpha, beta");
+
+        /// beta = 0 does not read c.
+        Tensor<T, 2> nan(m, n);
+        nan = std::numeric_limits<T>::quiet_NaN();
+        gemm(nan, a, bt, T(-1));
+        check(same(nan, a, bt, c0, T(-1), T(0)), "gemm: beta 0, c not read");
+
+        /// Column-major a, strided view of b, column-major c and
+        /// a strided view of c.
+        Tensor<T, 2> at(col_major, m, k), cm(col_major, m, n);
+        Tensor<T, 3> bbig(k, 3, n), cbig(m, 2, n);
+        for (std::size_t i = 0; i < m; ++i)
+            for (std::size_t j = 0; j < k; ++j)
+                at(i, j) = a(i, j);
+        auto bv = bbig.template slice<1>(2);
+        auto cv = cbig.template slice<1>(1);
+        ints(bv);
+        for (std::size_t i = 0; i < m; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                cm(i, j) = cv(i, j) = c0(i, j);
+        gemm(cm, at, bv, T(3), T(2));
+        check(same(cm, at, bv, c0, T(3), T(2)), "gemm: column-major c, views");
+        gemm(cv, at, bt, T(1), T(1));
+        check(same(cv, at, bt, c0, T(1), T(1)), "gemm: c view");
+        bool untouched = true;
+        for (std::size_t i = 0; i < m; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                untouched = untouched && cbig(i, 0, j) == T(0);
+        check(untouched, "gemm: rest of the view untouched");
+    }
+}
+
+/// Child: the parameters loaded from the cache file, and a product.
+static int
+child()
+{
+    Tensor<float, 2> a(40, 50), b(50, 60), c(40, 60);
+    ints(a);
+    ints(b);
+    gemm(c, a, b);
+    const Gemm_params f = gemm_params<float>(), d = gemm_params<double>();
+    std::printf("%zu %zu %zu %zu %zu %zu %zu %zu %d\n", f.mc, f.kc, f.nc, f.kernel,
+                d.mc, d.kc, d.nc, d.kernel, int(same(c, a, b, c, 1.0f, 0.0f)));
+    return 0;
+}
+
+static std::string
+run(const char* self, const std::string& cache, const char* arg = "child")
+{
+    setenv("TENSOR_GEMM_CACHE", cache.c_str(), 1);
+    const std::string cmd = std::string(self) + " " + arg;
+    FILE* p = popen(cmd.c_str(), "r");
+    std::string out;
+    char buf[256];
+    while (p && std::fgets(buf, sizeof(buf), p))
+        out += buf;
+    check(p && pclose(p) == 0, "child run");
+    return out;
+}
+
+static std::string
+line(const Gemm_params& f, const Gemm_params& d)
+{
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "%zu %zu %zu %zu %zu %zu %zu %zu 1\n", f.mc, f.kc, f.nc,
+                  f.kernel, d.mc, d.kc, d.nc, d.kernel);
+    return buf;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "child")
+        return child();
+    if (argc > 1) {
+        set_gemm_params<float>({48, 128, 1024, 0});
+        return save_gemm_params<float>() ? 0 : 1;
+    }
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+
+    /// Every micro-kernel, small blocks so that products span
+    /// several blocks of m, n and k, then the defaults.
+    for (std::size_t kernel = 0; kernel < gemm_kernels().size(); ++kernel) {
+        products<float>({16, 32, 48, kernel});
+        products<double>({8, 16, 16, kernel});
+    }
+    products<float>(tensor_impl::_gemm_default<float>());
+    products<double>(tensor_impl::_gemm_default<double>());
+    const std::size_t huge = std::numeric_limits<std::size_t>::max();
+    products<float>({huge, huge, huge, 3});
+
+    /// Missing, garbage or invalid cache files: the defaults.
+    const std::string path = "/tmp/tensor_gemm_test_" + std::to_string(getpid());
+    const Gemm_params df = tensor_impl::_gemm_default<float>();
+    const Gemm_params dd = tensor_impl::_gemm_default<double>();
+    std::remove(path.c_str());
+    check(run(argv[0], path) == line(df, dd), "missing cache file");
+    check(run(argv[0], "/tmp") == line(df, dd), "cache path is a directory");
+    {
+        std::ofstream os(path, std::ios::binary);
+        for (int i = 0; i < 4096; ++i)
+            os.put(char(i * 37 + 11));
+    }
+    check(run(argv[0], path) == line(df, dd), "garbage cache file");
+    {
+        std::ofstream os(path);
+        os << "float 0 128 1024 1\nfloat 48 128 1024 4\nfloat 48 128\n"
+              "double x 1 2 3\nfloat -1 128 1024 1\n# double 8 8 8 0\n";
+    }
+    check(run(argv[0], path) == line(df, dd), "invalid cache lines");
+
+    /// A valid line is used, for its type only.
+    {
+        std::ofstream os(path);
+        os << "# comment\nfloat 1 2\nfloat 64 200 2048 2\n";
+    }
+    check(run(argv[0], path) == line({64, 200, 2048, 2}, dd), "valid cache line");
+
+    /// save_gemm_params replaces the line of its type, keeps the others.
+    {
+        std::ofstream os(path);
+        os << "double 32 64 512 0\nfloat 64 200 2048 2\n";
+    }
+    run(argv[0], path, "save");
+    check(run(argv[0], path) == line({48, 128, 1024, 0}, {32, 64, 512, 0}), "saved cache file");
+    std::remove(path.c_str());
+
+    if (failures)
+        return 1;
+    std::printf("gemm: ok\n");
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Reduced precision kernels: gemv and dot on every layout and on views.
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+template <typename H>
+void
+layouts(const char* name)
+{
+    for (std::size_t c : {1, 77, 300}) {
+        const std::size_t r = c == 300 ? 3001 : 301;
+        Tensor<float, 2> f(uninitialized, r, c);
+        fill_uniform(f, Philox(1), -1.f, 1.f);
+        Tensor<H, 2> rm = to_half<H>(f);
+        Tensor<H, 2> cm(col_major, r, c);
+        for (std::size_t i = 0; i < r; ++i)
+            for (std::size_t j = 0; j < c; ++j)
+                cm(i, j) = rm(i, j);
+        Tensor<float, 1> x(uninitialized, c);
+        fill_uniform(x, Philox(2), -1.f, 1.f);
+
+        /// Views: rows strided in a 3-D tensor, x a column.
+        Tensor<H, 3> big(r, 2, c);
+        Tensor<float, 2> xs(c, 3);
+        for (std::size_t i = 0; i < r; ++i)
+            for (std::size_t j = 0; j < c; ++j)
+                big(i, 1, j) = rm(i, j);
+        for (std::size_t j = 0; j < c; ++j)
+            xs(j, 2) = x(j);
+
+        const auto yr = gemv(rm, x);
+        const auto yc = gemv(cm, x);
+        const auto yv = gemv(big.template slice<1>(1), xs.template slice<1>(2));
+        bool ok = yr.size() == r && yc.size() == r && yv.size() == r;
+        for (std::size_t i = 0; ok && i < r; ++i) {
+            double ref = 0, mag = 0;
+            for (std::size_t j = 0; j < c; ++j) {
+                ref += double(float(rm(i, j))) * x(j);
+                mag += std::fabs(double(float(rm(i, j))) * x(j));
+            }
+            ok = std::fabs(yr(i) - ref) <= 1e-5 * mag + 1e-30 &&
+                 std::fabs(yc(i) - ref) <= 1e-5 * mag + 1e-30 &&
+                 std::fabs(yv(i) - ref) <= 1e-5 * mag + 1e-30;
+        }
+        check(ok, name);
+
+        /// dot of a row and of a column with float views.
+        bool dots = true;
+        for (std::size_t i : {std::size_t{0}, r / 2, r - 1}) {
+            double ref = 0, mag = 0;
+            for (std::size_t j = 0; j < c; ++j) {
+                ref += double(float(rm(i, j))) * x(j);
+                mag += std::fabs(double(float(rm(i, j))) * x(j));
+            }
+            dots = dots && std::fabs(dot(rm.template slice<0>(i), x) - ref) <= 1e-5 * mag + 1e-30 &&
+                   std::fabs(dot(cm.template slice<0>(i), xs.template slice<1>(2)) - ref) <=
+                       1e-5 * mag + 1e-30;
+        }
+        check(dots, "dot of views");
+    }
+
+    Tensor<float, 1> a(uninitialized, 1000), b(uninitialized, 1000);
+    fill_uniform(a, Philox(3), -1.f, 1.f);
+    fill_uniform(b, Philox(4), -1.f, 1.f);
+    Tensor<H, 1> ha = to_half<H>(a), hb = to_half<H>(b);
+    double ref = 0, mag = 0;
+    for (std::size_t i = 0; i < 1000; ++i) {
+        ref += double(float(ha(i))) * double(float(hb(i)));
+        mag += std::fabs(double(float(ha(i))) * double(float(hb(i))));
+    }
+    check(std::fabs(dot(ha, hb) - ref) <= 1e-5 * mag, "dot");
+}
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+    layouts<float16>("gemv float16, row and column-major");
+    layouts<bfloat16>("gemv bfloat16, row and column-major");
+
+    if (failures == 0)
+        std::printf("half: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+// Binary tensor files: round trips and damaged streams.
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// A stream buffer over a string that cannot seek (a pipe).
+class Pipe_buf : public std::streambuf {
+public:
+    explicit Pipe_buf(std::string s)
+        : _s{std::move(s)}
+    { setg(&_s[0], &_s[0], &_s[0] + _s.size()); }
+
+private:
+    std::string _s;
+};
+
+/// Header of a float tensor of rank 2 with extents r x c.
+static std::string
+header(std::uint64_t r, std::uint64_t c)
+{
+    std::string h = "TNSR";
+    h += char(1);
+    h += char(0);
+    h += char(sizeof(float));
+    h += char(2);
+    h.append(reinterpret_cast<const char*>(&r), 8);
+    h.append(reinterpret_cast<const char*>(&c), 8);
+    return h;
+}
+
+int
+main()
+{
+    Tensor<float, 2> a(uninitialized, 30, 40);
+    fill_uniform(a, Philox(1));
+    std::ostringstream os;
+    check(write(os, a), "write");
+    const std::string file = os.str();
+
+    {
+        std::istringstream is(file);
+        Tensor<float, 2> b;
+        check(read(is, b) && b == a, "round trip");
+    }
+    {
+        Pipe_buf pb(file);
+        std::istream is(&pb);
+        Tensor<float, 2> b;
+        check(read(is, b) && b == a, "round trip, stream that cannot seek");
+    }
+
+    /// Truncated: t is left untouched.
+    for (bool pipe : {false, true}) {
+        const std::string cut = file.substr(0, file.size() - 7);
+        std::istringstream ss(cut);
+        Pipe_buf pb(cut);
+        std::istream ps(&pb);
+        Tensor<float, 2> b(2, 2);
+        check(!read(pipe ? ps : static_cast<std::istream&>(ss), b) && b.size() == 4,
+              pipe ? "truncated, stream that cannot seek" : "truncated");
+    }
+
+    /// Corrupt extents: rejected before allocating.
+    for (bool pipe : {false, true}) {
+        const std::string bad = header(std::uint64_t{1} << 40, std::uint64_t{1} << 40) +
+                                std::string(64, '\0');
+        std::istringstream ss(bad);
+        Pipe_buf pb(bad);
+        std::istream ps(&pb);
+        Tensor<float, 2> b;
+        check(!read(pipe ? ps : static_cast<std::istream&>(ss), b),
+              pipe ? "huge extents, stream that cannot seek" : "huge extents");
+    }
+    {
+        std::istringstream is(header(std::uint64_t{1} << 62, 16) + std::string(64, '\0'));
+        Tensor<float, 2> b;
+        check(!read(is, b), "extents overflowing size_t");
+    }
+
+    if (failures == 0)
+        std::printf("io: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+// Lazy_graph: fused evaluation against the eager operators.
+#include <cstdio>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+int
+main()
+{
+    /// Division by a scalar stays a division (integers).
+    {
+        Lazy_graph<int, 1> g;
+        Tensor<int, 1> x{ {10, 20, 30, 7} };
+        Tensor<int, 1> r = (g.input(x) / 2).eval();
+        check(r.size() == 4 && r(0) == 5 && r(1) == 10 && r(2) == 15 && r(3) == 3,
+              "int graph: x / 2");
+        Tensor<int, 1> q = (60 / g.input(x)).eval();
+        check(q(0) == 6 && q(1) == 3 && q(2) == 2 && q(3) == 8, "int graph: 60 / x");
+    }
+
+    /// Same rounding as Tensor / s (floats).
+    {
+        Lazy_graph<float, 2> g;
+        Tensor<float, 2> x(uninitialized, 37, 101);
+        fill_uniform(x, Philox(1), -10.f, 10.f);
+        auto lx = g.input(x);
+        Tensor<float, 2> r = ((lx + 1.f) / 3.f).eval();
+        Tensor<float, 2> e = (x + 1.f) / 3.f;
+        bool same = true;
+        for (std::size_t i = 0; i < x.rows(); ++i)
+            for (std::size_t j = 0; j < x.cols(); ++j)
+                same = same && r(i, j) == e(i, j);
+        check(same, "float graph: (x + 1) / 3 matches eager");
+    }
+
+    /// An input as the root is copied.
+    {
+        Lazy_graph<double, 1> g;
+        Tensor<double, 1> x{ {1.5, 2.5, 3.5} };
+        Tensor<double, 1> r = g.input(x).eval();
+        check(r.size() == 3 && r(0) == 1.5 && r(1) == 2.5 && r(2) == 3.5, "root input");
+        r(0) = 0;
+        check(x(0) == 1.5, "root input is a copy");
+
+        Tensor<double, 2> c(col_major, 2, 3);
+        for (std::size_t i = 0; i < 2; ++i)
+            for (std::size_t j = 0; j < 3; ++j)
+                c(i, j) = double(i * 3 + j);
+        Lazy_graph<double, 2> h;
+        Tensor<double, 2> rc = h.input(c).eval();
+        check(rc.size() == 6 && rc(1, 2) == 5 && rc(0, 1) == 1, "root column-major input");
+    }
+
+    if (failures == 0)
+        std::printf("lazy: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// LU and Cholesky: residuals on both sides of the block size, other
+// layouts and views, singular and indefinite matrices.
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// ||a x - b|| / (||a|| ||x||), max norms, b and x of k columns.
+template <typename A, typename X, typename B>
+static double
+residual(const A& a, const X& x, const B& b, std::size_t k)
+{
+    const std::size_t n = a.rows();
+    double r = 0, na = 0, nx = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        double row = 0;
+        for (std::size_t j = 0; j < n; ++j)
+            row += std::fabs(a(i, j));
+        na = std::max(na, row);
+        for (std::size_t c = 0; c < k; ++c) {
+            double s = -b(i, c);
+            for (std::size_t j = 0; j < n; ++j)
+                s += a(i, j) * x(j, c);
+            r = std::max(r, std::fabs(s));
+            nx = std::max(nx, std::fabs(x(i, c)));
+        }
+    }
+    return r / (na * nx);
+}
+
+/// Symmetric positive definite: m m^T + n I.
+static Tensor<double, 2>
+spd(std::size_t n, std::uint64_t seed)
+{
+    Tensor<double, 2> m(uninitialized, n, n), a(n, n);
+    fill_uniform(m, Philox(seed), -1.0, 1.0);
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t j = 0; j < n; ++j) {
+            double s = i == j ? double(n) : 0.0;
+            for (std::size_t c = 0; c < n; ++c)
+                s += m(i, c) * m(j, c);
+            a(i, j) = s;
+        }
+    return a;
+}
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+    const double tol = 1e-13;
+
+    /// LU: general matrices, one and several right-hand sides.
+    for (std::size_t n : {1, 2, 63, 64, 65, 130, 200}) {
+        Tensor<double, 2> a(uninitialized, n, n), b(uninitialized, n, 3);
+        fill_uniform(a, Philox(n), -1.0, 1.0);
+        fill_uniform(b, Philox(n + 1000), -1.0, 1.0);
+
+        Tensor<double, 2> lu = a, x = b;
+        Tensor<std::size_t, 1> piv;
+        check(lu_factor(lu, piv) == 0, "lu_factor: info");
+        check(piv.size() == n, "lu_factor: pivots");
+        lu_solve(lu, piv, x);
+        check(residual(a, x, b, 3) < tol, "lu_solve: matrix");
+
+        Tensor<double, 1> v = b.slice<1>(1);
+        lu_solve(lu, piv, v);
+        bool same = true;
+        for (std::size_t i = 0; i < n; ++i)
+            same = same && v(i) == x(i, 1);
+        check(same, "lu_solve: vector");
+
+        /// Column-major and strided views give the same solution.
+        Tensor<double, 2> cm(col_major, n, n);
+        Tensor<double, 3> big(n, 2, n);
+        auto view = big.slice<1>(1);
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                cm(i, j) = view(i, j) = a(i, j);
+        std::size_t info = 1;
+        check(solve(cm, b, &info) == x && info == 0, "solve: column-major");
+        check(solve(view, b) == x, "solve: view");
+
+        Tensor<std::size_t, 1> vpiv;
+        check(lu_factor(view, vpiv) == 0, "lu_factor: view");
+        same = true;
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                same = same && view(i, j) == lu(i, j);
+        check(same && vpiv == piv, "lu_factor: view factors");
+    }
+
+    /// A zero column is found at its place, in any block.
+    for (std::size_t z : {0, 5, 63, 64, 70, 129}) {
+        Tensor<double, 2> a(uninitialized, 130, 130), b(uninitialized, 130, 1);
+        fill_uniform(a, Philox(7), -1.0, 1.0);
+        fill_uniform(b, Philox(8), -1.0, 1.0);
+        for (std::size_t i = 0; i < 130; ++i)
+            a(i, z) = 0;
+        Tensor<std::size_t, 1> piv;
+        Tensor<double, 2> lu = a;
+        check(lu_factor(lu, piv) == z + 1, "lu_factor: singular");
+        std::size_t info = 0;
+        solve(a, b, &info);
+        check(info == z + 1, "solve: singular");
+    }
+
+    /// Cholesky.
+    for (std::size_t n : {1, 2, 63, 64, 65, 130, 200}) {
+        const Tensor<double, 2> a = spd(n, n);
+        Tensor<double, 2> b(uninitialized, n, 2);
+        fill_uniform(b, Philox(n + 2000), -1.0, 1.0);
+
+        std::size_t info = 1;
+        const Tensor<double, 2> l = cholesky(a, &info);
+        check(info == 0, "cholesky: info");
+        double err = 0;
+        bool upper = true;
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j) {
+                double s = -a(i, j);
+                for (std::size_t c = 0; c <= std::min(i, j); ++c)
+                    s += l(i, c) * l(j, c);
+                err = std::max(err, std::fabs(s) / a(i, i));
+                upper = upper && (j <= i || l(i, j) == 0);
+            }
+        check(err < tol, "cholesky: l l^T");
+        check(upper, "cholesky: zero upper triangle");
+
+        Tensor<double, 2> x = b;
+        cholesky_solve(l, x);
+        check(residual(a, x, b, 2) < tol, "cholesky_solve");
+
+        /// In place on other layouts: the strictly upper triangle
+        /// is neither read nor written.
+        Tensor<double, 2> cm(col_major, n, n);
+        Tensor<double, 3> big(n, 3, n);
+        auto view = big.slice<1>(2);
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                cm(i, j) = view(i, j) = j > i ? 777.0 : a(i, j);
+        check(cholesky_factor(cm) == 0 && cholesky_factor(view) == 0, "cholesky_factor: layouts");
+        bool same = true;
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j) {
+                const double e = j > i ? 777.0 : l(i, j);
+                same = same && cm(i, j) == e && view(i, j) == e;
+            }
+        check(same, "cholesky_factor: layouts, factors");
+    }
+
+    /// Not positive definite: the first bad pivot, in any block.
+    for (std::size_t z : {0, 5, 64, 70, 129}) {
+        Tensor<double, 2> a = spd(130, 9);
+        a(z, z) = -1;
+        std::size_t info = 0;
+        cholesky(a, &info);
+        check(info == z + 1, "cholesky: indefinite");
+        a(z, z) = std::numeric_limits<double>::quiet_NaN();
+        check(cholesky_factor(a) == z + 1, "cholesky_factor: NaN pivot");
+    }
+    Tensor<double, 2> neg(1, 1);
+    neg(0, 0) = -4;
+    check(cholesky_factor(neg) == 1, "cholesky_factor: 1 x 1");
+
+    /// Triangular solves, unit diagonal or not.
+    {
+        const std::size_t n = 150;
+        Tensor<double, 2> t(uninitialized, n, n), b(uninitialized, n, 4);
+        fill_uniform(t, Philox(11), -1.0, 1.0);
+        fill_uniform(b, Philox(12), -1.0, 1.0);
+        for (std::size_t i = 0; i < n; ++i)
+            t(i, i) = 4 + t(i, i);
+        for (bool unit : {false, true}) {
+            Tensor<double, 2> lo(n, n), up(n, n);
+            for (std::size_t i = 0; i < n; ++i)
+                for (std::size_t j = 0; j < n; ++j) {
+                    const double v = i == j && unit ? 1.0 : t(i, j);
+                    (j <= i ? lo : up)(i, j) = v;
+                    if (i == j)
+                        up(i, j) = v;
+                }
+            Tensor<double, 2> x = b, y = b;
+            solve_lower(t, x, unit);
+            solve_upper(t, y, unit);
+            check(residual(lo, x, b, 4) < tol, "solve_lower");
+            check(residual(up, y, b, 4) < tol, "solve_upper");
+        }
+    }
+
+    if (failures)
+        return 1;
+    std::printf("linalg: ok\n");
+    return 0;
+}
@@ -0,0 +1,186 @@
+// Masks: compare, ~, where, masked_fill and masked_select against
+// scalar loops. Build with and without -march=native to cover both
+// paths of _pack_bits (AVX2 and the portable one).
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static std::uint64_t state = 88172645463325252ull;
+
+static std::uint64_t
+next()
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/// Bits of m against pred(i, j, k) in logical order.
+template <typename P>
+static bool
+same_bits(const Mask<3>& m, P pred)
+{
+    const auto& e = m.extents();
+    std::size_t at = 0;
+    for (std::size_t i = 0; i < e[0]; ++i)
+        for (std::size_t j = 0; j < e[1]; ++j)
+            for (std::size_t k = 0; k < e[2]; ++k)
+                if (m.test(at++) != pred(i, j, k))
+                    return false;
+    return true;
+}
+
+/// Bits past size() are all zero.
+template <std::size_t N>
+static bool
+clean_tail(const Mask<N>& m)
+{ return m.size() % 64 == 0 || (m.data()[m.words() - 1] >> (m.size() % 64)) == 0; }
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+
+    /// Dense, strided (a slice of a larger tensor) and column-major
+    /// operands, with ties; 9 x 50 x 31 spans several blocks and
+    /// ends inside a word.
+    const std::size_t E0 = 9, E1 = 50, E2 = 31;
+    Tensor<float, 3> dense(E0, E1, E2), cm(col_major, E0, E1, E2);
+    Tensor<float, 4> big(E0, 3, E1, E2);
+    auto strided = big.slice<1>(1);
+    for (std::size_t i = 0; i < E0; ++i)
+        for (std::size_t j = 0; j < E1; ++j)
+            for (std::size_t k = 0; k < E2; ++k) {
+                dense(i, j, k) = float(next() % 5);
+                strided(i, j, k) = float(next() % 5);
+                cm(i, j, k) = float(next() % 5);
+            }
+
+    check(same_bits(less(dense, strided),
+                    [&](std::size_t i, std::size_t j, std::size_t k) {
+                        return dense(i, j, k) < strided(i, j, k); }),
+          "less, dense and strided");
+    check(same_bits(equal(cm, dense),
+                    [&](std::size_t i, std::size_t j, std::size_t k) {
+                        return cm(i, j, k) == dense(i, j, k); }),
+          "equal, column-major and dense");
+    check(same_bits(greater_equal(strided, cm),
+                    [&](std::size_t i, std::size_t j, std::size_t k) {
+                        return strided(i, j, k) >= cm(i, j, k); }),
+          "greater_equal, strided and column-major");
+    check(same_bits(not_equal(2.0f, cm),
+                    [&](std::size_t i, std::size_t j, std::size_t k) {
+                        return 2.0f != cm(i, j, k); }),
+          "not_equal, scalar and column-major");
+    check(same_bits(greater(strided, 1.0f),
+                    [&](std::size_t i, std::size_t j, std::size_t k) {
+                        return strided(i, j, k) > 1.0f; }),
+          "greater, strided and scalar");
+
+    /// ~ and the bits past size().
+    {
+        Mask<3> m = less_equal(dense, 2.0f);
+        Mask<3> n = ~m;
+        check(clean_tail(m) && clean_tail(n), "tail bits zero after compare and ~");
+        check(n.count() == n.size() - m.count(), "~ complements every element");
+        check((m & n).count() == 0 && (m | n).all() && (m ^ n).all(), "&, | and ^ with ~");
+        check(clean_tail(~Mask<3>(E0, E1, E2)) && (~Mask<3>(E0, E1, E2)).all(), "~ of an empty mask");
+        check((~Mask<3>({E0, E1, E2}, true)).count() == 0, "~ of a full mask");
+    }
+
+    /// where and masked_fill writing over one of their inputs.
+    {
+        Mask<3> m = greater(dense, 2.0f);
+        Tensor<float, 3> a = dense, b = cm;
+        Tensor<float, 3> expect = where(m, dense, cm);
+        where(a, m, a, b);
+        check(a == expect, "where, out aliasing a");
+        a = dense;
+        where(b, m, a, b);
+        check(b == expect, "where, out aliasing b");
+
+        Tensor<float, 4> copy = big;
+        auto v = copy.slice<1>(1);
+        masked_fill(v, m, -1.0f);
+        check(same_bits(equal(v, -1.0f),
+                        [&](std::size_t i, std::size_t j, std::size_t k) {
+                            return m(i, j, k) || strided(i, j, k) == -1.0f; }),
+              "masked_fill of a strided view");
+        bool untouched = true;
+        for (std::size_t i = 0; i < E0; ++i)
+            for (std::size_t j = 0; j < E1; ++j)
+                for (std::size_t k = 0; k < E2; ++k)
+                    untouched = untouched && copy(i, 0, j, k) == big(i, 0, j, k) &&
+                                copy(i, 2, j, k) == big(i, 2, j, k) &&
+                                (m(i, j, k) || copy(i, 1, j, k) == big(i, 1, j, k));
+        check(untouched, "masked_fill leaves the rest alone");
+
+        Tensor<float, 3> t = dense;
+        masked_assign(t, m, t);
+        check(t == dense, "masked_assign from itself");
+    }
+
+    /// masked_select keeps the logical order across blocks, sparse
+    /// (set bits visited) and dense chunks alike.
+    for (std::uint64_t density : {1, 8, 32, 63}) {
+        Tensor<std::int32_t, 2> x(3, 4173);
+        for (std::size_t i = 0; i < x.size(); ++i)
+            x.data()[i] = std::int32_t(i);
+        Mask<2> m(3, 4173);
+        for (std::size_t i = 0; i < m.size(); ++i)
+            m.set(i, next() % 64 < density);
+        Tensor<std::int32_t, 1> s = masked_select(x, m);
+        std::vector<std::int32_t> ref;
+        for (std::size_t i = 0; i < m.size(); ++i)
+            if (m.test(i))
+                ref.push_back(std::int32_t(i));
+        bool ok = s.size() == ref.size();
+        for (std::size_t i = 0; ok && i < ref.size(); ++i)
+            ok = s(i) == ref[i];
+        check(ok, "masked_select order");
+
+        Tensor<std::int32_t, 2> xc(col_major, 3, 4173);
+        for (std::size_t i = 0; i < 3; ++i)
+            for (std::size_t j = 0; j < 4173; ++j)
+                xc(i, j) = x(i, j);
+        check(masked_select(xc, m) == s, "masked_select of a column-major tensor");
+    }
+
+    /// _pack_bits / _unpack_bits against a scalar loop.
+    {
+        bool ok = true;
+        std::uint8_t c[64], d[64];
+        for (std::size_t r = 0; r < 1000; ++r) {
+            std::uint64_t w = 0;
+            for (std::size_t i = 0; i < 64; ++i) {
+                c[i] = std::uint8_t(next() % (r % 3 + 2) == 0);
+                w |= std::uint64_t(c[i]) << i;
+            }
+            ok = ok && tensor_impl::_pack_bits(c) == w;
+            tensor_impl::_unpack_bits(w, d);
+            for (std::size_t i = 0; i < 64; ++i)
+                ok = ok && d[i] == c[i];
+        }
+        check(ok, "_pack_bits and _unpack_bits");
+    }
+
+    if (failures == 0)
+        std::printf("mask: ok\n");
+    return failures == 0 ? 0 : 1;
+}
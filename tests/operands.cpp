@@ -0,0 +1,103 @@
+// Operators on expiring tensors: operand order and buffer reuse.
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+/// Tensor buffers come from the aligned operator new: count them.
+static std::size_t aligned_allocations = 0;
+
+void*
+operator new(std::size_t n, std::align_val_t a)
+{
+    ++aligned_allocations;
+    const std::size_t al = static_cast<std::size_t>(a);
+    if (void* p = std::aligned_alloc(al, (n + al - 1) / al * al))
+        return p;
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void* p, std::align_val_t) noexcept
+{ std::free(p); }
+
+void
+operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{ std::free(p); }
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+int
+main()
+{
+    /// Non commutative +: the order of the operands is kept.
+    {
+        Tensor<std::string, 1> a{ "a", "b" };
+        Tensor<std::string, 1> b{ "x", "y" };
+        Tensor<std::string, 1> r = a + std::move(Tensor<std::string, 1>(b));
+        check(r(0) == "ax" && r(1) == "by", "a + Tensor&&");
+        Tensor<std::string, 1> l = std::move(Tensor<std::string, 1>(a)) + b;
+        check(l(0) == "ax" && l(1) == "by", "Tensor&& + b");
+    }
+    {
+        Tensor<int, 1> a{ {10, 20} };
+        Tensor<int, 1> b{ {1, 2} };
+        Tensor<int, 1> r = a - (b + b);
+        check(r(0) == 8 && r(1) == 16, "a - Tensor&&");
+    }
+
+    /// A chain allocates only for its first temporary.
+    {
+        Tensor<double, 2> a(300, 200), b(300, 200), c(300, 200), d(300, 200);
+        a.fill(1);
+        b.fill(2);
+        c.fill(3);
+        d.fill(4);
+
+        std::size_t before = aligned_allocations;
+        Tensor<double, 2> r = a + b - c + d;
+        check(aligned_allocations - before == 1, "a + b - c + d: one allocation");
+        check(r(7, 11) == 4, "a + b - c + d: value");
+
+        before = aligned_allocations;
+        Tensor<double, 2> s = -(a + b) * 2.0 + c / 3.0 - (d - 1.0);
+        check(aligned_allocations - before == 3, "-(a + b) * 2 + c / 3 - (d - 1): three allocations");
+        check(s(0, 0) == -8, "-(a + b) * 2 + c / 3 - (d - 1): value");
+
+        before = aligned_allocations;
+        Tensor<double, 2> t = a + (b + (c + d));
+        check(aligned_allocations - before == 1, "a + (b + (c + d)): one allocation");
+        check(t(299, 199) == 10, "a + (b + (c + d)): value");
+    }
+
+    /// A shared operand is only read, so it keeps its buffer.
+    {
+        Tensor<double, 2> a(300, 200), b(300, 200);
+        a.fill(1);
+        b.fill(2);
+        b.share();
+        Tensor<double, 2> c = b;
+
+        std::size_t before = aligned_allocations;
+        a.apply([](double& x, const double& y) { x += y; }, c);
+        check(aligned_allocations == before, "apply(f, shared m): no copy of m");
+        check(std::as_const(b).data() == std::as_const(c).data(), "apply(f, shared m): m still shared");
+        check(a(299, 199) == 3, "apply(f, shared m): value");
+    }
+
+    if (failures == 0)
+        std::printf("operands: ok\n");
+    return failures == 0 ? 0 : 1;
+}
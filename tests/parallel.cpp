@@ -0,0 +1,73 @@
+// Thread_pool: exceptions thrown by the chunks of a parallel_for.
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <atomic>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// Run pool.parallel_for with f throwing on the chunk starting
+/// at bad; returns true if the exception reached the caller.
+static bool
+throws_from(Thread_pool& pool, std::size_t bad, std::atomic<std::size_t>& seen)
+{
+    try {
+        pool.parallel_for(4000, 1000, [&](std::size_t b, std::size_t e) {
+            if (b == bad)
+                throw std::runtime_error("chunk");
+            seen += e - b;
+        });
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+int
+main()
+{
+    /// The library pool is built at first use.
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+
+    Thread_pool pool(4);
+    for (std::size_t bad : {0, 1000, 3000}) {
+        std::atomic<std::size_t> seen{0};
+        check(throws_from(pool, bad, seen), "exception rethrown to the caller");
+        check(seen == 3000, "the other chunks ran to the end");
+    }
+    std::atomic<std::size_t> all{0};
+    pool.parallel_for(4000, 1000, [&](std::size_t b, std::size_t e) { all += e - b; });
+    check(all == 4000, "pool usable after an exception");
+
+    /// From a user callable of a parallel kernel.
+    Tensor<double, 1> t(uninitialized, std::size_t{1} << 20);
+    bool caught = false;
+    try {
+        t.generate([](std::size_t i) {
+            if (i == (std::size_t{3} << 18))
+                throw std::runtime_error("generate");
+            return double(i);
+        });
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    check(caught, "exception from generate");
+    t.generate([](std::size_t i) { return double(i); });
+    check(t(12345) == 12345, "generate after an exception");
+
+    if (failures == 0)
+        std::printf("parallel: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+// Int8 quantization and qgemm against scalar loops.
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// sum_k (a_ik - za_i) * (b_kj - zb_j), from the logical values.
+static Tensor<std::int32_t, 2>
+reference(const Quantized_mat& a, const Quantized_mat& b)
+{
+    Tensor<std::int32_t, 2> r(a.rows(), b.cols());
+    for (std::size_t i = 0; i < a.rows(); ++i)
+        for (std::size_t j = 0; j < b.cols(); ++j)
+            for (std::size_t k = 0; k < a.cols(); ++k)
+                r(i, j) += (a.values(i, k) - a.zero_points(i)) *
+                           (b.values(k, j) - b.zero_points(j));
+    return r;
+}
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+
+    /// Odd sizes: SIMD tails and partial tiles of b.
+    for (Quant_scheme scheme : {Quant_scheme::symmetric, Quant_scheme::asymmetric}) {
+        Tensor<float, 2> fa(uninitialized, 67, 1037), fb(uninitialized, 1037, 301);
+        fill_normal(fa, Philox(1));
+        fill_uniform(fb, Philox(2), -0.5f, 2.0f);
+        Quantized_mat a = quantize(fa, Quant_axis::rows, scheme);
+        Quantized_mat b = quantize(fb, Quant_axis::cols, scheme);
+        check(b.values.descriptor().col_major(), "by cols: column-major values");
+        check(qgemm(a, b) == reference(a, b), "qgemm");
+
+        /// Any layout and no sums: copied and computed.
+        Quantized_mat ra{Tensor<std::int8_t, 2>(col_major, a.rows(), a.cols()),
+                         a.scales, a.zero_points, a.axis, {}};
+        Quantized_mat rb{Tensor<std::int8_t, 2>(b.rows(), b.cols()),
+                         b.scales, b.zero_points, b.axis, {}};
+        for (std::size_t i = 0; i < a.rows(); ++i)
+            for (std::size_t k = 0; k < a.cols(); ++k)
+                ra.values(i, k) = a.values(i, k);
+        for (std::size_t k = 0; k < b.rows(); ++k)
+            for (std::size_t j = 0; j < b.cols(); ++j)
+                rb.values(k, j) = b.values(k, j);
+        check(qgemm(ra, rb) == qgemm(a, b), "qgemm, other layouts");
+
+        /// Round trip within half a step.
+        Tensor<float, 2> da = dequantize(a), db = dequantize(b);
+        bool close = true;
+        for (std::size_t i = 0; i < fa.rows(); ++i)
+            for (std::size_t k = 0; k < fa.cols(); ++k)
+                close = close && std::abs(da(i, k) - fa(i, k)) <= 0.5f * a.scales(i) * 1.001f;
+        for (std::size_t k = 0; k < fb.rows(); ++k)
+            for (std::size_t j = 0; j < fb.cols(); ++j)
+                close = close && std::abs(db(k, j) - fb(k, j)) <= 0.5f * b.scales(j) * 1.001f;
+        check(close, "dequantize");
+
+        Tensor<float, 2> p = a * b;
+        Tensor<double, 2> dr(67, 301);
+        double err = 0, norm = 0;
+        for (std::size_t i = 0; i < 67; ++i)
+            for (std::size_t j = 0; j < 301; ++j) {
+                double acc = 0;
+                for (std::size_t k = 0; k < 1037; ++k)
+                    acc += double(fa(i, k)) * fb(k, j);
+                err = std::max(err, std::abs(p(i, j) - acc));
+                norm = std::max(norm, std::abs(acc));
+            }
+        check(err < 0.02 * norm, "a * b close to the float product");
+    }
+
+    /// Views of any layout quantize as their copies.
+    {
+        Tensor<double, 3> big(uninitialized, 80, 3, 50);
+        fill_normal(big, Philox(3));
+        auto view = big.slice<1>(2);
+        Tensor<double, 2> cm(col_major, 80, 50), copy(80, 50);
+        for (std::size_t i = 0; i < 80; ++i)
+            for (std::size_t j = 0; j < 50; ++j)
+                cm(i, j) = copy(i, j) = big(i, 2, j);
+        for (Quant_axis axis : {Quant_axis::rows, Quant_axis::cols}) {
+            Quantized_mat x = quantize(view, axis), y = quantize(cm, axis),
+                          z = quantize(copy, axis);
+            check(x.values == z.values && x.scales == z.scales && x.sums == z.sums &&
+                  y.values == z.values && y.scales == z.scales && y.sums == z.sums,
+                  "quantize views and column-major tensors");
+        }
+    }
+
+    /// NaN maps to the zero point and does not touch the range.
+    {
+        Tensor<float, 2> m = {{1.0f, std::numeric_limits<float>::quiet_NaN(), 3.0f},
+                              {-2.0f, 0.5f, std::numeric_limits<float>::quiet_NaN()}};
+        Quantized_mat q = quantize(m, Quant_axis::rows, Quant_scheme::asymmetric);
+        check(q.values(0, 1) == q.zero_points(0) && q.values(1, 2) == q.zero_points(1),
+              "NaN quantized to the zero point");
+        check(q.values(0, 2) == 127 && q.values(1, 0) == -127, "NaN ignored by the range");
+    }
+
+    if (failures == 0)
+        std::printf("quantized: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// Random fills: bit-identical for any number of threads (the test
+// runs itself with several pool sizes) and any layout, ranges,
+// moments, and Bernoulli edge cases.
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// FNV-1a of the bytes of t, in logical order.
+template <typename M>
+static std::uint64_t
+hash(const M& t)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (const auto& x : Tensor<Value_type<M>, M::order>(t)) {
+        unsigned char b[sizeof(x)];
+        std::memcpy(b, &x, sizeof(x));
+        for (unsigned char c : b)
+            h = (h ^ c) * 1099511628211ull;
+    }
+    return h;
+}
+
+/// Fills whose results must not depend on the pool.
+static std::string
+fills()
+{
+    std::string s;
+    auto add = [&](std::uint64_t h) { s += std::to_string(h) + " "; };
+    Tensor<float, 2> f(uninitialized, 517, 1023);
+    Tensor<double, 2> d(col_major, 517, 1023);
+    Tensor<std::int32_t, 3> b(uninitialized, 300, 3, 1001);
+    add(hash(fill_uniform(f, Philox(1), -2.0f, 5.0f)));
+    add(hash(fill_normal(f, Philox(2, 7))));
+    add(hash(fill_uniform(d, Philox(3))));
+    add(hash(fill_normal(d, Philox(4), 1.0, 3.0)));
+    add(hash(fill_bernoulli(b.slice<1>(2), Philox(5), 0.3)));
+    return s;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 1) {
+        std::printf("%s\n", fills().c_str());
+        return 0;
+    }
+
+    /// Philox4x32-10 known answer (Salmon et al.): key 0, counter 0.
+    {
+        const auto w = Philox(0)(0);
+        check(w[0] == 0x6627e8d5u && w[1] == 0xe169c58du &&
+              w[2] == 0xbc57ac4cu && w[3] == 0x9b00dbd8u, "Philox known answer");
+    }
+
+    /// Same bits with 1 to 7 threads.
+    {
+        std::string first;
+        for (const char* n : {"1", "2", "3", "4", "7"}) {
+            setenv("TENSOR_NUM_THREADS", n, 1);
+            std::string cmd = std::string(argv[0]) + " child";
+            FILE* p = popen(cmd.c_str(), "r");
+            std::string out;
+            char buf[256];
+            while (p && std::fgets(buf, sizeof(buf), p))
+                out += buf;
+            check(p && pclose(p) == 0 && !out.empty(), "child run");
+            if (first.empty())
+                first = out;
+            check(out == first, "same values for any number of threads");
+        }
+    }
+
+    /// Same values by logical index, whatever the layout.
+    {
+        Tensor<double, 2> rm(uninitialized, 301, 257), cm(col_major, 301, 257);
+        Tensor<double, 3> big(uninitialized, 301, 2, 257);
+        fill_normal(rm, Philox(6));
+        fill_normal(cm, Philox(6));
+        fill_normal(big.slice<1>(1), Philox(6));
+        bool same = true;
+        for (std::size_t i = 0; i < 301; ++i)
+            for (std::size_t j = 0; j < 257; ++j)
+                same = same && rm(i, j) == cm(i, j) && rm(i, j) == big(i, 1, j);
+        check(same, "same values for row-major, column-major and strided");
+
+        Tensor<double, 2> other(uninitialized, 301, 257);
+        fill_normal(other, Philox(6, 1));
+        check(!(other == rm), "streams differ");
+    }
+
+    /// Uniform values in [lo, hi), with 1 and 3 (where lo + u * (hi - lo)
+    /// can round up to hi) and a reversed range.
+    {
+        Tensor<float, 1> f(uninitialized, std::size_t{1} << 24);
+        bool in = true;
+        double sum = 0;
+        for (std::uint64_t seed = 0; seed < 4; ++seed) {
+            fill_uniform(f, Philox(seed), 1.0f, 3.0f);
+            for (float x : f) {
+                in = in && x >= 1.0f && x < 3.0f;
+                sum += x;
+            }
+        }
+        check(in, "float uniform in [lo, hi)");
+        check(std::abs(sum / (4.0 * f.size()) - 2.0) < 1e-3, "float uniform mean");
+
+        fill_uniform(f, Philox(9), 1.0f, -1.0f);
+        in = true;
+        for (float x : f)
+            in = in && x <= 1.0f && x > -1.0f;
+        check(in, "float uniform, reversed range");
+
+        Tensor<double, 1> d(uninitialized, std::size_t{1} << 22);
+        fill_uniform(d, Philox(10), -3.0, 0.5);
+        in = true;
+        for (double x : d)
+            in = in && x >= -3.0 && x < 0.5;
+        check(in, "double uniform in [lo, hi)");
+    }
+
+    /// Normal moments: mean, variance, skewness and kurtosis.
+    {
+        const std::size_t n = std::size_t{1} << 22;
+        Tensor<float, 1> f(uninitialized, n);
+        Tensor<double, 1> d(uninitialized, n);
+        fill_normal(f, Philox(11), 2.0f, 3.0f);
+        fill_normal(d, Philox(12), 2.0, 3.0);
+        auto moments = [&](auto& t, const char* what) {
+            double m1 = 0, m2 = 0, m3 = 0, m4 = 0;
+            bool finite = true;
+            for (auto x : t) {
+                const double z = (double(x) - 2.0) / 3.0;
+                finite = finite && std::isfinite(z);
+                m1 += z;
+                m2 += z * z;
+                m3 += z * z * z;
+                m4 += z * z * z * z;
+            }
+            m1 /= n;
+            m2 /= n;
+            m3 /= n;
+            m4 /= n;
+            /// About 5 standard errors of each estimate.
+            check(finite && std::abs(m1) < 5 / std::sqrt(double(n)) &&
+                  std::abs(m2 - 1) < 5 * std::sqrt(2.0 / n) &&
+                  std::abs(m3) < 5 * std::sqrt(15.0 / n) &&
+                  std::abs(m4 - 3) < 5 * std::sqrt(96.0 / n), what);
+        };
+        moments(f, "float normal moments");
+        moments(d, "double normal moments");
+    }
+
+    /// Bernoulli: p = 0 and p = 1 exactly, p = 0.25 on average.
+    {
+        Tensor<std::uint8_t, 1> b(uninitialized, std::size_t{1} << 22);
+        fill_bernoulli(b, Philox(13), 0.0);
+        check(count_nonzero(b) == 0, "Bernoulli p = 0");
+        fill_bernoulli(b, Philox(13), 1.0);
+        check(count_nonzero(b) == b.size(), "Bernoulli p = 1");
+        fill_bernoulli(b, Philox(13), 0.25);
+        const double freq = double(count_nonzero(b)) / b.size();
+        check(std::abs(freq - 0.25) < 5 * std::sqrt(0.25 * 0.75 / b.size()), "Bernoulli p = 0.25");
+        Tensor<float, 2> f(uninitialized, 100, 100);
+        fill_bernoulli(f, Philox(14), 2.0);
+        check(count_nonzero(f) == f.size(), "Bernoulli p clamped to 1");
+    }
+
+    if (failures == 0)
+        std::printf("random: ok\n");
+    return failures == 0 ? 0 : 1;
+}
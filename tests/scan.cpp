@@ -0,0 +1,120 @@
+// Scans: results against a serial loop, and bit-identical for any
+// number of threads (the test runs itself with several pool sizes).
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// FNV-1a of the bytes of t, read in logical order.
+template <typename M>
+static std::uint64_t
+hash(const M& t)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (const auto& x : Tensor<Value_type<M>, M::order>(t)) {
+        unsigned char b[sizeof(x)];
+        std::memcpy(b, &x, sizeof(x));
+        for (unsigned char c : b)
+            h = (h ^ c) * 1099511628211ull;
+    }
+    return h;
+}
+
+/// Scans whose results must not depend on the pool.
+static std::string
+scans()
+{
+    std::string s;
+    auto add = [&](std::uint64_t h) { s += std::to_string(h) + " "; };
+
+    Tensor<float, 1> one(uninitialized, (std::size_t{1} << 20) + 123);
+    fill_uniform(one, Philox(1), -1.0f, 1.0f);
+    add(hash(cumsum<0>(one)));
+    add(hash(cumsum<0>(one, Scan::exclusive)));
+
+    Tensor<float, 2> few(uninitialized, 3, 300001);
+    fill_normal(few, Philox(2));
+    add(hash(cumsum<1>(few)));
+
+    Tensor<double, 2> many(uninitialized, 9, 140000);
+    fill_normal(many, Philox(3));
+    add(hash(cumsum<1>(many)));
+
+    Tensor<float, 2> cm(col_major, 200000, 3);
+    fill_uniform(cm, Philox(4));
+    add(hash(cumsum<0>(cm)));
+    return s;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 1) {
+        std::printf("%s\n", scans().c_str());
+        return 0;
+    }
+
+    /// Against a serial loop: exact on integers, close on floats.
+    {
+        Tensor<std::int64_t, 2> a(uninitialized, 5, 400000);
+        for (std::size_t i = 0; i < a.size(); ++i)
+            a.data()[i] = std::int64_t(i * 7919 % 1000) - 500;
+        Tensor<std::int64_t, 2> c = cumsum<1>(a), x = cumsum<1>(a, Scan::exclusive);
+        bool same = true;
+        for (std::size_t i = 0; i < 5; ++i) {
+            std::int64_t acc = 0;
+            for (std::size_t j = 0; j < 400000; ++j) {
+                same = same && x(i, j) == acc;
+                acc += a(i, j);
+                same = same && c(i, j) == acc;
+            }
+        }
+        check(same, "integer cumsum along long lines");
+
+        Tensor<double, 1> f(uninitialized, 1 << 20);
+        fill_uniform(f, Philox(5));
+        Tensor<double, 1> g = cumsum<0>(f);
+        double acc = 0, err = 0;
+        for (std::size_t j = 0; j < f.size(); ++j) {
+            acc += f(j);
+            err = std::max(err, std::abs(g(j) - acc) / acc);
+        }
+        check(err < 1e-12, "double cumsum of a long line");
+    }
+
+    /// Same bits with 1 to 7 threads.
+    std::string first;
+    for (const char* n : {"1", "2", "3", "4", "7"}) {
+        setenv("TENSOR_NUM_THREADS", n, 1);
+        std::string cmd = std::string(argv[0]) + " child";
+        FILE* p = popen(cmd.c_str(), "r");
+        std::string out;
+        char buf[256];
+        while (p && std::fgets(buf, sizeof(buf), p))
+            out += buf;
+        check(p && pclose(p) == 0 && !out.empty(), "child run");
+        if (first.empty())
+            first = out;
+        check(out == first, "same results for any number of threads");
+    }
+
+    if (failures == 0)
+        std::printf("scan: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+// softmax, log_softmax, logsumexp and layer_norm against double
+// references, on every row length (up to the block maxima kept on
+// the heap), in place, on views, and on infinite rows.
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// Row lengths: a single element, partial and whole blocks, and
+/// more than _softmax_stack_blocks blocks.
+static const std::size_t lengths[] = {
+    1, 5, tensor_impl::_vmath_block, tensor_impl::_vmath_block + 1, 1000,
+    tensor_impl::_softmax_stack_blocks * tensor_impl::_vmath_block + 37
+};
+
+template <typename T>
+static void
+against_double(T tol, const char* what)
+{
+    bool ok = true;
+    for (std::size_t L : lengths) {
+        const std::size_t R = 5;
+        Tensor<T, 2> x(uninitialized, R, L);
+        fill_normal(x, Philox(L), T(80), T(20));
+        Tensor<T, 2> s = softmax(x), ls = log_softmax(x), ln = layer_norm(x);
+        Tensor<T, 1> lse = logsumexp(x);
+        for (std::size_t i = 0; i < R; ++i) {
+            double m = -std::numeric_limits<double>::infinity(), mean = 0;
+            for (std::size_t j = 0; j < L; ++j) {
+                m = std::max(m, double(x(i, j)));
+                mean += x(i, j);
+            }
+            mean /= double(L);
+            double sum = 0, var = 0;
+            for (std::size_t j = 0; j < L; ++j) {
+                sum += std::exp(double(x(i, j)) - m);
+                var += (x(i, j) - mean) * (x(i, j) - mean);
+            }
+            var /= double(L);
+            const double lsum = m + std::log(sum);
+            ok = ok && std::abs(lse(i) - lsum) <= tol * std::abs(lsum);
+            double total = 0;
+            for (std::size_t j = 0; j < L; ++j) {
+                const double p = std::exp(double(x(i, j)) - lsum);
+                total += s(i, j);
+                ok = ok && std::abs(s(i, j) - p) <= tol * p + std::numeric_limits<T>::min();
+                ok = ok && std::abs(ls(i, j) - (x(i, j) - lsum)) <= tol * std::abs(lsum);
+                const double n = (x(i, j) - mean) / std::sqrt(var + 1e-5);
+                ok = ok && std::abs(ln(i, j) - n) <= tol * (1 + std::abs(n));
+            }
+            ok = ok && std::abs(total - 1) <= tol * (1 + std::sqrt(double(L)));
+        }
+    }
+    check(ok, what);
+}
+
+template <typename T>
+static void
+edges(const char* what)
+{
+    const T inf = std::numeric_limits<T>::infinity();
+    bool ok = true;
+    for (std::size_t L : lengths) {
+        /// Rows: all -inf, one +inf, some -inf, regular.
+        Tensor<T, 2> x(uninitialized, 4, L);
+        fill_normal(x, Philox(L + 1));
+        for (std::size_t j = 0; j < L; ++j) {
+            x(0, j) = -inf;
+            if (j % 3 == 0)
+                x(2, j) = -inf;
+        }
+        x(1, L / 2) = inf;
+        x(2, L - 1) = T(0.5);
+
+        Tensor<T, 2> s = softmax(x), ls = log_softmax(x);
+        Tensor<T, 1> lse = logsumexp(x);
+        ok = ok && lse(0) == -inf && lse(1) == inf && std::isfinite(lse(2)) &&
+             std::isfinite(lse(3));
+        double s2 = 0, s3 = 0;
+        for (std::size_t j = 0; j < L; ++j) {
+            /// As torch: an all -inf row has no distribution.
+            ok = ok && std::isnan(s(0, j)) && std::isnan(ls(0, j));
+            if (j % 3 == 0 && j != L - 1)
+                ok = ok && s(2, j) == 0 && ls(2, j) == -inf;
+            else
+                ok = ok && std::isfinite(ls(2, j));
+            s2 += s(2, j);
+            s3 += s(3, j);
+        }
+        /// Rows do not leak into each other.
+        ok = ok && std::abs(s2 - 1) < 1e-4 && std::abs(s3 - 1) < 1e-4;
+    }
+    check(ok, what);
+}
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+
+    against_double<float>(2e-5f, "float rows against double");
+    against_double<double>(1e-12, "double rows against double");
+    edges<float>("float infinite rows");
+    edges<double>("double infinite rows");
+
+    /// In place, and through views: same bits as dense out of place.
+    for (std::size_t L : lengths) {
+        Tensor<float, 2> x(uninitialized, 7, L);
+        fill_normal(x, Philox(L + 2), 0.0f, 4.0f);
+        Tensor<float, 1> gamma(uninitialized, L), beta(uninitialized, L);
+        fill_normal(gamma, Philox(L + 3));
+        fill_normal(beta, Philox(L + 4));
+        const Tensor<float, 2> s = softmax(x), ls = log_softmax(x), ln = layer_norm(x),
+                               aff = layer_norm(x, gamma, beta);
+
+        Tensor<float, 2> t = x;
+        check(softmax(t, t) == s, "softmax in place");
+        t = x;
+        check(log_softmax(t, t) == ls, "log_softmax in place");
+        t = x;
+        check(layer_norm(t, t) == ln, "layer_norm in place");
+        t = x;
+        check(layer_norm(t, t, gamma, beta) == aff, "affine layer_norm in place");
+
+        /// Strided rows (column-major) and strided gamma / beta.
+        Tensor<float, 2> cm(col_major, 7, L), params(L, 3);
+        for (std::size_t i = 0; i < 7; ++i)
+            for (std::size_t j = 0; j < L; ++j)
+                cm(i, j) = x(i, j);
+        for (std::size_t j = 0; j < L; ++j) {
+            params(j, 0) = gamma(j);
+            params(j, 2) = beta(j);
+        }
+        check(softmax(cm) == s && log_softmax(cm) == ls && layer_norm(cm) == ln,
+              "column-major rows");
+        check(layer_norm(cm, params.slice<1>(0), params.slice<1>(2)) == aff,
+              "affine layer_norm, strided gamma and beta");
+        Tensor<float, 2> out(col_major, 7, L);
+        layer_norm(out, x, params.slice<1>(0), params.slice<1>(2));
+        check(out == aff, "affine layer_norm into a column-major out");
+    }
+
+    if (failures == 0)
+        std::printf("softmax: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// sort, argsort and topk against std::sort / std::stable_sort, on
+// both sides of the network limit and along strided axes of views.
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <vector>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static std::uint64_t state = 88172645463325252ull;
+
+static std::uint64_t
+next()
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/// Values with ties; floats also get infinities and signed zeros.
+template <typename T>
+static T
+draw(std::uint64_t range)
+{
+    const std::uint64_t r = next();
+    if constexpr (std::is_floating_point<T>::value) {
+        switch (r % 16) {
+        case 0: return std::numeric_limits<T>::infinity();
+        case 1: return -std::numeric_limits<T>::infinity();
+        case 2: return T(-0.0);
+        default: break;
+        }
+    }
+    return T(std::int64_t(r >> 8) % std::int64_t(range)) - T(range / 2);
+}
+
+/// Lines of length L along dimension 1 (unit stride) and 0 (strided)
+/// of a row-major tensor, sorted by sort<D> against std::sort.
+template <typename T, typename Comp>
+static bool
+lines(std::size_t L, Comp comp)
+{
+    bool ok = true;
+    Tensor<T, 2> a(uninitialized, 131, L), b(uninitialized, L, 131);
+    for (auto& x : a)
+        x = draw<T>(L < 8 ? 4 : 100);
+    for (auto& x : b)
+        x = draw<T>(L < 8 ? 4 : 100);
+    Tensor<T, 2> ra = a, rb = b;
+    sort<1>(a, comp);
+    sort<0>(b, comp);
+    std::vector<T> line(L);
+    for (std::size_t i = 0; i < 131; ++i) {
+        for (std::size_t j = 0; j < L; ++j)
+            line[j] = ra(i, j);
+        std::sort(line.begin(), line.end(), comp);
+        for (std::size_t j = 0; j < L; ++j)
+            ok = ok && a(i, j) == line[j];
+        for (std::size_t j = 0; j < L; ++j)
+            line[j] = rb(j, i);
+        std::sort(line.begin(), line.end(), comp);
+        for (std::size_t j = 0; j < L; ++j)
+            ok = ok && b(j, i) == line[j];
+    }
+    return ok;
+}
+
+/// Indexes of a line ordered by comp, ties by index.
+template <typename T, typename Comp>
+static std::vector<std::size_t>
+stable_order(const std::vector<T>& v, Comp comp)
+{
+    std::vector<std::size_t> ix(v.size());
+    std::iota(ix.begin(), ix.end(), std::size_t{0});
+    std::stable_sort(ix.begin(), ix.end(), [&](std::size_t a, std::size_t b) {
+        return comp(v[a], v[b]);
+    });
+    return ix;
+}
+
+int
+main()
+{
+    setenv("TENSOR_NUM_THREADS", "4", 1);
+
+    /// Every network length, the first std::sort one, and beyond.
+    bool net = true;
+    for (std::size_t L = 2; L <= tensor_impl::_sort_network_max + 1; ++L)
+        net = net && lines<float>(L, std::less<float>()) &&
+              lines<float>(L, std::greater<float>()) &&
+              lines<double>(L, std::less<double>()) &&
+              lines<std::int32_t>(L, std::greater<std::int32_t>()) &&
+              lines<std::int8_t>(L, std::less<std::int8_t>()) &&
+              lines<std::uint16_t>(L, std::greater<std::uint16_t>());
+    check(net, "sort, network lengths, both directions");
+    check(lines<float>(1000, std::less<float>()) && lines<std::int64_t>(257, std::greater<std::int64_t>()),
+          "sort, long lines");
+    check(lines<float>(17, [](float a, float b) { return a < b; }),
+          "sort, other comparators on short lines");
+
+    /// Along axis 0 of a view: the other slices are left alone.
+    for (std::size_t L : {std::size_t{20}, std::size_t{40}}) {
+        Tensor<float, 3> big(uninitialized, L, 3, 50);
+        for (auto& x : big)
+            x = draw<float>(50);
+        const Tensor<float, 3> ref = big;
+        sort<0>(big.slice<1>(1));
+        bool ok = true;
+        std::vector<float> line(L);
+        for (std::size_t k = 0; k < 50; ++k) {
+            for (std::size_t i = 0; i < L; ++i)
+                line[i] = ref(i, 1, k);
+            std::sort(line.begin(), line.end());
+            for (std::size_t i = 0; i < L; ++i)
+                ok = ok && big(i, 1, k) == line[i] && big(i, 0, k) == ref(i, 0, k) &&
+                     big(i, 2, k) == ref(i, 2, k);
+        }
+        check(ok, "sort along axis 0 of a view");
+    }
+
+    /// argsort keeps ties in their original order, along both axes.
+    for (std::size_t L : {std::size_t{5}, std::size_t{32}, std::size_t{1000}}) {
+        Tensor<std::int32_t, 2> a(uninitialized, 17, L);
+        for (auto& x : a)
+            x = draw<std::int32_t>(4);
+        const auto up = argsort<1>(a);
+        const auto down = argsort<1>(a, std::greater<std::int32_t>());
+        bool ok = true;
+        std::vector<std::int32_t> v(L);
+        for (std::size_t i = 0; i < 17; ++i) {
+            for (std::size_t j = 0; j < L; ++j)
+                v[j] = a(i, j);
+            const auto su = stable_order(v, std::less<std::int32_t>());
+            const auto sd = stable_order(v, std::greater<std::int32_t>());
+            for (std::size_t j = 0; j < L; ++j)
+                ok = ok && up(i, j) == su[j] && down(i, j) == sd[j];
+        }
+        check(ok, "argsort stability");
+
+        Tensor<std::int32_t, 2> t(uninitialized, L, 17);
+        for (std::size_t i = 0; i < L; ++i)
+            for (std::size_t j = 0; j < 17; ++j)
+                t(i, j) = a(j, i);
+        Tensor<std::uint32_t, 2> cols(col_major, L, 17);
+        argsort<0>(cols, t);
+        for (std::size_t j = 0; j < 17; ++j) {
+            for (std::size_t i = 0; i < L; ++i)
+                v[i] = t(i, j);
+            const auto su = stable_order(v, std::less<std::int32_t>());
+            for (std::size_t i = 0; i < L; ++i)
+                ok = ok && cols(i, j) == su[i];
+        }
+        check(ok, "argsort along a strided axis into a column-major out");
+    }
+
+    /// topk: ties by lowest index, heap (8k <= L) and nth_element
+    /// branches, largest and smallest first.
+    for (std::size_t k : {std::size_t{1}, std::size_t{12}, std::size_t{13}, std::size_t{60}, std::size_t{100}}) {
+        const std::size_t L = 100;
+        Tensor<float, 2> a(uninitialized, 9, L);
+        for (auto& x : a)
+            x = float(next() % 6);
+        const auto [vg, ig] = topk<1>(a, k);
+        const auto [vl, il] = topk<1>(a, k, std::less<float>());
+        bool ok = vg.extent(1) == k && ig.extent(1) == k;
+        std::vector<float> v(L);
+        for (std::size_t i = 0; ok && i < 9; ++i) {
+            for (std::size_t j = 0; j < L; ++j)
+                v[j] = a(i, j);
+            const auto sg = stable_order(v, std::greater<float>());
+            const auto sl = stable_order(v, std::less<float>());
+            for (std::size_t j = 0; j < k; ++j)
+                ok = ok && ig(i, j) == sg[j] && vg(i, j) == v[sg[j]] &&
+                     il(i, j) == sl[j] && vl(i, j) == v[sl[j]];
+        }
+        check(ok, 8 * k <= L ? "topk ties, heap" : "topk ties, nth_element");
+
+        /// Along axis 0 of a view.
+        Tensor<float, 3> big(uninitialized, L, 2, 9);
+        for (std::size_t i = 0; i < L; ++i)
+            for (std::size_t j = 0; j < 9; ++j)
+                big(i, 1, j) = a(j, i);
+        const auto [v0, i0] = topk<0>(big.slice<1>(1), k);
+        for (std::size_t j = 0; j < 9; ++j)
+            for (std::size_t r = 0; r < k; ++r)
+                ok = ok && i0(r, j) == ig(j, r) && v0(r, j) == vg(j, r);
+        check(ok, "topk along axis 0 of a view");
+    }
+
+    if (failures == 0)
+        std::printf("sort: ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Vectorized math: documented error bounds and special values.
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include "../include/tensor.h"
+
+using namespace Math;
+
+static int failures = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+/// |got - ref| in ulps of T at ref (long double reference).
+template <typename T>
+long double
+ulps(T got, long double ref)
+{
+    constexpr int mant = std::numeric_limits<T>::digits - 1;
+    constexpr int emin = std::numeric_limits<T>::min_exponent - 1;
+    const int e = ref == 0 ? emin : std::max(std::ilogb(ref), emin);
+    return std::fabs((long double)got - ref) / std::ldexp(1.0L, e - mant);
+}
+
+/// Max error of f on n points of [lo, hi], spaced evenly or
+/// geometrically; fails if it is above bound.
+template <typename T, typename F, typename R>
+void
+sweep(const char* name, F f, R ref, long double lo, long double hi, bool geometric,
+      double bound)
+{
+    const std::size_t n = std::size_t{1} << 20;
+    Tensor<T, 1> x(uninitialized, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        const long double t = (i + 0.5L) / n;
+        x(i) = T(geometric ? lo * std::pow(hi / lo, t) : lo + (hi - lo) * t);
+    }
+    Tensor<T, 1> y = f(x);
+    long double worst = 0;
+    T at = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const long double e = ulps(y(i), ref((long double)x(i)));
+        if (!(e <= worst)) {
+            worst = e;
+            at = x(i);
+        }
+    }
+    if (!(worst <= bound)) {
+        std::printf("FAIL: %s<%s> on [%Lg, %Lg]: %.3Lf ulp at %.17g (bound %g)\n", name,
+                    sizeof(T) == 4 ? "float" : "double", lo, hi, worst, double(at), bound);
+        ++failures;
+    }
+}
+
+template <typename T>
+void
+bounds()
+{
+    auto exp_ = [](const Tensor<T, 1>& x) { return Math::exp(x); };
+    auto log_ = [](const Tensor<T, 1>& x) { return Math::log(x); };
+    auto tanh_ = [](const Tensor<T, 1>& x) { return Math::tanh(x); };
+    auto sigmoid_ = [](const Tensor<T, 1>& x) { return Math::sigmoid(x); };
+    auto erf_ = [](const Tensor<T, 1>& x) { return Math::erf(x); };
+    auto sqrt_ = [](const Tensor<T, 1>& x) { return Math::sqrt(x); };
+    auto rsqrt_ = [](const Tensor<T, 1>& x) { return Math::rsqrt(x); };
+    const long double tiny = std::numeric_limits<T>::denorm_min() * 16.0L;
+    const long double top = std::numeric_limits<T>::max() / 2;
+    const long double exp_hi = sizeof(T) == 4 ? 88.7L : 709.7L;
+    const long double exp_lo = sizeof(T) == 4 ? -103.9L : -745.1L;
+
+    sweep<T>("exp", exp_, [](long double v) { return expl(v); }, exp_lo, exp_hi, false, 1.5);
+    sweep<T>("exp", exp_, [](long double v) { return expl(v); }, -1, 1, false, 1.5);
+    sweep<T>("log", log_, [](long double v) { return logl(v); }, tiny, top, true, 1);
+    sweep<T>("log", log_, [](long double v) { return logl(v); }, 0.5L, 2, false, 1);
+    sweep<T>("tanh", tanh_, [](long double v) { return tanhl(v); }, -10, 10, false, 1.5);
+    sweep<T>("tanh", tanh_, [](long double v) { return tanhl(v); }, 1e-8L, 1, true, 1.5);
+    sweep<T>("sigmoid", sigmoid_, [](long double v) { return 1 / (1 + expl(-v)); },
+             exp_lo + 1, 40, false, 2.5);
+    sweep<T>("erf", erf_, [](long double v) { return erfl(v); }, -6, 6, false, 3);
+    sweep<T>("erf", erf_, [](long double v) { return erfl(v); }, 1e-8L, 1, true, 3);
+    sweep<T>("sqrt", sqrt_, [](long double v) { return sqrtl(v); }, tiny, top, true, 0.5);
+    sweep<T>("rsqrt", rsqrt_, [](long double v) { return 1 / sqrtl(v); }, 1e-30L, 1e30L, true, 1.5);
+}
+
+template <typename T>
+void
+specials()
+{
+    const T inf = std::numeric_limits<T>::infinity();
+    const T nan = std::numeric_limits<T>::quiet_NaN();
+    Tensor<T, 1> x{ {T(-0.0), T(0), T(1), T(-1), inf, -inf, nan} };
+    const auto e = Math::exp(x);
+    const auto l = Math::log(x);
+    const auto t = Math::tanh(x);
+    const auto f = Math::erf(x);
+    check(e(0) == 1 && e(4) == inf && e(5) == 0 && std::isnan(e(6)), "exp specials");
+    check(l(0) == -inf && l(1) == -inf && l(2) == 0 && std::isnan(l(3)) && l(4) == inf &&
+          std::isnan(l(5)) && std::isnan(l(6)), "log specials");
+    check(t(0) == 0 && std::signbit(t(0)) && !std::signbit(t(1)) && t(4) == 1 && t(5) == -1 &&
+          std::isnan(t(6)), "tanh specials (signed zero)");
+    check(std::signbit(f(0)) && f(4) == 1 && f(5) == -1 && std::isnan(f(6)), "erf specials");
+}
+
+int
+main()
+{
+    bounds<float>();
+    bounds<double>();
+    specials<float>();
+    specials<double>();
+
+    if (failures == 0)
+        std::printf("vmath: ok\n");
+    return failures == 0 ? 0 : 1;
+}